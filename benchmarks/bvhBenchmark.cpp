@@ -0,0 +1,163 @@
+// BVH benchmark: build time and tree quality, then random ray casts, sphere
+// sweeps and box overlap queries per second against teapot.obj and peter.obj
+// (or the files given on the command line). The first rays are checked against
+// a brute force loop over every triangle.
+//
+// Usage: bvhBenchmark [rays] [files...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/model.hpp>
+#include <common/assets.hpp>
+#include <common/bvh.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Small fast generator so the random numbers don't dominate the timings
+static unsigned int seed = 1;
+static float random01()
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static glm::vec3 randomPoint(const glm::vec3& min, const glm::vec3& max)
+{
+    return min + (max - min) * glm::vec3(random01(), random01(), random01());
+}
+
+static glm::vec3 randomDirection()
+{
+    float z = 2.0f * random01() - 1.0f;
+    float angle = 6.2831853f * random01();
+    float r = sqrtf(1.0f - z * z);
+    return glm::vec3(r * cosf(angle), r * sinf(angle), z);
+}
+
+// Closest hit by testing every triangle
+static float bruteForceRaycast(const BVH& bvh, const glm::vec3& origin, const glm::vec3& direction)
+{
+    float best = FLT_MAX;
+    for (const BVHTriangle& triangle : bvh.triangles)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.edge2);
+        float det = glm::dot(triangle.edge1, p);
+        if (fabsf(det) < 1e-12f)
+            continue;
+        float inverseDet = 1.0f / det;
+        glm::vec3 s = origin - triangle.v0;
+        float u = glm::dot(s, p) * inverseDet;
+        glm::vec3 q = glm::cross(s, triangle.edge1);
+        float v = glm::dot(direction, q) * inverseDet;
+        float t = glm::dot(triangle.edge2, q) * inverseDet;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int numRays = argc > 1 ? atoi(argv[1]) : 2000000;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+        paths = { "../assets/teapot.obj", "../assets/peter.obj" };
+
+    for (const std::string& path : paths)
+    {
+        MeshSource source;
+        if (!source.load(path.c_str()))
+            continue;
+
+        // Build a fresh tree to time it (the one in the source may come from the cache)
+        Clock::time_point start = Clock::now();
+        BVH bvh;
+        bvh.build(source.vertices, source.indices, source.numIndices, source.indexSize);
+        double buildTime = milliseconds(start);
+
+        glm::vec3 min = bvh.nodes[0].min, max = bvh.nodes[0].max;
+        glm::vec3 centre = 0.5f * (min + max);
+        float extent = glm::length(max - min);
+
+        unsigned int leaves = 0;
+        for (const BVHNode& node : bvh.nodes)
+            leaves += node.count > 0;
+        printf("\n%s: %zu triangles, %zu nodes (%u leaves), SAH cost %.1f, build %.2f ms (cached tree %s)\n",
+            path.c_str(), bvh.triangles.size(), bvh.nodes.size(), leaves, bvh.cost(), buildTime,
+            source.bvh->nodes.size() == bvh.nodes.size() ? "matches" : "differs");
+
+        // Rays from a sphere around the mesh towards random points in its bounds
+        std::vector<glm::vec3> origins(numRays), directions(numRays);
+        for (unsigned int i = 0; i < numRays; i++)
+        {
+            origins[i] = centre + randomDirection() * extent;
+            directions[i] = glm::normalize(randomPoint(min, max) - origins[i]);
+        }
+
+        // Check against brute force
+        unsigned int numChecked = std::min(numRays, 2000u), mismatches = 0;
+        for (unsigned int i = 0; i < numChecked; i++)
+        {
+            RayHit hit;
+            float expected = bruteForceRaycast(bvh, origins[i], directions[i]);
+            bool found = bvh.raycast(origins[i], directions[i], FLT_MAX, hit);
+            if (found != (expected < FLT_MAX) || (found && fabsf(hit.distance - expected) > 1e-4f * extent))
+                mismatches++;
+        }
+
+        start = Clock::now();
+        unsigned int hits = 0;
+        for (unsigned int i = 0; i < numRays; i++)
+        {
+            RayHit hit;
+            hits += bvh.raycast(origins[i], directions[i], FLT_MAX, hit);
+        }
+        double rayTime = milliseconds(start);
+        printf("  rays:    %6.2f M/s, %4.1f%% hit, %u of %u checked against brute force differ\n",
+            numRays / rayTime / 1000.0, 100.0 * hits / numRays, mismatches, numChecked);
+
+        // Sphere sweeps of a few percent of the mesh size along the same paths
+        unsigned int numSweeps = numRays / 4;
+        float radius = 0.02f * extent;
+        start = Clock::now();
+        hits = 0;
+        for (unsigned int i = 0; i < numSweeps; i++)
+        {
+            RayHit hit;
+            hits += bvh.sphereSweep(origins[i], origins[i] + directions[i] * (2.0f * extent), radius, hit);
+        }
+        double sweepTime = milliseconds(start);
+        printf("  sweeps:  %6.2f M/s, %4.1f%% hit (radius %.3f)\n",
+            numSweeps / sweepTime / 1000.0, 100.0 * hits / numSweeps, radius);
+
+        // Boxes a few percent of the mesh size anywhere in its bounds
+        glm::vec3 halfSize = glm::vec3(0.02f * extent);
+        start = Clock::now();
+        hits = 0;
+        for (unsigned int i = 0; i < numRays; i++)
+        {
+            glm::vec3 point = randomPoint(min, max);
+            hits += bvh.overlapBox(point - halfSize, point + halfSize);
+        }
+        double boxTime = milliseconds(start);
+        printf("  boxes:   %6.2f M/s, %4.1f%% overlap\n", numRays / boxTime / 1000.0, 100.0 * hits / numRays);
+    }
+
+    return 0;
+}
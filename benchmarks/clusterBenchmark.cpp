@@ -0,0 +1,105 @@
+// Light cluster assignment benchmark: 100, 500, 1000 and 4000 point lights (or
+// the counts given on the command line) scattered around the game camera are
+// listed in the 16 x 12 x 24 clusters of its view frustum, on the calling thread
+// and split between 1, 2, 4, ... job system threads up to one per core. Reports the
+// assignment time, the lights per lit cluster (what a fragment loops over,
+// against every light without clustering) and checks the threaded lists match.
+//
+// Usage: clusterBenchmark [lights...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <common/clusters.hpp>
+#include <common/jobs.hpp>
+#include <common/maths.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static unsigned int seed = 1;
+static float random01()
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Best time of a few assignments
+static double timeAssign(LightClusters& clusters, JobSystem* jobSystem)
+{
+    double best = 1e30;
+    for (int r = 0; r < 20; r++)
+    {
+        Clock::time_point start = Clock::now();
+        clusters.assign(jobSystem);
+        best = std::min(best, milliseconds(start));
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<unsigned int> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back(atoi(argv[i]));
+    if (counts.empty())
+        counts = { 100, 500, 1000, 4000 };
+
+    // The game's camera looking along a 60 x 60 room
+    float near = 0.1f, far = 100.0f;
+    glm::mat4 projection = glm::perspective(Maths::radians(90.0f), 1024.0f / 768.0f, near, far);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::unique_ptr<JobSystem>> systems;
+    for (unsigned int threads = 1; threads <= cores; threads *= 2)
+        systems.emplace_back(new JobSystem(threads));
+
+    printf("%u x %u x %u clusters, %u cores, best of 20 kept\n", LightClusters::tilesX, LightClusters::tilesY,
+        LightClusters::slices, cores);
+
+    for (unsigned int count : counts)
+    {
+        // Point lights on and above the floor, reaching 1 to 4 units
+        LightClusters clusters;
+        clusters.setProjection(projection, near, far, 1024.0f, 768.0f);
+        clusters.lights.resize(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            LightBlock& light = clusters.lights[i];
+            glm::vec3 position(60.0f * random01() - 30.0f, 3.0f * random01() - 1.0f, 60.0f * random01() - 30.0f);
+            light.position = glm::vec3(view * glm::vec4(position, 1.0f));
+            light.type = 1;
+            light.range = 1.0f + 3.0f * random01();
+        }
+
+        double time = timeAssign(clusters, nullptr);
+        std::vector<glm::uvec2> expectedClusters = clusters.clusters;
+        std::vector<unsigned int> expectedIndices = clusters.indices;
+        float perCluster = clusters.indices.size() / std::max(float(clusters.litClusters), 1.0f);
+        printf("\n%u lights: %zu indices, %u clusters lit, %.1f lights per lit cluster (max %u, %.0fx fewer than all)\n",
+            count, clusters.indices.size(), clusters.litClusters, perCluster, clusters.maxClusterLights,
+            count / std::max(perCluster, 1.0f));
+        printf("  %-10s %8.3f ms\n", "no jobs", time);
+
+        for (std::unique_ptr<JobSystem>& jobSystem : systems)
+        {
+            double jobsTime = timeAssign(clusters, jobSystem.get());
+            bool match = clusters.clusters == expectedClusters && clusters.indices == expectedIndices;
+            printf("  %2u threads %8.3f ms   %5.2fx   %s\n", jobSystem->size(), jobsTime, time / jobsTime,
+                match ? "lists match" : "LISTS DIFFER");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Collision broadphase benchmark: moving circle colliders kept in a SpatialHash,
+// updated incrementally each frame and queried for every overlapping pair. The
+// colliders are spread so the density stays the same as the count grows, and
+// the brute force O(n^2) check is run for the smaller counts to confirm the
+// pairs found match.
+//
+// Usage: collisionBenchmark [max colliders] [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <common/spatialhash.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static float random(float min, float max)
+{
+    return min + (max - min) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int maxColliders = argc > 1 ? atoi(argv[1]) : 100000;
+    int frames = argc > 2 ? atoi(argv[2]) : 30;
+    float deltaTime = 1.0f / 60.0f;
+
+    printf("%d frames (median ms per frame)\n", frames);
+    printf("%10s %10s %10s %14s %10s %14s %10s\n", "colliders", "update", "pairs", "pairs tested",
+        "found", "brute force", "brute ms");
+
+    for (unsigned int numColliders = 1000; numColliders <= maxColliders; numColliders *= 10)
+    {
+        // About one collider per 4 square units whatever the count
+        float halfSize = sqrtf(static_cast<float>(numColliders));
+        std::vector<glm::vec3> positions(numColliders), velocities(numColliders);
+        std::vector<float> radii(numColliders);
+        srand(1);
+        for (unsigned int i = 0; i < numColliders; i++)
+        {
+            positions[i] = glm::vec3(random(-halfSize, halfSize), 0.0f, random(-halfSize, halfSize));
+            velocities[i] = glm::vec3(random(-5.0f, 5.0f), 0.0f, random(-5.0f, 5.0f));
+            radii[i] = random(0.25f, 0.5f);
+        }
+
+        SpatialHash grid(1.0f, numColliders * 4);
+        std::vector<glm::uvec2> pairs;
+        std::vector<double> updateTimes, pairTimes;
+        unsigned int tested = 0, found = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            // Move (bouncing off the edges) and update the grid
+            Clock::time_point start = Clock::now();
+            for (unsigned int i = 0; i < numColliders; i++)
+            {
+                positions[i] += velocities[i] * deltaTime;
+                if (fabsf(positions[i].x) > halfSize)
+                    velocities[i].x = -velocities[i].x;
+                if (fabsf(positions[i].z) > halfSize)
+                    velocities[i].z = -velocities[i].z;
+                grid.update(i, positions[i], radii[i]);
+            }
+            updateTimes.push_back(milliseconds(start));
+
+            start = Clock::now();
+            grid.resetCounts();
+            grid.pairs(pairs);
+            pairTimes.push_back(milliseconds(start));
+            tested = grid.pairsTested;
+            found = grid.pairsFound;
+        }
+
+        // Brute force check of the last frame
+        unsigned long long bruteTests = static_cast<unsigned long long>(numColliders) * (numColliders - 1) / 2;
+        if (numColliders <= 10000)
+        {
+            Clock::time_point start = Clock::now();
+            unsigned int bruteFound = 0;
+            for (unsigned int i = 0; i < numColliders; i++)
+            {
+                for (unsigned int j = i + 1; j < numColliders; j++)
+                {
+                    float dx = positions[i].x - positions[j].x;
+                    float dz = positions[i].z - positions[j].z;
+                    float distance = radii[i] + radii[j];
+                    bruteFound += dx * dx + dz * dz <= distance * distance;
+                }
+            }
+            double bruteTime = milliseconds(start);
+            printf("%10u %10.3f %10.3f %14u %10u %14llu %10.2f%s\n", numColliders, median(updateTimes),
+                median(pairTimes), tested, found, bruteTests, bruteTime,
+                bruteFound == found ? "" : "  MISMATCH");
+        }
+        else
+        {
+            printf("%10u %10.3f %10.3f %14u %10u %14llu %10s\n", numColliders, median(updateTimes),
+                median(pairTimes), tested, found, bruteTests, "-");
+        }
+    }
+
+    return 0;
+}
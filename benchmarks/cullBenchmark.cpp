@@ -0,0 +1,93 @@
+// Frustum culling benchmark: 1M bounding spheres (or the count given on the
+// command line) scattered around a camera, culled one at a time with
+// Frustum::sphereVisible and in batches with Frustum::cullSpheres at every SIMD
+// level this CPU supports. Each batched result is checked against the one at a
+// time result.
+//
+// Usage: cullBenchmark [spheres] [repeats]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <common/frustum.hpp>
+#include <common/maths.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static unsigned int seed = 1;
+static float random01()
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 10;
+
+    // Spheres in a 200 x 40 x 200 box around the camera
+    std::vector<glm::vec4> spheres(count);
+    for (unsigned int i = 0; i < count; i++)
+        spheres[i] = glm::vec4(200.0f * random01() - 100.0f, 40.0f * random01() - 20.0f,
+            200.0f * random01() - 100.0f, 0.05f + 2.0f * random01());
+
+    // The game's camera, turning a little between repeats
+    glm::mat4 projection = glm::perspective(Maths::radians(45.0f), 1024.0f / 768.0f, 0.1f, 100.0f);
+    std::vector<Frustum> frustums(repeats);
+    for (int r = 0; r < repeats; r++)
+    {
+        float yaw = 0.6f * r;
+        glm::vec3 front(cosf(yaw), 0.0f, sinf(yaw));
+        frustums[r].update(projection * glm::lookAt(glm::vec3(0.0f), front, glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
+
+    printf("%u spheres, %d repeats (best time kept), best SIMD level %s\n", count, repeats,
+        Maths::simdName(Maths::maxSimdLevel()));
+
+    // One at a time
+    std::vector<std::vector<unsigned int>> expected(repeats);
+    double oneTime = 1e30;
+    for (int r = 0; r < repeats; r++)
+    {
+        expected[r].reserve(count);
+        Clock::time_point start = Clock::now();
+        for (unsigned int i = 0; i < count; i++)
+            if (frustums[r].sphereVisible(glm::vec3(spheres[i]), spheres[i].w))
+                expected[r].push_back(i);
+        oneTime = std::min(oneTime, milliseconds(start));
+    }
+    printf("  %-12s %8.2f ms %8.1f M spheres/s   %zu visible (%.1f%%)\n", "one at a time", oneTime,
+        count / oneTime / 1000.0, expected[0].size(), 100.0 * expected[0].size() / count);
+
+    // Batched
+    std::vector<unsigned int> visible;
+    visible.reserve(count);
+    for (int level = Maths::SIMD_SCALAR; level <= Maths::maxSimdLevel(); level++)
+    {
+        Maths::simdLevel = Maths::SimdLevel(level);
+        double time = 1e30;
+        unsigned int mismatches = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point start = Clock::now();
+            frustums[r].cullSpheres(count, spheres.data(), visible);
+            time = std::min(time, milliseconds(start));
+            mismatches += visible != expected[r];
+        }
+        printf("  %-12s %8.2f ms %8.1f M spheres/s   %5.1fx   %d of %d frames differ\n",
+            Maths::simdName(Maths::SimdLevel(level)), time, count / time / 1000.0, oneTime / time, mismatches, repeats);
+    }
+    Maths::simdLevel = Maths::maxSimdLevel();
+
+    return 0;
+}
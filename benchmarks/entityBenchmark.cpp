@@ -0,0 +1,179 @@
+// Entity update benchmark: the old std::vector<Object> loop (string names compared
+// per object) against the structure of arrays EntityStore. Each frame moves the
+// bullets, animates the teapots, builds the model matrices and queues every
+// entity with the InstancedRenderer (no GL context, nothing is drawn).
+//
+// Usage: entityBenchmark [entities] [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/maths.hpp>
+#include <common/model.hpp>
+#include <common/renderer.hpp>
+#include <common/entities.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// The Object struct coursework.cpp used before the entity store
+struct LegacyObject
+{
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+    float angle = 0.0f;
+    float width = 0.0f;
+    std::string name;
+    objectType type;
+};
+
+int main(int argc, char** argv)
+{
+    unsigned int numEntities = argc > 1 ? atoi(argv[1]) : 100000;
+    int frames = argc > 2 ? atoi(argv[2]) : 100;
+
+    // Stand-ins for the scene's models (distinct materials so they don't group)
+    Model teapot, teapotGun, bullet, walls, floor;
+    teapot.ka = 1.0f;
+    teapotGun.ka = 2.0f;
+    bullet.ka = 3.0f;
+    walls.ka = 4.0f;
+    floor.ka = 5.0f;
+
+    // Mostly bullets, with the rest split between the other kinds
+    const char* names[] = { "bullet", "staticTeapot", "teapotGun", "walls", "floor", "roof" };
+    const EntityTag tags[] = { BULLET, STATIC_TEAPOT, TEAPOT_GUN, WALLS, FLOOR, ROOF };
+    const Model* models[] = { &bullet, &teapot, &teapotGun, &walls, &floor, &floor };
+
+    std::vector<LegacyObject> objects;
+    EntityStore entities;
+    entities.reserve(numEntities);
+    srand(1);
+    for (unsigned int i = 0; i < numEntities; i++)
+    {
+        unsigned int kind = (i % 10 < 5) ? 0 : 1 + i % 5;
+
+        Object object;
+        object.position = glm::vec3(rand() % 100 - 50.0f, 0.0f, rand() % 100 - 50.0f);
+        object.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+        object.scale = glm::vec3(0.5f);
+        object.angle = (rand() % 360) * 0.0174533f;
+        object.tag = tags[kind];
+        object.model = models[kind];
+        object.type = ENVINOMENT;
+        object.velocity = kind == 0 ? glm::vec3(1.0f, 0.0f, 0.5f) * 20.0f : glm::vec3(0.0f);
+        entities.spawn(object);
+
+        LegacyObject legacy;
+        legacy.position = object.position;
+        legacy.rotation = object.rotation;
+        legacy.scale = object.scale;
+        legacy.angle = object.angle;
+        legacy.name = names[kind];
+        legacy.type = ENVINOMENT;
+        objects.push_back(legacy);
+    }
+
+    glm::vec3 bulletDirection = glm::vec3(1.0f, 0.0f, 0.5f);
+    glm::vec3 eye = glm::vec3(0.0f, 0.0f, 4.0f);
+    glm::vec3 front = glm::vec3(0.0f, 0.0f, -1.0f);
+    float deltaTime = 1.0f / 60.0f;
+    InstancedRenderer renderer;
+
+    // Old loop: string compares per object to pick the behaviour and the model
+    std::vector<double> legacyTimes;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        float time = frame * deltaTime;
+        Clock::time_point start = Clock::now();
+        renderer.begin();
+        for (unsigned int i = 0; i < static_cast<unsigned int>(objects.size()); i++)
+        {
+            if (objects[i].name == "staticTeapot")
+            {
+                objects[i].position.y = 0.5 * Maths::square(sinf(time * 2));
+                objects[i].angle = time * 2;
+            }
+            if (objects[i].name == "teapotGun")
+            {
+                objects[i].position = eye + Maths::normalise(front) * glm::vec3(1.0f, 0.0f, 1.0f);
+                objects[i].angle = 0.0f;
+            }
+            if (objects[i].name == "bullet")
+                objects[i].position += bulletDirection * 20.0f * deltaTime;
+
+            glm::mat4 translate = Maths::translate(objects[i].position);
+            glm::mat4 scale = Maths::scale(objects[i].scale);
+            glm::mat4 rotate = Maths::rotate(objects[i].angle, objects[i].rotation);
+            glm::mat4 model = translate * rotate * scale;
+
+            if (objects[i].name == "staticTeapot")
+                renderer.add(teapot, model);
+            if (objects[i].name == "teapotGun")
+                renderer.add(teapotGun, model);
+            if (objects[i].name == "bullet")
+                renderer.add(bullet, model);
+            if (objects[i].name == "walls")
+                renderer.add(walls, model);
+            if (objects[i].name == "floor" || objects[i].name == "roof")
+                renderer.add(floor, model);
+        }
+        legacyTimes.push_back(milliseconds(start));
+    }
+    unsigned int legacyInstances = renderer.numInstances();
+
+    // Entity store: integer tags, then one pass per system
+    std::vector<double> storeTimes, updateTimes;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        float time = frame * deltaTime;
+        Clock::time_point start = Clock::now();
+        for (unsigned int i = 0; i < entities.size(); i++)
+        {
+            if (entities.tags[i] == STATIC_TEAPOT)
+            {
+                entities.positions[i].y = 0.5 * Maths::square(sinf(time * 2));
+                entities.angles[i] = time * 2;
+            }
+            if (entities.tags[i] == TEAPOT_GUN)
+            {
+                entities.positions[i] = eye + Maths::normalise(front) * glm::vec3(1.0f, 0.0f, 1.0f);
+                entities.angles[i] = 0.0f;
+            }
+        }
+        entities.move(deltaTime);
+        entities.updateTransforms();
+        updateTimes.push_back(milliseconds(start));
+
+        renderer.begin();
+        entities.submit(renderer.instances);
+        storeTimes.push_back(milliseconds(start));
+    }
+
+    printf("%u entities, %d frames (median ms per frame)\n", numEntities, frames);
+    printf("%-28s %10s %10s %10s\n", "", "update", "total", "instances");
+    printf("%-28s %10s %10.3f %10u\n", "std::vector<Object>", "-", median(legacyTimes), legacyInstances);
+    printf("%-28s %10.3f %10.3f %10u\n", "EntityStore", median(updateTimes), median(storeTimes),
+        renderer.numInstances());
+    printf("speedup %.2fx\n", median(legacyTimes) / median(storeTimes));
+
+    return 0;
+}
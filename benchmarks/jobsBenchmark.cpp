@@ -0,0 +1,160 @@
+// Job system benchmark: how the work-stealing job system scales over 1, 2, 4, ...
+// threads up to one per core. Times a synthetic parallel_for (a few hundred
+// nanoseconds of maths per index), many tiny jobs (the scheduling overhead),
+// nested parallel_fors with a dependent job per group (waits inside jobs), and
+// the tangent generation of peter.obj repeated [copies] times (or the file given
+// on the command line) split into jobs. Reports the best time of each and the
+// speedup over one thread.
+//
+// Usage: jobsBenchmark [copies] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/model.hpp>
+#include <common/meshoptimiser.hpp>
+#include <common/jobs.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+// Best of a few runs in milliseconds
+template <class F>
+static double bestTime(F run)
+{
+    double best = 1e30;
+    for (int r = 0; r < 5; r++)
+    {
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+// Some maths that doesn't touch memory, so the threads don't share a bottleneck
+static float work(unsigned int index)
+{
+    float x = index * 1e-6f;
+    for (int i = 0; i < 32; i++)
+        x = sinf(x) * 0.5f + sqrtf(x + 1.0f);
+    return x;
+}
+
+// parallel_for over a million indices, each writing its own result
+static void syntheticFor(JobSystem& jobSystem, std::vector<float>& results)
+{
+    jobSystem.parallelFor(static_cast<unsigned int>(results.size()), 0, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+            results[i] = work(i);
+    });
+}
+
+// 100k jobs that each do almost nothing
+static void tinyJobs(JobSystem& jobSystem, std::atomic<unsigned int>& total)
+{
+    JobCounter counter;
+    for (unsigned int i = 0; i < 100000; i++)
+        jobSystem.run([&total] { total.fetch_add(1, std::memory_order_relaxed); }, &counter);
+    jobSystem.wait(counter);
+}
+
+// 64 groups, each a parallel_for over 4096 indices followed by a job that
+// depends on it and sums the group
+static void nestedJobs(JobSystem& jobSystem, std::vector<float>& results, std::vector<float>& sums)
+{
+    const unsigned int groupSize = 4096;
+    jobSystem.parallelFor(64, 1, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int group = begin; group < end; group++)
+        {
+            JobCounter counter;
+            jobSystem.run([&, group]
+            {
+                jobSystem.parallelFor(groupSize, 512, [&](unsigned int first, unsigned int last)
+                {
+                    for (unsigned int i = first; i < last; i++)
+                        results[group * groupSize + i] = work(group * groupSize + i);
+                });
+            }, &counter);
+
+            JobCounter sumCounter;
+            jobSystem.runAfter(counter, [&, group]
+            {
+                float sum = 0.0f;
+                for (unsigned int i = 0; i < groupSize; i++)
+                    sum += results[group * groupSize + i];
+                sums[group] = sum;
+            }, &sumCounter);
+            jobSystem.wait(sumCounter);
+            jobSystem.wait(counter);
+        }
+    });
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int copies = argc > 1 ? atoi(argv[1]) : 16;
+    std::string path = argc > 2 ? argv[2] : "../assets/peter.obj";
+
+    // The mesh for the tangents, indexed and optimised as the game loads it
+    MeshData mesh;
+    std::vector<Vertex> corners;
+    if (Model::loadObj(path.c_str(), corners))
+    {
+        MeshData single;
+        Model::buildIndexed(corners, single);
+        MeshOptimiser::optimiseVertexCache(single.indices, static_cast<unsigned int>(single.vertices.size()));
+        MeshOptimiser::optimiseVertexFetch(single);
+        for (unsigned int c = 0; c < copies; c++)
+        {
+            unsigned int offset = static_cast<unsigned int>(mesh.vertices.size());
+            mesh.vertices.insert(mesh.vertices.end(), single.vertices.begin(), single.vertices.end());
+            for (unsigned int index : single.indices)
+                mesh.indices.push_back(offset + index);
+        }
+    }
+
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < cores; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(cores);
+
+    printf("%u cores, %zu triangles of tangents (%s x%u). Times in ms (best of 5), speedup over 1 thread\n",
+        cores, mesh.indices.size() / 3, path.c_str(), copies);
+    printf("%-8s %18s %18s %18s %18s\n", "threads", "parallel_for", "100k tiny jobs", "nested", "tangents");
+
+    std::vector<float> results(1 << 20);
+    std::vector<float> sums(64);
+    double base[4] = {};
+    for (unsigned int threads : threadCounts)
+    {
+        JobSystem jobSystem(threads);
+        std::atomic<unsigned int> total(0);
+        double times[4];
+        times[0] = bestTime([&] { syntheticFor(jobSystem, results); });
+        times[1] = bestTime([&] { tinyJobs(jobSystem, total); });
+        times[2] = bestTime([&] { nestedJobs(jobSystem, results, sums); });
+        times[3] = mesh.indices.empty() ? 0.0 : bestTime([&] { Model::calculateTangents(mesh, &jobSystem); });
+        if (threads == 1)
+            std::copy(times, times + 4, base);
+
+        printf("%-8u", threads);
+        for (int i = 0; i < 4; i++)
+            printf(" %9.2f (%5.2fx)", times[i], times[i] > 0.0 ? base[i] / times[i] : 0.0);
+        printf("%s\n", total == 500000 ? "" : "   jobs lost!");
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Startup benchmark: cold .obj parse vs warm binary mesh cache load for every
+// .obj in the assets folder.
+//
+// Usage: meshCacheBenchmark [assets folder] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/model.hpp>
+#include <common/meshcache.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char** argv)
+{
+    std::string folder = argc > 1 ? argv[1] : "../assets";
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+    // Collect the .obj files
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(folder))
+        if (entry.path().extension() == ".obj")
+            paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+
+    printf("%-16s %8s %9s %9s %10s %10s %10s %10s %8s\n", "asset", "obj KB", "corners", "vertices",
+        "upload KB", "(was KB)", "cold ms", "warm ms", "speedup");
+
+    double totalCold = 0.0, totalWarm = 0.0;
+    for (const std::string& path : paths)
+    {
+        std::vector<double> cold, warm;
+        unsigned int numVertices = 0, numIndices = 0, indexSize = 0;
+        uint64_t sourceHash = 0, sourceSize = 0;
+        std::string cachePath = MeshCache::cachePath(path.c_str());
+
+        for (int i = 0; i < iterations; i++)
+        {
+            // Cold: hash, parse the text and calculate tangents
+            Clock::time_point start = Clock::now();
+            MeshCache::hashFile(path.c_str(), sourceHash, sourceSize);
+            MeshData mesh;
+            Model::loadMesh(path.c_str(), mesh);
+            cold.push_back(milliseconds(start));
+
+            numVertices = static_cast<unsigned int>(mesh.vertices.size());
+            numIndices = static_cast<unsigned int>(mesh.indices.size());
+            indexSize = mesh.indexSize();
+            MeshCache::write(cachePath.c_str(), sourceHash, sourceSize, mesh);
+
+            // Warm: hash, map the cache and touch every vertex as an upload would
+            start = Clock::now();
+            MeshCache::hashFile(path.c_str(), sourceHash, sourceSize);
+            MeshCache cache;
+            float checksum = 0.0f;
+            if (cache.open(cachePath.c_str(), sourceHash, sourceSize))
+            {
+                for (unsigned int v = 0; v < cache.numVertices; v++)
+                    checksum += cache.vertices[v].position.x;
+                const unsigned char* indices = static_cast<const unsigned char*>(cache.indices);
+                for (unsigned int i = 0; i < cache.numIndices * cache.indexSize; i += 64)
+                    checksum += indices[i];
+            }
+            cache.close();
+            warm.push_back(milliseconds(start));
+
+            if (checksum != checksum)
+                printf("NaN in %s\n", path.c_str());
+        }
+
+        double coldMs = median(cold), warmMs = median(warm);
+        totalCold += coldMs;
+        totalWarm += warmMs;
+        double uploadKB = (numVertices * sizeof(Vertex) + numIndices * indexSize) / 1024.0;
+        double unindexedKB = numIndices * sizeof(Vertex) / 1024.0;
+        printf("%-16s %8.1f %9u %9u %10.1f %10.1f %10.3f %10.3f %7.1fx\n",
+            std::filesystem::path(path).filename().string().c_str(), sourceSize / 1024.0,
+            numIndices, numVertices, uploadKB, unindexedKB, coldMs, warmMs, coldMs / warmMs);
+    }
+
+    printf("%-16s %8s %9s %9s %10s %10s %10.3f %10.3f %7.1fx\n", "total", "", "", "", "", "",
+        totalCold, totalWarm, totalCold / totalWarm);
+    return 0;
+}
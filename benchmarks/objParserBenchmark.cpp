@@ -0,0 +1,60 @@
+// Microbenchmark of the .obj parser, reports parsing throughput in MB/s.
+//
+// Usage: objParserBenchmark [files...]   (defaults to peter, zombie and teapot)
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/meshcache.hpp>
+#include <common/objparser.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+        paths = { "../assets/peter.obj", "../assets/zombie.obj", "../assets/teapot.obj" };
+
+    printf("%-24s %10s %10s %10s %10s %10s\n", "file", "MB", "vertices", "triangles", "ms", "MB/s");
+
+    for (const std::string& path : paths)
+    {
+        // Copy the file into memory so that only parsing is timed
+        MappedFile file;
+        if (!file.open(path.c_str()))
+        {
+            printf("Unable to open %s\n", path.c_str());
+            continue;
+        }
+        std::vector<char> buffer(file.data, file.data + file.size);
+        file.close();
+
+        // Warm up, then repeat for at least half a second
+        ObjData obj;
+        ObjParser::parse(&buffer[0], buffer.size(), obj);
+
+        int runs = 0;
+        double seconds = 0.0;
+        Clock::time_point start = Clock::now();
+        while (seconds < 0.5 || runs < 5)
+        {
+            ObjParser::parse(&buffer[0], buffer.size(), obj);
+            runs++;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        double megabytes = buffer.size() / (1024.0 * 1024.0);
+        printf("%-24s %10.2f %10zu %10zu %10.3f %10.1f\n", path.c_str(), megabytes,
+            obj.positions.size(), obj.corners.size() / 3, 1000.0 * seconds / runs,
+            megabytes * runs / seconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Replay benchmark: writes a scripted session (walk up to the teapot, pick it up
+// and fire 500 bullets while turning) as an input log, replays it in the game
+// headless with the fixed 1/60 s step and prints the frame time statistics as
+// JSON, so runs on different commits can be compared. A session recorded with
+// --record can be replayed instead.
+//
+// Usage: replayBenchmark [session.input] (run from the source/ folder, next to
+// the game executable)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include <common/input.hpp>
+
+// Hold the keys and move the cursor the same way for a number of frames
+static void addFrames(InputLog& log, unsigned int count, uint16_t keys, float cursorX)
+{
+    InputFrame input;
+    input.keys = keys;
+    input.cursorX = cursorX;
+    for (unsigned int i = 0; i < count; i++)
+        log.frames.push_back(input);
+}
+
+int main(int argc, char** argv)
+{
+    const char* sessionPath = "replaySession.input";
+    const char* statsPath = "replayStats.json";
+
+    if (argc > 1)
+        sessionPath = argv[1];
+    else
+    {
+        // Stand still, walk forward into the teapot (which picks it up), then press
+        // and release E 500 times while turning, and let the last bullets fly
+        InputLog log;
+        addFrames(log, 30, 0, 0.0f);
+        addFrames(log, 90, 1 << INPUT_W, 0.0f);
+        for (unsigned int i = 0; i < 500; i++)
+        {
+            addFrames(log, 1, 1 << INPUT_E, 3.0f);
+            addFrames(log, 1, 0, 3.0f);
+        }
+        addFrames(log, 120, 0, 0.0f);
+        if (!log.save(sessionPath))
+            return 1;
+        printf("Wrote a %zu frame session to %s\n", log.frames.size(), sessionPath);
+    }
+
+#ifdef _WIN32
+    std::string command = "Computer_Graphics_Coursework.exe";
+#else
+    std::string command = "./Computer_Graphics_Coursework";
+#endif
+    command += std::string(" --replay ") + sessionPath + " --stats-json " + statsPath;
+    printf("Running %s\n", command.c_str());
+    fflush(stdout);
+    if (system(command.c_str()) != 0)
+    {
+        printf("The replay failed\n");
+        return 1;
+    }
+
+    // Print the statistics the game wrote
+    FILE* file = fopen(statsPath, "r");
+    if (file == NULL)
+    {
+        printf("Couldn't read %s\n", statsPath);
+        return 1;
+    }
+    char buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        fwrite(buffer, 1, length, stdout);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Tangent benchmark: times Model::calculateTangents on teapot.obj and peter.obj
+// (or the files given on the command line) against the previous per-triangle
+// loop, with the scalar and SSE kernels on one thread and in jobs on every core. Each mesh is also repeated
+// [copies] times to show how a large mesh scales over the threads. First checks
+// the handedness of a packed tangent survives both GL rules for decoding signed
+// normalised 2-bit values (returns 1 if it doesn't).
+//
+// Usage: tangentBenchmark [copies] [files...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <common/stb_image.hpp>
+#include <common/model.hpp>
+#include <common/meshoptimiser.hpp>
+#include <common/jobs.hpp>
+#include <common/maths.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+// The tangent loop before it was vectorised (face tangents summed per vertex,
+// no angle weighting, projection or handedness)
+static void previousTangents(MeshData& mesh)
+{
+    std::vector<Vertex>& vertices = mesh.vertices;
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < vertices.size(); i++)
+        vertices[i].tangent = glm::vec4(0.0f);
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        Vertex& v0 = vertices[mesh.indices[i]];
+        Vertex& v1 = vertices[mesh.indices[i + 1]];
+        Vertex& v2 = vertices[mesh.indices[i + 2]];
+        glm::vec3 E1 = v1.position - v0.position;
+        glm::vec3 E2 = v2.position - v1.position;
+        float deltaU1 = v1.uv.x - v0.uv.x;
+        float deltaV1 = v1.uv.y - v0.uv.y;
+        float deltaU2 = v2.uv.x - v1.uv.x;
+        float deltaV2 = v2.uv.y - v1.uv.y;
+        float det = deltaU1 * deltaV2 - deltaU2 * deltaV1;
+        if (det == 0.0f)
+            continue;
+        float denom = 1.0f / det;
+        glm::vec3 tangent = (deltaV2 * E1 - deltaV1 * E2) * denom;
+        glm::vec3 bitangent = (deltaU1 * E2 - deltaU2 * E1) * denom;
+        v0.tangent += glm::vec4(tangent, 0.0f);
+        v1.tangent += glm::vec4(tangent, 0.0f);
+        v2.tangent += glm::vec4(tangent, 0.0f);
+        bitangents[mesh.indices[i]] += bitangent;
+        bitangents[mesh.indices[i + 1]] += bitangent;
+        bitangents[mesh.indices[i + 2]] += bitangent;
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        float tangentLength = glm::length(glm::vec3(vertices[i].tangent));
+        float bitangentLength = glm::length(bitangents[i]);
+        if (tangentLength > 0.0f)
+            vertices[i].tangent /= tangentLength;
+        if (bitangentLength > 0.0f)
+            bitangents[i] /= bitangentLength;
+    }
+}
+
+// Best of a few runs
+template <class F>
+static double bestTime(F run)
+{
+    double best = 1e30;
+    for (int r = 0; r < 5; r++)
+    {
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+// Largest |dot(tangent, normal)|, the tangents that aren't unit length and the mirrored ones
+static void checkTangents(const MeshData& mesh, float& outMaxDot, unsigned int& outNotUnit, unsigned int& outMirrored)
+{
+    outMaxDot = 0.0f;
+    outNotUnit = 0;
+    outMirrored = 0;
+    for (const Vertex& vertex : mesh.vertices)
+    {
+        glm::vec3 tangent(vertex.tangent);
+        outMaxDot = std::max(outMaxDot, fabsf(glm::dot(tangent, glm::normalize(vertex.normal))));
+        outNotUnit += fabsf(glm::length(tangent) - 1.0f) > 1e-3f;
+        outMirrored += vertex.tangent.w < 0.0f;
+    }
+}
+
+// Pack a tangent with each handedness into GL_INT_2_10_10_10_REV and decode its
+// w the way GL 3.3 ((2c + 1) / 3) and GL 4.2+ (max(c, -1)) would, checking the
+// sign the shaders use is unchanged
+static bool checkPackedHandedness()
+{
+    bool ok = true;
+    for (float handedness : { 1.0f, -1.0f })
+    {
+        Vertex vertex = {};
+        vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        vertex.tangent = glm::vec4(1.0f, 0.0f, 0.0f, handedness);
+        PackedVertex packed = Mesh::packVertex(vertex);
+
+        int c = static_cast<int>(packed.tangent) >> 30;
+        float gl33 = (2.0f * c + 1.0f) / 3.0f;
+        float gl42 = std::max(float(c), -1.0f);
+        float sign33 = gl33 < 0.0f ? -1.0f : 1.0f;
+        float sign42 = gl42 < 0.0f ? -1.0f : 1.0f;
+        printf("Packed handedness %+.0f: stored %d, decodes to %+.3f (GL 3.3) / %+.3f (GL 4.2), sign %s\n",
+            handedness, c, gl33, gl42, sign33 == handedness && sign42 == handedness ? "kept" : "LOST");
+        ok = ok && sign33 == handedness && sign42 == handedness;
+    }
+    return ok;
+}
+
+static void run(const char* name, MeshData& mesh, JobSystem& jobSystem)
+{
+    double previous = bestTime([&] { previousTangents(mesh); });
+    float previousDot;
+    unsigned int previousNotUnit, mirrored;
+    checkTangents(mesh, previousDot, previousNotUnit, mirrored);
+
+    Maths::simdLevel = Maths::SIMD_SCALAR;
+    double scalar = bestTime([&] { Model::calculateTangents(mesh); });
+    Maths::simdLevel = Maths::maxSimdLevel();
+    double single = bestTime([&] { Model::calculateTangents(mesh); });
+    double threaded = bestTime([&] { Model::calculateTangents(mesh, &jobSystem); });
+    float maxDot;
+    unsigned int notUnit;
+    checkTangents(mesh, maxDot, notUnit, mirrored);
+
+    printf("%-20s %9zu %9zu %9.2f %9.2f %9.2f %9.2f %7.1fx %7.1fx   %.1e / %.1e   %u / %u   %u\n", name,
+        mesh.indices.size() / 3, mesh.vertices.size(), previous, scalar, single, threaded, scalar / single,
+        single / threaded, previousDot, maxDot, previousNotUnit, notUnit, mirrored);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int copies = argc > 1 ? atoi(argv[1]) : 64;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+        paths = { "../assets/teapot.obj", "../assets/peter.obj" };
+
+    if (!checkPackedHandedness())
+        return 1;
+
+    JobSystem jobSystem;
+    printf("%u threads, %s. Times in ms (best of 5); max |t.n| and tangents that aren't unit length are previous / new\n",
+        jobSystem.size(), Maths::simdName(Maths::maxSimdLevel()));
+    printf("%-20s %9s %9s %9s %9s %9s %9s %8s %8s   %-17s %-9s %s\n", "mesh", "triangles", "vertices",
+        "previous", "scalar", "SIMD", "threaded", "SIMD", "threads", "max |t.n|", "not unit", "mirrored");
+
+    for (const std::string& path : paths)
+    {
+        std::vector<Vertex> corners;
+        if (!Model::loadObj(path.c_str(), corners))
+            continue;
+
+        MeshData mesh;
+        Model::buildIndexed(corners, mesh);
+        MeshOptimiser::optimiseVertexCache(mesh.indices, static_cast<unsigned int>(mesh.vertices.size()));
+        MeshOptimiser::optimiseVertexFetch(mesh);
+        run(path.c_str(), mesh, jobSystem);
+
+        // The same mesh repeated, as one large mesh
+        MeshData large;
+        for (unsigned int c = 0; c < copies; c++)
+        {
+            unsigned int offset = static_cast<unsigned int>(large.vertices.size());
+            large.vertices.insert(large.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            for (unsigned int index : mesh.indices)
+                large.indices.push_back(offset + index);
+        }
+        std::string name = path.substr(path.find_last_of("/\\") + 1) + " x" + std::to_string(copies);
+        run(name.c_str(), large, jobSystem);
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Transform benchmark: model, model-view and model-view-projection matrices for
+// 1k, 10k, 100k and 1M objects, built one object at a time with the Maths
+// matrix functions (the old EntityStore loop) and with the batched kernels at
+// every SIMD level this CPU supports. The batched results are checked against
+// the per-object ones.
+//
+// Usage: transformBenchmark [repeats]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <common/maths.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+static double milliseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static unsigned int seed = 1;
+static float random01()
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Largest element difference relative to the largest element of the reference
+static float maxError(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        float size = 1.0f;
+        for (int col = 0; col < 4; col++)
+            for (int row = 0; row < 4; row++)
+                size = std::max(size, fabsf(a[i][col][row]));
+        for (int col = 0; col < 4; col++)
+            for (int row = 0; row < 4; row++)
+                error = std::max(error, fabsf(a[i][col][row] - b[i][col][row]) / size);
+    }
+    return error;
+}
+
+int main(int argc, char** argv)
+{
+    int repeats = argc > 1 ? atoi(argv[1]) : 5;
+
+    glm::mat4 view = Quaternion(Maths::radians(20.0f), Maths::radians(35.0f)).matrix() *
+        Maths::translate(glm::vec3(-1.0f, -2.0f, -8.0f));
+    float fov = Maths::radians(45.0f), aspect = 1024.0f / 768.0f, near = 0.2f, far = 100.0f;
+    glm::mat4 projection;
+    projection[0][0] = 1.0f / (aspect * tanf(fov / 2.0f));
+    projection[1][1] = 1.0f / tanf(fov / 2.0f);
+    projection[2][2] = -(far + near) / (far - near);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -2.0f * far * near / (far - near);
+    projection[3][3] = 0.0f;
+
+    printf("Best SIMD level: %s, %d repeats (best time kept)\n", Maths::simdName(Maths::maxSimdLevel()), repeats);
+
+    unsigned int counts[] = { 1000, 10000, 100000, 1000000 };
+    for (unsigned int count : counts)
+    {
+        std::vector<glm::vec3> positions(count), axes(count), scales(count);
+        std::vector<float> angles(count);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            positions[i] = glm::vec3(20.0f * random01() - 10.0f, 4.0f * random01(), 20.0f * random01() - 10.0f);
+            axes[i] = glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) + glm::vec3(0.0f, 0.1f, 0.0f);
+            angles[i] = Maths::radians(720.0f * random01() - 360.0f);
+            scales[i] = glm::vec3(0.1f + random01(), 0.1f + random01(), 0.1f + random01());
+        }
+
+        std::vector<glm::mat4> model(count), modelView(count), mvp(count);
+        std::vector<glm::mat4> batchModel(count), batchModelView(count), batchMVP(count);
+        printf("\n%u objects (ns per object)\n", count);
+
+        // Per object, as the draw loop used to do
+        double modelTime = 1e30, mvpTime = 1e30;
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point start = Clock::now();
+            for (unsigned int i = 0; i < count; i++)
+                model[i] = Maths::translate(positions[i]) * Maths::rotate(angles[i], axes[i]) * Maths::scale(scales[i]);
+            modelTime = std::min(modelTime, milliseconds(start));
+
+            start = Clock::now();
+            for (unsigned int i = 0; i < count; i++)
+            {
+                glm::mat4 m = Maths::translate(positions[i]) * Maths::rotate(angles[i], axes[i]) * Maths::scale(scales[i]);
+                modelView[i] = view * m;
+                mvp[i] = projection * modelView[i];
+            }
+            mvpTime = std::min(mvpTime, milliseconds(start));
+        }
+        printf("  %-10s model %7.2f   MV+MVP %7.2f\n", "per object", 1e6 * modelTime / count, 1e6 * mvpTime / count);
+
+        for (int level = Maths::SIMD_SCALAR; level <= Maths::maxSimdLevel(); level++)
+        {
+            Maths::simdLevel = Maths::SimdLevel(level);
+            double batchModelTime = 1e30, batchMVPTime = 1e30;
+            for (int r = 0; r < repeats; r++)
+            {
+                Clock::time_point start = Clock::now();
+                Maths::modelMatrices(count, positions.data(), axes.data(), angles.data(), scales.data(), batchModel.data());
+                batchModelTime = std::min(batchModelTime, milliseconds(start));
+
+                start = Clock::now();
+                Maths::modelViewMatrices(count, positions.data(), axes.data(), angles.data(), scales.data(),
+                    view, projection, batchModelView.data(), batchMVP.data());
+                batchMVPTime = std::min(batchMVPTime, milliseconds(start));
+            }
+            float error = std::max(maxError(model, batchModel),
+                std::max(maxError(modelView, batchModelView), maxError(mvp, batchMVP)));
+            printf("  %-10s model %7.2f   MV+MVP %7.2f   speedup %5.1fx / %5.1fx   max error %.1e\n",
+                Maths::simdName(Maths::SimdLevel(level)), 1e6 * batchModelTime / count, 1e6 * batchMVPTime / count,
+                modelTime / batchModelTime, mvpTime / batchMVPTime, error);
+        }
+        Maths::simdLevel = Maths::maxSimdLevel();
+    }
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include <common/assets.hpp>
+#include <common/stb_image.hpp>
+
+// Seconds since an arbitrary epoch
+static double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Upload decoded pixels to a texture
+static void uploadTexture(TextureResource& texture, const unsigned char* data,
+    int width, int height, int numComponents)
+{
+    GLenum format = GL_RGBA;
+    if (numComponents == 1)
+        format = GL_RED;
+    else if (numComponents == 3)
+        format = GL_RGB;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    texture.bytes = static_cast<size_t>(width) * height * numComponents * 4 / 3;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+TextureResource::~TextureResource()
+{
+    glDeleteTextures(1, &id);
+}
+
+bool MeshSource::load(const char* path, JobSystem* jobSystem)
+{
+    // Hash the .obj so an edited file never loads a stale cache
+    uint64_t sourceHash = 0, sourceSize = 0;
+    bool hashed = MeshCache::hashFile(path, sourceHash, sourceSize);
+    std::string cachePath = MeshCache::cachePath(path);
+
+    // Use the binary mesh cache if there is an up to date one
+    if (hashed && cache.open(cachePath.c_str(), sourceHash, sourceSize))
+    {
+        printf("Loading file %s (cached)\n", path);
+        vertices = cache.vertices;
+        numVertices = cache.numVertices;
+        indices = cache.indices;
+        numIndices = cache.numIndices;
+        indexSize = cache.indexSize;
+        geometryHash = cache.geometryHash;
+        bvh = std::make_shared<BVH>();
+        bvh->load(cache.nodes, cache.numNodes, cache.triangleOrder, vertices, indices, numIndices, indexSize);
+        return true;
+    }
+
+    // Load object, index it and calculate tangents
+    if (!Model::loadMesh(path, data, jobSystem))
+        return false;
+
+    data.packIndices(packedIndices);
+    vertices = data.vertices.data();
+    numVertices = static_cast<unsigned int>(data.vertices.size());
+    indices = packedIndices.data();
+    numIndices = static_cast<unsigned int>(data.indices.size());
+    indexSize = data.indexSize();
+    geometryHash = MeshCache::hashGeometry(data);
+
+    // Build the BVH
+    bvh = std::make_shared<BVH>();
+    bvh->build(vertices, indices, numIndices, indexSize);
+
+    // Write the cache for the next run
+    if (hashed && !MeshCache::write(cachePath.c_str(), sourceHash, sourceSize, data, bvh.get()))
+        printf("Unable to write mesh cache %s\n", cachePath.c_str());
+    return true;
+}
+
+AssetCache& AssetCache::global()
+{
+    static AssetCache cache;
+    return cache;
+}
+
+std::string AssetCache::canonicalPath(const char* path)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? std::string(path) : canonical.string();
+}
+
+std::shared_ptr<Mesh> AssetCache::loadMesh(const char* path)
+{
+    // Already loaded (or loading) from this path
+    std::string key = canonicalPath(path);
+    std::shared_ptr<Mesh> mesh = meshes[key].lock();
+    if (mesh)
+    {
+        meshHits++;
+        if (jobs)
+            pendingMeshHits.push_back(mesh);
+        else
+            bytesSaved += mesh->vertexBytes + mesh->indexBytes;
+        return mesh;
+    }
+
+    mesh = std::make_shared<Mesh>();
+    mesh->name = path;
+    meshes[key] = mesh;
+
+    // Read the file in a job, the buffers are set up in finishLoading
+    if (jobs)
+    {
+        LoadJob* job = new LoadJob;
+        job->path = path;
+        job->mesh = mesh;
+        submit(job);
+        return mesh;
+    }
+
+    MeshSource source;
+    if (!source.load(path))
+    {
+        meshMisses++;
+        return mesh;
+    }
+    uploadMesh(mesh, source);
+    return mesh;
+}
+
+void AssetCache::uploadMesh(const std::shared_ptr<Mesh>& mesh, const MeshSource& source)
+{
+    // Already loaded from another file with the same geometry
+    std::shared_ptr<Mesh> other = geometry[source.geometryHash].lock();
+    if (other && other->buffers)
+    {
+        meshHits++;
+        bytesSaved += other->vertexBytes + other->indexBytes;
+        mesh->shareBuffers(*other);
+        return;
+    }
+
+    // Upload a new mesh
+    meshMisses++;
+    mesh->geometryHash = source.geometryHash;
+    mesh->bvh = source.bvh;
+    mesh->setupBuffers(source.vertices, source.numVertices, source.indices, source.numIndices, source.indexSize);
+    geometry[source.geometryHash] = mesh;
+}
+
+std::shared_ptr<TextureResource> AssetCache::loadTexture(const char* path)
+{
+    // Already loaded (or loading)
+    std::string key = canonicalPath(path);
+    std::shared_ptr<TextureResource> texture = textures[key].lock();
+    if (texture)
+    {
+        textureHits++;
+        if (jobs)
+            pendingTextureHits.push_back(texture);
+        else
+            bytesSaved += texture->bytes;
+        return texture;
+    }
+
+    textureMisses++;
+    texture = std::make_shared<TextureResource>();
+    texture->path = path;
+    textures[key] = texture;
+
+    glGenTextures(1, &texture->id);
+
+    // Decode the image in a job, it is uploaded in finishLoading
+    if (jobs)
+    {
+        LoadJob* job = new LoadJob;
+        job->path = path;
+        job->texture = texture;
+        submit(job);
+        return texture;
+    }
+
+    int width, height, numComponents;
+    unsigned char* data = stbi_load(path, &width, &height, &numComponents, 0);
+    if (data)
+        uploadTexture(*texture, data, width, height, numComponents);
+    else
+        std::cout << "Texture " << path << " failed to load." << std::endl;
+    stbi_image_free(data);
+
+    return texture;
+}
+
+void AssetCache::beginAsyncLoading(JobSystem& jobSystem)
+{
+    jobs = &jobSystem;
+    loadStart = now();
+    loadTimes = AssetLoadTimes();
+    meshLoadMicroseconds = 0;
+    textureDecodeMicroseconds = 0;
+}
+
+void AssetCache::submit(LoadJob* job)
+{
+    jobs->run([this, job]
+    {
+        double start = now();
+        if (job->mesh)
+        {
+            job->loaded = job->source.load(job->path.c_str(), jobs);
+            meshLoadMicroseconds += static_cast<uint64_t>((now() - start) * 1e6);
+        }
+        else
+        {
+            job->pixels = stbi_load(job->path.c_str(), &job->width, &job->height, &job->numComponents, 0);
+            textureDecodeMicroseconds += static_cast<uint64_t>((now() - start) * 1e6);
+        }
+
+        // Queued before this job finishes, so the counter can't reach zero in between
+        jobs->runOnMainThread([this, job] { upload(job); }, &loading);
+    }, &loading);
+}
+
+void AssetCache::upload(LoadJob* job)
+{
+    double start = now();
+    if (job->mesh)
+    {
+        if (job->loaded)
+            uploadMesh(job->mesh, job->source);
+        else
+            meshMisses++;
+    }
+    else
+    {
+        if (job->pixels)
+            uploadTexture(*job->texture, job->pixels, job->width, job->height, job->numComponents);
+        else
+            std::cout << "Texture " << job->path << " failed to load." << std::endl;
+        stbi_image_free(job->pixels);
+    }
+    loadTimes.upload += now() - start;
+    delete job;
+}
+
+void AssetCache::finishLoading()
+{
+    if (!jobs)
+        return;
+
+    // Run loads and uploads until none are left
+    jobs->wait(loading);
+
+    // The sizes of what the hits shared are only known once it is uploaded
+    for (const std::shared_ptr<Mesh>& mesh : pendingMeshHits)
+        bytesSaved += mesh->vertexBytes + mesh->indexBytes;
+    for (const std::shared_ptr<TextureResource>& texture : pendingTextureHits)
+        bytesSaved += texture->bytes;
+    pendingMeshHits.clear();
+    pendingTextureHits.clear();
+
+    jobs = nullptr;
+    loadTimes.meshLoad = meshLoadMicroseconds / 1e6;
+    loadTimes.textureDecode = textureDecodeMicroseconds / 1e6;
+    loadTimes.wall = now() - loadStart;
+}
+
+void AssetCache::report() const
+{
+    printf("Asset cache: meshes %u hits / %u misses, textures %u hits / %u misses, %.1f KB saved\n",
+        meshHits, meshMisses, textureHits, textureMisses, bytesSaved / 1024.0);
+}
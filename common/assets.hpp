@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#include <common/model.hpp>
+#include <common/meshcache.hpp>
+#include <common/jobs.hpp>
+
+// CPU side of a mesh load: the mapped mesh cache if it is up to date, otherwise
+// the parsed .obj (which is then written to the cache for the next run), and the
+// BVH of its triangles
+class MeshSource
+{
+public:
+    const Vertex* vertices = nullptr;
+    unsigned int numVertices = 0;
+    const void* indices = nullptr;
+    unsigned int numIndices = 0;
+    unsigned int indexSize = 0;
+    uint64_t geometryHash = 0;
+    std::shared_ptr<BVH> bvh;
+
+    // Tangents of a parsed mesh are split into jobs when there is a job system
+    bool load(const char* path, JobSystem* jobSystem = nullptr);
+
+private:
+    MeshCache cache;
+    MeshData data;
+    std::vector<unsigned char> packedIndices;
+};
+
+// Time spent in each loading stage (seconds). Parse and decode times are summed
+// over the worker threads so they can exceed the wall time.
+struct AssetLoadTimes
+{
+    double meshLoad = 0.0;      // hashing, cache mapping or parsing meshes
+    double textureDecode = 0.0; // decoding images
+    double upload = 0.0;        // GL uploads on the main thread
+    double wall = 0.0;          // beginAsyncLoading to finishLoading
+};
+
+// Reference counted cache of meshes and textures keyed by canonical path. Handles
+// are shared pointers, the cache only keeps weak pointers so a resource is freed
+// as soon as the last model using it lets go. Meshes from different files whose
+// indexed vertices and indices are bit for bit the same (the geometry hash)
+// share GPU buffers.
+class AssetCache
+{
+public:
+    // Load counters
+    unsigned int meshHits = 0;
+    unsigned int meshMisses = 0;
+    unsigned int textureHits = 0;
+    unsigned int textureMisses = 0;
+    size_t bytesSaved = 0;
+
+    // Get a mesh or texture, loading it if it isn't already loaded
+    std::shared_ptr<Mesh> loadMesh(const char* path);
+    std::shared_ptr<TextureResource> loadTexture(const char* path);
+
+    // Between these calls loadMesh and loadTexture return empty placeholders
+    // straight away and the files are read in jobs. Each finished load queues its
+    // upload as a main thread job, which finishLoading runs as the loads complete
+    // (the job system must have been created on the GL thread).
+    void beginAsyncLoading(JobSystem& jobSystem);
+    void finishLoading();
+
+    // Stage times of the last beginAsyncLoading/finishLoading batch
+    AssetLoadTimes loadTimes;
+
+    // Print the hit/miss counters
+    void report() const;
+
+    // Cache used by Model
+    static AssetCache& global();
+
+    // Absolute path with . and .. removed (used as the key)
+    static std::string canonicalPath(const char* path);
+
+private:
+    // Background load, uploaded on the main thread when it finishes
+    struct LoadJob
+    {
+        std::string path;
+        std::shared_ptr<Mesh> mesh;
+        MeshSource source;
+        bool loaded = false;
+        std::shared_ptr<TextureResource> texture;
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0, numComponents = 0;
+    };
+
+    JobSystem* jobs = nullptr;
+    double loadStart = 0.0;
+
+    // Loads and uploads not yet finished, and the cache hits on them whose
+    // saving is counted once they have finished
+    JobCounter loading;
+    std::vector<std::shared_ptr<Mesh>> pendingMeshHits;
+    std::vector<std::shared_ptr<TextureResource>> pendingTextureHits;
+    std::atomic<uint64_t> meshLoadMicroseconds{0};
+    std::atomic<uint64_t> textureDecodeMicroseconds{0};
+
+    void submit(LoadJob* job);
+    void upload(LoadJob* job);
+    void uploadMesh(const std::shared_ptr<Mesh>& mesh, const MeshSource& source);
+
+    std::unordered_map<std::string, std::weak_ptr<Mesh>> meshes;
+    std::unordered_map<uint64_t, std::weak_ptr<Mesh>> geometry;
+    std::unordered_map<std::string, std::weak_ptr<TextureResource>> textures;
+};
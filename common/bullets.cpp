@@ -0,0 +1,116 @@
+#include <cmath>
+
+#include <common/bullets.hpp>
+#include <common/maths.hpp>
+
+BulletPool::BulletPool(unsigned int size, float maxAge, float roomBound)
+    : lifetime(maxAge), bound(roomBound)
+{
+    unsigned int capacity = size;
+    positions.resize(capacity);
+    velocities.resize(capacity);
+    ages.resize(capacity);
+    angles.resize(capacity);
+    slots.resize(capacity);
+    indices.assign(capacity, ~0u);
+    generations.assign(capacity, 0);
+
+    // Hand out the low slots first
+    freeSlots.reserve(capacity);
+    for (unsigned int i = capacity; i > 0; i--)
+        freeSlots.push_back(i - 1);
+}
+
+BulletHandle BulletPool::fire(const glm::vec3& position, const glm::vec3& velocity, float angle)
+{
+    BulletHandle handle;
+    if (freeSlots.empty())
+        return handle;
+
+    unsigned int slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    unsigned int index = count++;
+    positions[index] = position;
+    velocities[index] = velocity;
+    ages[index] = 0.0f;
+    angles[index] = angle;
+    slots[index] = slot;
+    indices[slot] = index;
+
+    handle.slot = slot;
+    handle.generation = generations[slot];
+    return handle;
+}
+
+bool BulletPool::alive(BulletHandle handle) const
+{
+    return handle.slot < capacity() && generations[handle.slot] == handle.generation &&
+        indices[handle.slot] != ~0u;
+}
+
+void BulletPool::kill(BulletHandle handle)
+{
+    if (alive(handle))
+        remove(indices[handle.slot]);
+}
+
+void BulletPool::remove(unsigned int index)
+{
+    // Free the slot and invalidate its handles
+    unsigned int slot = slots[index];
+    indices[slot] = ~0u;
+    generations[slot]++;
+    freeSlots.push_back(slot);
+
+    // Move the last live bullet into the gap
+    unsigned int last = --count;
+    if (index != last)
+    {
+        positions[index] = positions[last];
+        velocities[index] = velocities[last];
+        ages[index] = ages[last];
+        angles[index] = angles[last];
+        slots[index] = slots[last];
+        indices[slots[index]] = index;
+    }
+}
+
+void BulletPool::update(float deltaTime)
+{
+    // Integrate
+    for (unsigned int i = 0; i < count; i++)
+    {
+        positions[i] += velocities[i] * deltaTime;
+        ages[i] += deltaTime;
+    }
+
+    // Cull (walking backwards so the bullet swapped in has already been checked)
+    for (unsigned int i = count; i > 0; i--)
+    {
+        unsigned int index = i - 1;
+        const glm::vec3& position = positions[index];
+        if (ages[index] > lifetime || fabsf(position.x) > bound || fabsf(position.z) > bound)
+            remove(index);
+    }
+}
+
+void BulletPool::submit(InstanceList& list, const Model& model, const glm::vec3& scale,
+    float extrapolate) const
+{
+    unsigned int material = list.materialId(model);
+    glm::mat4 scaleMatrix = Maths::scale(scale);
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 position = positions[i] + velocities[i] * extrapolate;
+        list.add(material, Maths::translate(position) * Maths::rotate(angles[i], axis) * scaleMatrix);
+    }
+}
+
+size_t BulletPool::memoryBytes() const
+{
+    return positions.capacity() * sizeof(glm::vec3) + velocities.capacity() * sizeof(glm::vec3) +
+        ages.capacity() * sizeof(float) + angles.capacity() * sizeof(float) +
+        (slots.capacity() + indices.capacity() + generations.capacity() + freeSlots.capacity()) * sizeof(unsigned int);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <glm/glm.hpp>
+
+#include <common/model.hpp>
+#include <common/renderer.hpp>
+
+// Handle to a pooled bullet. The generation changes when the slot is freed, so
+// a handle to a culled bullet never finds the bullet that reuses its slot.
+struct BulletHandle
+{
+    unsigned int slot = ~0u;
+    unsigned int generation = 0;
+};
+
+// Fixed capacity pool of bullets. Live bullets are kept packed at the front of
+// the arrays (culled bullets are swap-removed) so the update is one pass over
+// contiguous memory, and slots are recycled through a free list so nothing is
+// allocated after construction.
+class BulletPool
+{
+public:
+    // Live bullets [0, size())
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> ages;
+    std::vector<float> angles;
+
+    float lifetime;     // seconds before a bullet is culled
+    float bound;        // bullets leaving the square |x|, |z| < bound are culled
+
+    BulletPool(unsigned int size, float maxAge, float roomBound);
+
+    // Add a bullet, returns an invalid handle if the pool is full
+    BulletHandle fire(const glm::vec3& position, const glm::vec3& velocity, float angle);
+
+    // Remove a bullet early (e.g. when it hits something)
+    void kill(BulletHandle handle);
+
+    // Remove the live bullet at an index (the last live bullet moves into its place)
+    void remove(unsigned int index);
+
+    // True while the bullet the handle refers to exists
+    bool alive(BulletHandle handle) const;
+
+    // Move and age the bullets, then cull the old ones and those out of the room
+    void update(float deltaTime);
+
+    // Queue a copy of the model at every bullet, moved along its velocity by
+    // extrapolate seconds (negative to draw it where it was)
+    void submit(InstanceList& list, const Model& model, const glm::vec3& scale,
+        float extrapolate = 0.0f) const;
+
+    unsigned int size() const { return count; }
+    unsigned int capacity() const { return static_cast<unsigned int>(generations.size()); }
+
+    // Bytes used by the pool's arrays
+    size_t memoryBytes() const;
+
+private:
+    unsigned int count = 0;
+
+    // Slot of each live bullet and the live index of each slot (~0u if free)
+    std::vector<unsigned int> slots;
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> generations;
+    std::vector<unsigned int> freeSlots;
+};
@@ -0,0 +1,655 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include <common/bvh.hpp>
+
+// Build parameters
+static const unsigned int numBins = 16;
+static const unsigned int maxLeafSize = 4;
+static const unsigned int maxDepth = 64;    // also bounds the traversal stacks
+
+static_assert(sizeof(BVHNode) == 32, "BVHNode is stored in the mesh cache");
+
+// Axis aligned box grown to contain points and other boxes
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Bounds& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    float area() const
+    {
+        glm::vec3 size = max - min;
+        if (size.x < 0.0f)
+            return 0.0f;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+static unsigned int readIndex(const void* indices, unsigned int indexSize, unsigned int i)
+{
+    if (indexSize == 2)
+        return static_cast<const unsigned short*>(indices)[i];
+    return static_cast<const unsigned int*>(indices)[i];
+}
+
+void BVH::build(const Vertex* vertices, const void* indices, unsigned int numIndices,
+    unsigned int indexSize)
+{
+    unsigned int numTriangles = numIndices / 3;
+    nodes.clear();
+    triangleOrder.resize(numTriangles);
+    triangles.clear();
+    if (numTriangles == 0)
+        return;
+
+    // Bounds and centroid of every triangle
+    std::vector<Bounds> triangleBounds(numTriangles);
+    std::vector<glm::vec3> centroids(numTriangles);
+    for (unsigned int t = 0; t < numTriangles; t++)
+    {
+        for (unsigned int k = 0; k < 3; k++)
+            triangleBounds[t].grow(vertices[readIndex(indices, indexSize, 3 * t + k)].position);
+        centroids[t] = 0.5f * (triangleBounds[t].min + triangleBounds[t].max);
+        triangleOrder[t] = t;
+    }
+
+    auto nodeBounds = [&](BVHNode& node)
+    {
+        Bounds bounds;
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+            bounds.grow(triangleBounds[triangleOrder[i]]);
+        node.min = bounds.min;
+        node.max = bounds.max;
+    };
+
+    nodes.reserve(2 * numTriangles);
+    BVHNode root;
+    root.first = 0;
+    root.count = numTriangles;
+    nodeBounds(root);
+    nodes.push_back(root);
+
+    // Split nodes depth first
+    struct Task { unsigned int node, depth; };
+    std::vector<Task> tasks;
+    tasks.push_back({ 0, 1 });
+    while (!tasks.empty())
+    {
+        Task task = tasks.back();
+        tasks.pop_back();
+        BVHNode node = nodes[task.node];
+        if (node.count <= 1 || task.depth >= maxDepth)
+            continue;
+
+        // Bounds of the centroids, which the bins divide
+        Bounds centroidBounds;
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+            centroidBounds.grow(centroids[triangleOrder[i]]);
+
+        // Find the cheapest split over the bin boundaries of each axis
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f)
+                continue;
+
+            Bounds bins[numBins];
+            unsigned int counts[numBins] = {};
+            float scale = numBins / extent;
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                unsigned int t = triangleOrder[i];
+                unsigned int bin = std::min(numBins - 1,
+                    static_cast<unsigned int>((centroids[t][axis] - centroidBounds.min[axis]) * scale));
+                bins[bin].grow(triangleBounds[t]);
+                counts[bin]++;
+            }
+
+            // Sweep from the left and from the right to get both sides of each split
+            float leftArea[numBins - 1];
+            unsigned int leftCount[numBins - 1];
+            Bounds left;
+            unsigned int count = 0;
+            for (unsigned int i = 0; i < numBins - 1; i++)
+            {
+                left.grow(bins[i]);
+                count += counts[i];
+                leftArea[i] = left.area();
+                leftCount[i] = count;
+            }
+
+            Bounds right;
+            count = 0;
+            for (unsigned int i = numBins - 1; i > 0; i--)
+            {
+                right.grow(bins[i]);
+                count += counts[i];
+                float cost = leftCount[i - 1] * leftArea[i - 1] + count * right.area();
+                if (leftCount[i - 1] > 0 && count > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // Keep small nodes as leaves when splitting them costs more than testing every triangle
+        Bounds bounds;
+        bounds.grow(node.min);
+        bounds.grow(node.max);
+        float leafCost = node.count * bounds.area();
+        if (bestAxis < 0 || (node.count <= maxLeafSize && bestCost + bounds.area() >= leafCost))
+            continue;
+
+        // Partition the triangles around the split
+        float scale = numBins / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        uint32_t* first = triangleOrder.data() + node.first;
+        uint32_t* middle = std::partition(first, first + node.count, [&](uint32_t t)
+        {
+            unsigned int bin = std::min(numBins - 1,
+                static_cast<unsigned int>((centroids[t][bestAxis] - centroidBounds.min[bestAxis]) * scale));
+            return bin < bestSplit;
+        });
+        unsigned int leftCount = static_cast<unsigned int>(middle - first);
+        if (leftCount == 0 || leftCount == node.count)
+            continue;
+
+        // Children are stored next to each other
+        BVHNode left, right;
+        left.first = node.first;
+        left.count = leftCount;
+        right.first = node.first + leftCount;
+        right.count = node.count - leftCount;
+        nodeBounds(left);
+        nodeBounds(right);
+
+        unsigned int leftIndex = static_cast<unsigned int>(nodes.size());
+        nodes.push_back(left);
+        nodes.push_back(right);
+        nodes[task.node].first = leftIndex;
+        nodes[task.node].count = 0;
+        tasks.push_back({ leftIndex, task.depth + 1 });
+        tasks.push_back({ leftIndex + 1, task.depth + 1 });
+    }
+
+    nodes.shrink_to_fit();
+    gatherTriangles(vertices, indices, indexSize);
+}
+
+void BVH::load(const BVHNode* cachedNodes, unsigned int numNodes, const uint32_t* cachedOrder,
+    const Vertex* vertices, const void* indices, unsigned int numIndices, unsigned int indexSize)
+{
+    nodes.assign(cachedNodes, cachedNodes + numNodes);
+    triangleOrder.assign(cachedOrder, cachedOrder + numIndices / 3);
+    gatherTriangles(vertices, indices, indexSize);
+}
+
+void BVH::gatherTriangles(const Vertex* vertices, const void* indices, unsigned int indexSize)
+{
+    triangles.resize(triangleOrder.size());
+    for (size_t i = 0; i < triangleOrder.size(); i++)
+    {
+        unsigned int t = triangleOrder[i];
+        glm::vec3 v0 = vertices[readIndex(indices, indexSize, 3 * t)].position;
+        glm::vec3 v1 = vertices[readIndex(indices, indexSize, 3 * t + 1)].position;
+        glm::vec3 v2 = vertices[readIndex(indices, indexSize, 3 * t + 2)].position;
+        triangles[i].v0 = v0;
+        triangles[i].edge1 = v1 - v0;
+        triangles[i].edge2 = v2 - v0;
+    }
+}
+
+float BVH::cost() const
+{
+    if (nodes.empty())
+        return 0.0f;
+
+    // Traversal and intersection are weighted the same
+    float total = 0.0f;
+    for (const BVHNode& node : nodes)
+    {
+        Bounds bounds;
+        bounds.grow(node.min);
+        bounds.grow(node.max);
+        total += bounds.area() * (node.count > 0 ? node.count : 1);
+    }
+    Bounds root;
+    root.grow(nodes[0].min);
+    root.grow(nodes[0].max);
+    return total / root.area();
+}
+
+// Distance along a ray to where it enters a box (false if it misses or enters beyond maxT)
+static bool intersectBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin,
+    const glm::vec3& inverseDirection, float maxT, float& outT)
+{
+    glm::vec3 t1 = (min - origin) * inverseDirection;
+    glm::vec3 t2 = (max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t1, t2);
+    glm::vec3 tFar = glm::max(t1, t2);
+    float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+    float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxT));
+    outT = enter;
+    return enter <= exit;
+}
+
+// Moller-Trumbore ray triangle intersection (either side)
+static bool intersectTriangle(const BVHTriangle& triangle, const glm::vec3& origin,
+    const glm::vec3& direction, float maxT, float& outT)
+{
+    glm::vec3 p = glm::cross(direction, triangle.edge2);
+    float det = glm::dot(triangle.edge1, p);
+    if (fabsf(det) < 1e-12f)
+        return false;
+
+    float inverseDet = 1.0f / det;
+    glm::vec3 s = origin - triangle.v0;
+    float u = glm::dot(s, p) * inverseDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    glm::vec3 q = glm::cross(s, triangle.edge1);
+    float v = glm::dot(direction, q) * inverseDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float t = glm::dot(triangle.edge2, q) * inverseDet;
+    if (t < 0.0f || t >= maxT)
+        return false;
+
+    outT = t;
+    return true;
+}
+
+// Closest point on a triangle to a point (Ericson, Real-Time Collision Detection 5.1.5)
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+    const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Smaller root of a t^2 + 2 b t + c = 0 if it lies in [0, maxT)
+static bool smallerRoot(float a, float b, float c, float maxT, float& outT)
+{
+    float discriminant = b * b - a * c;
+    if (a <= 1e-12f || discriminant < 0.0f)
+        return false;
+
+    float t = (-b - sqrtf(discriminant)) / a;
+    if (t < 0.0f || t >= maxT)
+        return false;
+
+    outT = t;
+    return true;
+}
+
+// First time in [0, maxT) a sphere at start + t * direction touches a triangle. The
+// sphere is assumed not to touch it at t = 0. The sphere first touches either the
+// face, an edge (a capsule around it) or a corner (a sphere around it).
+static bool sweepTriangle(const BVHTriangle& triangle, const glm::vec3& start, const glm::vec3& direction,
+    float radius, float maxT, float& outT)
+{
+    glm::vec3 corners[3] = { triangle.v0, triangle.v0 + triangle.edge1, triangle.v0 + triangle.edge2 };
+    bool found = false;
+    float best = maxT;
+
+    // Face
+    glm::vec3 normal = glm::cross(triangle.edge1, triangle.edge2);
+    float length = glm::length(normal);
+    if (length > 0.0f)
+    {
+        normal /= length;
+        float distance = glm::dot(normal, start - triangle.v0);
+        float speed = glm::dot(normal, direction);
+        float side = distance > 0.0f ? 1.0f : -1.0f;
+        if (speed * side < 0.0f)
+        {
+            float t = (distance - side * radius) / -speed;
+            if (t >= 0.0f && t < best)
+            {
+                // Contact point on the plane must be inside the triangle
+                glm::vec3 contact = start + t * direction - side * radius * normal;
+                bool inside = true;
+                for (int i = 0; i < 3 && inside; i++)
+                {
+                    glm::vec3 edge = corners[(i + 1) % 3] - corners[i];
+                    inside = glm::dot(glm::cross(edge, contact - corners[i]), normal) >= 0.0f;
+                }
+                if (inside)
+                {
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+    }
+
+    float directionLength = glm::dot(direction, direction);
+    for (int i = 0; i < 3; i++)
+    {
+        // Corner
+        glm::vec3 m = start - corners[i];
+        float t;
+        if (smallerRoot(directionLength, glm::dot(direction, m), glm::dot(m, m) - radius * radius, best, t))
+        {
+            best = t;
+            found = true;
+        }
+
+        // Edge, only counted where the closest point lies between the corners
+        glm::vec3 edge = corners[(i + 1) % 3] - corners[i];
+        float edgeLength = glm::dot(edge, edge);
+        float edgeDirection = glm::dot(edge, direction);
+        float edgeStart = glm::dot(edge, m);
+        float a = edgeLength * directionLength - edgeDirection * edgeDirection;
+        float b = edgeLength * glm::dot(m, direction) - edgeDirection * edgeStart;
+        float c = edgeLength * (glm::dot(m, m) - radius * radius) - edgeStart * edgeStart;
+        if (smallerRoot(a, b, c, best, t))
+        {
+            float f = (edgeStart + t * edgeDirection) / edgeLength;
+            if (f >= 0.0f && f <= 1.0f)
+            {
+                best = t;
+                found = true;
+            }
+        }
+    }
+
+    outT = best;
+    return found;
+}
+
+// Separating axis test of a triangle against a box (Akenine-Moller)
+static bool triangleBoxOverlap(const glm::vec3& centre, const glm::vec3& halfSize, const BVHTriangle& triangle)
+{
+    glm::vec3 a = triangle.v0 - centre;
+    glm::vec3 b = a + triangle.edge1;
+    glm::vec3 c = a + triangle.edge2;
+
+    // Box axes
+    glm::vec3 low = glm::min(a, glm::min(b, c));
+    glm::vec3 high = glm::max(a, glm::max(b, c));
+    if (low.x > halfSize.x || low.y > halfSize.y || low.z > halfSize.z ||
+        high.x < -halfSize.x || high.y < -halfSize.y || high.z < -halfSize.z)
+        return false;
+
+    // Triangle plane
+    glm::vec3 normal = glm::cross(triangle.edge1, triangle.edge2);
+    if (fabsf(glm::dot(normal, a)) > glm::dot(halfSize, glm::abs(normal)))
+        return false;
+
+    // Cross products of the box axes and the triangle edges
+    glm::vec3 edges[3] = { b - a, c - b, a - c };
+    for (int i = 0; i < 3; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            glm::vec3 unit = glm::vec3(0.0f);
+            unit[k] = 1.0f;
+            glm::vec3 axis = glm::cross(unit, edges[i]);
+            float p0 = glm::dot(a, axis), p1 = glm::dot(b, axis), p2 = glm::dot(c, axis);
+            float r = glm::dot(halfSize, glm::abs(axis));
+            if (std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Triangle normal facing against a direction
+static glm::vec3 facingNormal(const BVHTriangle& triangle, const glm::vec3& direction)
+{
+    glm::vec3 normal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+    return glm::dot(normal, direction) > 0.0f ? -normal : normal;
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+    RayHit& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float best = maxDistance;
+    unsigned int bestTriangle = ~0u;
+
+    // Visit the nearer child first and skip nodes entered beyond the closest hit
+    struct Entry { unsigned int node; float t; };
+    Entry stack[maxDepth + 1];
+    unsigned int size = 0;
+    float t;
+    if (intersectBox(nodes[0].min, nodes[0].max, origin, inverseDirection, best, t))
+        stack[size++] = { 0, t };
+
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        if (entry.t > best)
+            continue;
+
+        const BVHNode& node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                if (intersectTriangle(triangles[i], origin, direction, best, t))
+                {
+                    best = t;
+                    bestTriangle = i;
+                }
+            }
+            continue;
+        }
+
+        float t0, t1;
+        bool hit0 = intersectBox(nodes[node.first].min, nodes[node.first].max, origin, inverseDirection, best, t0);
+        bool hit1 = intersectBox(nodes[node.first + 1].min, nodes[node.first + 1].max, origin, inverseDirection, best, t1);
+        if (hit0 && hit1)
+        {
+            // Push the far child first so the near one is popped next
+            if (t0 <= t1)
+            {
+                stack[size++] = { node.first + 1, t1 };
+                stack[size++] = { node.first, t0 };
+            }
+            else
+            {
+                stack[size++] = { node.first, t0 };
+                stack[size++] = { node.first + 1, t1 };
+            }
+        }
+        else if (hit0)
+            stack[size++] = { node.first, t0 };
+        else if (hit1)
+            stack[size++] = { node.first + 1, t1 };
+    }
+
+    if (bestTriangle == ~0u)
+        return false;
+
+    hit.distance = best;
+    hit.triangle = triangleOrder[bestTriangle];
+    hit.normal = facingNormal(triangles[bestTriangle], direction);
+    return true;
+}
+
+bool BVH::sphereSweep(const glm::vec3& start, const glm::vec3& end, float radius, RayHit& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 direction = end - start;
+    glm::vec3 inverseDirection = 1.0f / direction;
+    glm::vec3 inflate = glm::vec3(radius);
+    float best = 1.0f;
+    unsigned int bestTriangle = ~0u;
+
+    // Same traversal as raycast, with the node boxes grown by the radius
+    struct Entry { unsigned int node; float t; };
+    Entry stack[maxDepth + 1];
+    unsigned int size = 0;
+    float t;
+    if (intersectBox(nodes[0].min - inflate, nodes[0].max + inflate, start, inverseDirection, best, t))
+        stack[size++] = { 0, t };
+
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        if (entry.t > best)
+            continue;
+
+        const BVHNode& node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                // Already touching at the start
+                const BVHTriangle& triangle = triangles[i];
+                glm::vec3 closest = closestPointOnTriangle(start, triangle.v0, triangle.v0 + triangle.edge1,
+                    triangle.v0 + triangle.edge2);
+                glm::vec3 offset = start - closest;
+                if (glm::dot(offset, offset) <= radius * radius)
+                {
+                    best = 0.0f;
+                    bestTriangle = i;
+                    size = 0;
+                    break;
+                }
+
+                if (sweepTriangle(triangle, start, direction, radius, best, t))
+                {
+                    best = t;
+                    bestTriangle = i;
+                }
+            }
+            continue;
+        }
+
+        const BVHNode& left = nodes[node.first];
+        const BVHNode& right = nodes[node.first + 1];
+        float t0, t1;
+        bool hit0 = intersectBox(left.min - inflate, left.max + inflate, start, inverseDirection, best, t0);
+        bool hit1 = intersectBox(right.min - inflate, right.max + inflate, start, inverseDirection, best, t1);
+        if (hit0 && hit1)
+        {
+            if (t0 <= t1)
+            {
+                stack[size++] = { node.first + 1, t1 };
+                stack[size++] = { node.first, t0 };
+            }
+            else
+            {
+                stack[size++] = { node.first, t0 };
+                stack[size++] = { node.first + 1, t1 };
+            }
+        }
+        else if (hit0)
+            stack[size++] = { node.first, t0 };
+        else if (hit1)
+            stack[size++] = { node.first + 1, t1 };
+    }
+
+    if (bestTriangle == ~0u)
+        return false;
+
+    // Contact normal points from the triangle to the sphere's centre
+    const BVHTriangle& triangle = triangles[bestTriangle];
+    glm::vec3 centre = start + best * direction;
+    glm::vec3 offset = centre - closestPointOnTriangle(centre, triangle.v0, triangle.v0 + triangle.edge1,
+        triangle.v0 + triangle.edge2);
+    float length = glm::length(offset);
+
+    hit.distance = best;
+    hit.triangle = triangleOrder[bestTriangle];
+    hit.normal = length > 1e-6f ? offset / length : facingNormal(triangle, direction);
+    return true;
+}
+
+bool BVH::overlapBox(const glm::vec3& min, const glm::vec3& max, std::vector<unsigned int>* outTriangles) const
+{
+    if (outTriangles)
+        outTriangles->clear();
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 centre = 0.5f * (min + max);
+    glm::vec3 halfSize = 0.5f * (max - min);
+    bool found = false;
+
+    unsigned int stack[maxDepth + 1];
+    unsigned int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const BVHNode& node = nodes[stack[--size]];
+        if (node.min.x > max.x || node.min.y > max.y || node.min.z > max.z ||
+            node.max.x < min.x || node.max.y < min.y || node.max.z < min.z)
+            continue;
+
+        if (node.count == 0)
+        {
+            stack[size++] = node.first;
+            stack[size++] = node.first + 1;
+            continue;
+        }
+
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            if (triangleBoxOverlap(centre, halfSize, triangles[i]))
+            {
+                if (!outTriangles)
+                    return true;
+                found = true;
+                outTriangles->push_back(triangleOrder[i]);
+            }
+        }
+    }
+
+    return found;
+}
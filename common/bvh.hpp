@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include <common/model.hpp>
+
+// BVH node (32 bytes, stored as is in the mesh cache). Leaves hold count
+// triangles starting at first; interior nodes have count 0 and their two
+// children at first and first + 1.
+struct BVHNode
+{
+    glm::vec3 min;
+    uint32_t first;
+    glm::vec3 max;
+    uint32_t count;
+};
+
+// Triangle stored as a corner and two edges, in leaf order
+struct BVHTriangle
+{
+    glm::vec3 v0;
+    glm::vec3 edge1;
+    glm::vec3 edge2;
+};
+
+// Closest hit of a ray or sweep
+struct RayHit
+{
+    float distance = 0.0f;      // along the ray, or the fraction of the sweep travelled
+    unsigned int triangle = 0;  // index of the triangle in the mesh's index buffer
+    glm::vec3 normal;           // unit triangle normal, facing against the ray
+};
+
+// Bounding volume hierarchy over a mesh's triangles, built with the surface area
+// heuristic. Queries are in the mesh's model space.
+class BVH
+{
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> triangleOrder;    // mesh triangle index of each leaf triangle
+    std::vector<BVHTriangle> triangles;
+
+    // Build the tree over indexed triangles (indexSize is 2 or 4 bytes)
+    void build(const Vertex* vertices, const void* indices, unsigned int numIndices,
+        unsigned int indexSize);
+
+    // Use a tree from the mesh cache (only the triangles are gathered)
+    void load(const BVHNode* cachedNodes, unsigned int numNodes, const uint32_t* cachedOrder,
+        const Vertex* vertices, const void* indices, unsigned int numIndices, unsigned int indexSize);
+
+    bool empty() const { return nodes.empty(); }
+
+    // First triangle hit by a ray within maxDistance (the direction need not be unit length,
+    // distances are in multiples of it)
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        RayHit& hit) const;
+
+    // First triangle touched by a sphere moving from start to end (hit.distance is the
+    // fraction of the way, 0 if the sphere already touches a triangle at the start)
+    bool sphereSweep(const glm::vec3& start, const glm::vec3& end, float radius, RayHit& hit) const;
+
+    // True if any triangle overlaps the box, optionally listing every such triangle
+    bool overlapBox(const glm::vec3& min, const glm::vec3& max,
+        std::vector<unsigned int>* outTriangles = nullptr) const;
+
+    // Surface area heuristic cost of the tree (lower is better)
+    float cost() const;
+
+private:
+    void gatherTriangles(const Vertex* vertices, const void* indices, unsigned int indexSize);
+};
@@ -48,6 +48,11 @@ void Camera::quaternionCamera()
 	else
 		orientation = Maths::SLERP(orientation, newOrientation, 1.0f);
 
+	calculateOrientationMatrices();
+}
+
+void Camera::calculateOrientationMatrices()
+{
 	// Calculate the view matrix
 	view = orientation.matrix() * Maths::translate(-eye);
 	if (isThird)
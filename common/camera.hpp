@@ -49,6 +49,7 @@ public:
     void rotateCamera(float radius, float rotationSpeed, glm::vec3 centrePos); // Simple function to rotate the camera around a position
     void calculateCameraVectors();
     void quaternionCamera();
+    void calculateOrientationMatrices(); // View, projection and camera vectors from the orientation and eye (no SLERP)
 
 private:
     glm::mat4 calculateView(glm::vec3 eye, glm::vec3 target, glm::vec3 worldUp);
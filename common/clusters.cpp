@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <cmath>
+
+#include <common/clusters.hpp>
+#include <common/jobs.hpp>
+#include <common/profiler.hpp>
+
+LightClusters::LightClusters()
+{
+    setProjection(glm::mat4(1.0f), 0.1f, 100.0f, 1.0f, 1.0f);
+}
+
+LightClusters::~LightClusters()
+{
+    deleteBuffers();
+}
+
+// Point at depth in front of the camera on both a tile column plane and a tile row plane
+static glm::vec3 tileCorner(const glm::vec4& column, const glm::vec4& row, float depth)
+{
+    // With z = -depth the planes are two lines in x and y
+    float c0 = column.z * depth - column.w;
+    float c1 = row.z * depth - row.w;
+    float determinant = column.x * row.y - column.y * row.x;
+    return glm::vec3((c0 * row.y - c1 * column.y) / determinant, (column.x * c1 - row.x * c0) / determinant, -depth);
+}
+
+void LightClusters::setProjection(const glm::mat4& projection, float near, float far, float width, float height)
+{
+    if (projection == this->projection && depthRange == glm::vec2(near, far) &&
+        width == this->width && height == this->height)
+        return;
+
+    // Rows of the projection matrix, so clip.x = dot(rowX, (x, y, z, 1)) and so on
+    glm::vec4 rowX(projection[0][0], projection[1][0], projection[2][0], projection[3][0]);
+    glm::vec4 rowY(projection[0][1], projection[1][1], projection[2][1], projection[3][1]);
+    glm::vec4 rowZ(projection[0][2], projection[1][2], projection[2][2], projection[3][2]);
+    glm::vec4 rowW(projection[0][3], projection[1][3], projection[2][3], projection[3][3]);
+
+    // The tile boundary x_ndc = a is the plane clip.x - a * clip.w = 0
+    for (unsigned int i = 0; i <= tilesX; i++)
+    {
+        glm::vec4 plane = rowX - (-1.0f + 2.0f * i / tilesX) * rowW;
+        columnPlanes[i] = plane / sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    }
+    for (unsigned int j = 0; j <= tilesY; j++)
+    {
+        glm::vec4 plane = rowY - (-1.0f + 2.0f * j / tilesY) * rowW;
+        rowPlanes[j] = plane / sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    }
+
+    // Slice k starts at near * (far / near)^(k / slices), so it is found from the
+    // depth with one log
+    for (unsigned int k = 0; k <= slices; k++)
+        sliceDepths[k] = near * powf(far / near, float(k) / slices);
+    sliceScale = slices / logf(far / near);
+    sliceBias = -logf(near) * sliceScale;
+
+    // Fragments outside near and far go in the first and last slices, so those
+    // reach the clip planes (clip.z = -clip.w and clip.z = clip.w)
+    glm::vec4 nearPlane = rowZ + rowW, farPlane = rowW - rowZ;
+    nearest = nearPlane.z < 0.0f ? std::min(nearPlane.w / nearPlane.z, near) : near;
+    farthest = farPlane.z > 0.0f ? std::max(farPlane.w / farPlane.z, far) : 1e30f;
+
+    // Bound each cluster's corners with a box and the box with a sphere
+    clusterSpheres.resize(numClusters);
+    for (unsigned int k = 0; k < slices; k++)
+    {
+        for (unsigned int j = 0; j < tilesY; j++)
+        {
+            for (unsigned int i = 0; i < tilesX; i++)
+            {
+                glm::vec3 low(1e30f), high(-1e30f);
+                for (unsigned int c = 0; c < 8; c++)
+                {
+                    float depth = sliceDepths[k + (c >> 2)];
+                    if (k + (c >> 2) == 0)
+                        depth = nearest;
+                    else if (k + (c >> 2) == slices)
+                        depth = farthest;
+                    glm::vec3 corner = tileCorner(columnPlanes[i + (c & 1)], rowPlanes[j + ((c >> 1) & 1)], depth);
+                    low = glm::min(low, corner);
+                    high = glm::max(high, corner);
+                }
+                clusterSpheres[(k * tilesY + j) * tilesX + i] = glm::vec4((low + high) * 0.5f,
+                    glm::length(high - low) * 0.5f);
+            }
+        }
+    }
+
+    this->projection = projection;
+    depthRange = glm::vec2(near, far);
+    this->width = width;
+    this->height = height;
+}
+
+unsigned int LightClusters::sliceOf(float depth) const
+{
+    float slice = floorf(logf(depth) * sliceScale + sliceBias);
+    return static_cast<unsigned int>(std::min(std::max(slice, 0.0f), float(slices - 1)));
+}
+
+void LightClusters::assign(JobSystem* jobSystem)
+{
+    ProfileScope scope("LightClusters::assign");
+    // Bounding spheres of the lights in front of the camera
+    spheres.clear();
+    sphereLights.clear();
+    sphereSlices.clear();
+    sphereCones.clear();
+    cones.clear();
+    for (unsigned int i = numGlobalLights; i < lights.size(); i++)
+    {
+        const LightBlock& light = lights[i];
+        if (light.range <= 0.0f)
+            continue;
+
+        // A spotlight narrower than a hemisphere is bounded by its cone: through the
+        // apex and the rim when under 45 degrees, else around the rim
+        glm::vec4 sphere = glm::vec4(light.position, light.range);
+        Cone cone;
+        bool spot = light.type == 2 && light.cosPhi > 0.0f && glm::length(light.direction) > 0.0f;
+        if (spot)
+        {
+            cone.apex = light.position;
+            cone.range = light.range;
+            cone.axis = glm::normalize(light.direction);
+            cone.cosAngle = light.cosPhi;
+            cone.sinAngle = sqrtf(std::max(1.0f - light.cosPhi * light.cosPhi, 0.0f));
+            if (cone.cosAngle > cone.sinAngle)
+            {
+                float radius = cone.range / (2.0f * cone.cosAngle);
+                sphere = glm::vec4(cone.apex + cone.axis * radius, radius);
+            }
+            else
+                sphere = glm::vec4(cone.apex + cone.axis * (cone.range * cone.cosAngle), cone.range * cone.sinAngle);
+        }
+
+        float depth = -sphere.z;
+        if (depth + sphere.w < nearest || depth - sphere.w > farthest)
+            continue;
+
+        sphereCones.push_back(spot ? static_cast<int>(cones.size()) : -1);
+        if (spot)
+            cones.push_back(cone);
+        spheres.push_back(sphere);
+        sphereLights.push_back(i);
+        sphereSlices.push_back(glm::uvec2(sliceOf(std::max(depth - sphere.w, sliceDepths[0])),
+            sliceOf(std::max(depth + sphere.w, sliceDepths[0]))));
+    }
+
+    // Each job lists the lights of a run of slices. Few lights aren't worth waking
+    // the threads for.
+    unsigned int numJobs = 1;
+    if (jobSystem != nullptr && spheres.size() >= 64)
+        numJobs = jobSystem->size() < slices ? jobSystem->size() : slices;
+    if (jobs.size() < numJobs)
+        jobs.resize(numJobs);
+    clusters.resize(numClusters);
+
+    if (numJobs == 1)
+        assignSlices(jobs[0], 0, slices);
+    else
+    {
+        jobSystem->parallelFor(numJobs, 1, [this, numJobs](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int j = begin; j < end; j++)
+                assignSlices(jobs[j], slices * j / numJobs, slices * (j + 1) / numJobs);
+        });
+    }
+
+    // Join the jobs' lists, moving each job's offsets past the lists before it
+    indices.clear();
+    litClusters = 0;
+    maxClusterLights = 0;
+    for (unsigned int j = 0; j < numJobs; j++)
+    {
+        unsigned int first = tilesX * tilesY * (slices * j / numJobs);
+        unsigned int last = tilesX * tilesY * (slices * (j + 1) / numJobs);
+        unsigned int base = static_cast<unsigned int>(indices.size());
+        for (unsigned int c = first; c < last; c++)
+        {
+            clusters[c].x += base;
+            if (clusters[c].y > 0)
+                litClusters++;
+            maxClusterLights = std::max(maxClusterLights, clusters[c].y);
+        }
+        indices.insert(indices.end(), jobs[j].indices.begin(), jobs[j].indices.end());
+    }
+}
+
+// Range of tiles a sphere overlaps, where planes[i] and planes[i + 1] bound tile i.
+// Returns false if it misses them all.
+static bool tileRange(const glm::vec4* planes, unsigned int numTiles, const glm::vec3& centre, float radius,
+    unsigned int& first, unsigned int& last)
+{
+    bool found = false;
+    float previous = planes[0].x * centre.x + planes[0].y * centre.y + planes[0].z * centre.z + planes[0].w;
+    for (unsigned int i = 0; i < numTiles; i++)
+    {
+        const glm::vec4& plane = planes[i + 1];
+        float next = plane.x * centre.x + plane.y * centre.y + plane.z * centre.z + plane.w;
+        if (previous >= -radius && next <= radius)
+        {
+            if (!found)
+                first = i;
+            last = i;
+            found = true;
+        }
+        previous = next;
+    }
+    return found;
+}
+
+// Whether a spotlight's cone reaches a sphere: the sphere's centre must be
+// within its radius of the cone's side, and not past either end of the axis
+static bool coneReaches(const glm::vec3& apex, const glm::vec3& axis, float cosAngle, float sinAngle, float range,
+    const glm::vec4& sphere)
+{
+    glm::vec3 offset = glm::vec3(sphere) - apex;
+    float along = glm::dot(offset, axis);
+    float across = sqrtf(std::max(glm::dot(offset, offset) - along * along, 0.0f));
+    float side = across * cosAngle - along * sinAngle;     // distance outside the side, negative inside
+    return side <= sphere.w && along <= range + sphere.w && along >= -sphere.w;
+}
+
+void LightClusters::assignSlices(Job& job, unsigned int firstSlice, unsigned int lastSlice)
+{
+    ProfileScope scope("LightClusters::assignSlices");
+    job.indices.clear();
+    for (unsigned int k = firstSlice; k < lastSlice; k++)
+    {
+        // Lights reaching this slice, with the tiles covered by their part inside it
+        job.sliceLights.clear();
+        float sliceNear = k == 0 ? nearest : sliceDepths[k];
+        float sliceFar = k + 1 == slices ? farthest : sliceDepths[k + 1];
+        for (unsigned int s = 0; s < spheres.size(); s++)
+        {
+            if (k < sphereSlices[s].x || k > sphereSlices[s].y)
+                continue;
+
+            // A sphere cut by the slice fits in the circle where it crosses the nearest face
+            glm::vec3 centre = glm::vec3(spheres[s]);
+            float depth = -centre.z;
+            float clampedDepth = std::min(std::max(depth, sliceNear), sliceFar);
+            float offset = clampedDepth - depth;
+            float radius = sqrtf(std::max(spheres[s].w * spheres[s].w - offset * offset, 0.0f));
+            centre.z = -clampedDepth;
+
+            SliceLight light;
+            light.light = sphereLights[s];
+            light.cone = sphereCones[s];
+            if (tileRange(columnPlanes, tilesX, centre, radius, light.firstColumn, light.lastColumn) &&
+                tileRange(rowPlanes, tilesY, centre, radius, light.firstRow, light.lastRow))
+                job.sliceLights.push_back(light);
+        }
+
+        // List them cluster by cluster, a row of tiles at a time
+        for (unsigned int y = 0; y < tilesY; y++)
+        {
+            job.rowLights.clear();
+            for (unsigned int l = 0; l < job.sliceLights.size(); l++)
+            {
+                if (y >= job.sliceLights[l].firstRow && y <= job.sliceLights[l].lastRow)
+                    job.rowLights.push_back(l);
+            }
+
+            for (unsigned int x = 0; x < tilesX; x++)
+            {
+                unsigned int c = (k * tilesY + y) * tilesX + x;
+                glm::uvec2& cluster = clusters[c];
+                cluster.x = static_cast<unsigned int>(job.indices.size());
+                for (unsigned int l : job.rowLights)
+                {
+                    const SliceLight& light = job.sliceLights[l];
+                    if (x < light.firstColumn || x > light.lastColumn)
+                        continue;
+
+                    // Spotlights also need their cone to reach the cluster's bounds
+                    if (light.cone >= 0)
+                    {
+                        const Cone& cone = cones[light.cone];
+                        if (!coneReaches(cone.apex, cone.axis, cone.cosAngle, cone.sinAngle, cone.range,
+                            clusterSpheres[c]))
+                            continue;
+                    }
+                    job.indices.push_back(light.light);
+                }
+                cluster.y = static_cast<unsigned int>(job.indices.size()) - cluster.x;
+            }
+        }
+    }
+}
+
+void LightClusters::toShader(const ShaderProgram& program)
+{
+    ProfileScope scope("LightClusters::toShader");
+    // Lights are read as raw bits so the light type stays an int
+    static const GLenum formats[3] = { GL_RGBA32UI, GL_RG32UI, GL_R32UI };
+    static const unsigned int units[3] = { ShaderProgram::clusterLightsUnit, ShaderProgram::clusterGridUnit,
+        ShaderProgram::clusterIndicesUnit };
+
+    if (buffers[0] == 0)
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+    }
+
+    // Replace the buffer contents (new storage every frame, so the driver
+    // needn't wait for the previous frame's draws to finish reading them)
+    const void* data[3] = { lights.data(), clusters.data(), indices.data() };
+    size_t sizes[3] = { lights.size() * sizeof(LightBlock), clusters.size() * sizeof(glm::uvec2),
+        indices.size() * sizeof(unsigned int) };
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        if (sizes[i] > 0)
+            glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+        else
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glActiveTexture(GL_TEXTURE0 + units[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Tiles per pixel and the depth slice scale and bias
+    glUniform4f(program.uniforms.clusterParams, tilesX / width, tilesY / height, sliceScale, sliceBias);
+    glUniform1i(program.uniforms.numGlobalLights, numGlobalLights);
+}
+
+void LightClusters::deleteBuffers()
+{
+    if (buffers[0] != 0)
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        buffers[i] = 0;
+        textures[i] = 0;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <common/light.hpp>
+
+class JobSystem;
+
+// Clustered forward lighting. The view frustum is split into a grid of clusters
+// (screen tiles by exponential depth slices) and each cluster lists the lights
+// whose range reaches it, so a fragment only loops over its own cluster's
+// lights. Spotlights are only listed in the clusters their cone reaches. The
+// lists are rebuilt on the CPU every frame and the shaders read them, with the
+// lights, from texture buffers.
+class LightClusters
+{
+public:
+    // Grid size (tilesX, tilesY and slices in clusteredFragmentShader.glsl)
+    static const unsigned int tilesX = 16;
+    static const unsigned int tilesY = 12;
+    static const unsigned int slices = 24;
+    static const unsigned int numClusters = tilesX * tilesY * slices;
+
+    // View space lights, the directional ones first. Those light every cluster
+    // so they are not listed.
+    std::vector<LightBlock> lights;
+    unsigned int numGlobalLights = 0;
+
+    // Offset and count into indices for each cluster, x fastest then y then slice
+    std::vector<glm::uvec2> clusters;
+    std::vector<unsigned int> indices;
+
+    // Stats from the last assign()
+    unsigned int litClusters = 0;
+    unsigned int maxClusterLights = 0;
+
+    LightClusters();
+    ~LightClusters();
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Calculate the tile planes, depth slices and cluster bounds of a projection
+    // (skipped if nothing changed). near and far bound the slices and width and
+    // height are the viewport in pixels.
+    void setProjection(const glm::mat4& projection, float near, float far, float width, float height);
+
+    // List the lights in every cluster, splitting the slices between the job
+    // system's threads (on the calling thread if jobSystem is null)
+    void assign(JobSystem* jobSystem = nullptr);
+
+    // Upload the lights and lists to the texture buffers, bind them and set the
+    // grid uniforms of a program (which must be in use)
+    void toShader(const ShaderProgram& program);
+
+    // Delete the buffers (also done by the destructor)
+    void deleteBuffers();
+
+private:
+    glm::vec4 columnPlanes[tilesX + 1];     // x_ndc = -1 + 2i / tilesX, positive to the right
+    glm::vec4 rowPlanes[tilesY + 1];        // y_ndc = -1 + 2j / tilesY, positive above
+    float sliceDepths[slices + 1];          // distance in front of the camera of each slice boundary
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+    float width = 1.0f, height = 1.0f;
+    glm::mat4 projection = glm::mat4(0.0f);
+    glm::vec2 depthRange = glm::vec2(0.0f);
+    float nearest = 0.0f, farthest = 0.0f;  // depths the first and last slices reach (out to the clip planes)
+
+    // View space bounding sphere of every cluster, in the order of clusters
+    std::vector<glm::vec4> clusterSpheres;
+
+    // Lights with a range as view space spheres (a spotlight's bounds its cone),
+    // the slices they reach and their cones (-1 for lights that aren't spotlights)
+    std::vector<glm::vec4> spheres;
+    std::vector<unsigned int> sphereLights;
+    std::vector<glm::uvec2> sphereSlices;
+    std::vector<int> sphereCones;
+
+    // A spotlight's lit volume: the part of a sphere around the apex within
+    // angle of the axis
+    struct Cone
+    {
+        glm::vec3 apex;
+        float range;
+        glm::vec3 axis;
+        float cosAngle, sinAngle;
+    };
+    std::vector<Cone> cones;
+
+    // A light reaching a slice, the tiles it covers there and its cone
+    struct SliceLight
+    {
+        unsigned int light;
+        unsigned int firstColumn, lastColumn;
+        unsigned int firstRow, lastRow;
+        int cone;
+    };
+
+    // Per job light lists and scratch, kept between frames
+    struct Job
+    {
+        std::vector<unsigned int> indices;
+        std::vector<SliceLight> sliceLights;
+        std::vector<unsigned int> rowLights;
+    };
+    std::vector<Job> jobs;
+
+    unsigned int buffers[3] = { 0, 0, 0 };
+    unsigned int textures[3] = { 0, 0, 0 };
+
+    unsigned int sliceOf(float depth) const;
+    void assignSlices(Job& job, unsigned int firstSlice, unsigned int lastSlice);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+// Bounding sphere against frustum kernel behind Frustum::cullSpheres. As in
+// transformkernel.hpp, V holds one sphere per lane and the same code builds the
+// scalar, SSE (simd.hpp) and AVX2 (mathsavx2.cpp) versions.
+//
+// Spheres are packed float[4] (centre, radius). Planes are float[24], six
+// (a, b, c, d) with ax + by + cz + d >= 0 on the inside and (a, b, c) unit length.
+
+namespace
+{
+
+// Write the index of each sphere at least partly inside to outVisible (which has
+// room for count) and return how many there are
+template <class V>
+unsigned int findVisibleSpheres(unsigned int count, const float* spheres, const float* planes, unsigned int* outVisible)
+{
+    // Splat the planes once
+    V a[6], b[6], c[6], d[6];
+    for (int p = 0; p < 6; p++)
+    {
+        a[p] = V(planes[4 * p]);
+        b[p] = V(planes[4 * p + 1]);
+        c[p] = V(planes[4 * p + 2]);
+        d[p] = V(planes[4 * p + 3]);
+    }
+
+    unsigned int numVisible = 0;
+    for (unsigned int i = 0; i + V::width <= count; i += V::width)
+    {
+        V x, y, z, radius;
+        V::load4Transposed(spheres + 4 * i, x, y, z, radius);
+
+        // Distance inside the nearest plane, negative when wholly outside any of them
+        V nearest = a[0] * x + b[0] * y + c[0] * z + d[0];
+        for (int p = 1; p < 6; p++)
+            nearest = V::min(nearest, a[p] * x + b[p] * y + c[p] * z + d[p]);
+        int outside = V::signMask(nearest + radius);
+
+        // Append the visible lanes without branching
+        for (unsigned int k = 0; k < V::width; k++)
+        {
+            outVisible[numVisible] = i + k;
+            numVisible += ((outside >> k) & 1) ^ 1;
+        }
+    }
+    return numVisible;
+}
+
+}
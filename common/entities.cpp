@@ -0,0 +1,221 @@
+#include <algorithm>
+
+#include <common/entities.hpp>
+#include <common/maths.hpp>
+#include <common/bvh.hpp>
+
+unsigned int EntityStore::spawn(const Object& object)
+{
+    tags.push_back(object.tag);
+    positions.push_back(object.position);
+    rotations.push_back(object.rotation);
+    angles.push_back(object.angle);
+    scales.push_back(object.scale);
+    transforms.push_back(glm::mat4(1.0f));
+    bounds.push_back(glm::vec4(object.position, 0.0f));
+    velocities.push_back(object.velocity);
+    colliders.push_back(object.type);
+    widths.push_back(object.width);
+    models.push_back(object.model);
+    return size() - 1;
+}
+
+void EntityStore::set(unsigned int index, const Object& object)
+{
+    tags[index] = object.tag;
+    positions[index] = object.position;
+    rotations[index] = object.rotation;
+    angles[index] = object.angle;
+    scales[index] = object.scale;
+    velocities[index] = object.velocity;
+    colliders[index] = object.type;
+    widths[index] = object.width;
+    models[index] = object.model;
+}
+
+void EntityStore::remove(unsigned int index)
+{
+    unsigned int last = size() - 1;
+    if (index != last)
+    {
+        tags[index] = tags[last];
+        positions[index] = positions[last];
+        rotations[index] = rotations[last];
+        angles[index] = angles[last];
+        scales[index] = scales[last];
+        transforms[index] = transforms[last];
+        bounds[index] = bounds[last];
+        velocities[index] = velocities[last];
+        colliders[index] = colliders[last];
+        widths[index] = widths[last];
+        models[index] = models[last];
+    }
+
+    tags.pop_back();
+    positions.pop_back();
+    rotations.pop_back();
+    angles.pop_back();
+    scales.pop_back();
+    transforms.pop_back();
+    bounds.pop_back();
+    velocities.pop_back();
+    colliders.pop_back();
+    widths.pop_back();
+    models.pop_back();
+}
+
+void EntityStore::clear()
+{
+    tags.clear();
+    positions.clear();
+    rotations.clear();
+    angles.clear();
+    scales.clear();
+    transforms.clear();
+    bounds.clear();
+    velocities.clear();
+    colliders.clear();
+    widths.clear();
+    models.clear();
+}
+
+void EntityStore::reserve(unsigned int count)
+{
+    tags.reserve(count);
+    positions.reserve(count);
+    rotations.reserve(count);
+    angles.reserve(count);
+    scales.reserve(count);
+    transforms.reserve(count);
+    bounds.reserve(count);
+    velocities.reserve(count);
+    colliders.reserve(count);
+    widths.reserve(count);
+    models.reserve(count);
+}
+
+bool EntityStore::sphereSweep(unsigned int index, const glm::vec3& start, const glm::vec3& end,
+    float radius, RayHit& hit) const
+{
+    if (!models[index])
+        return false;
+
+    // Move the sweep into the model's space
+    glm::mat4 inverse = glm::inverse(transforms[index]);
+    glm::vec3 localStart = glm::vec3(inverse * glm::vec4(start, 1.0f));
+    glm::vec3 localEnd = glm::vec3(inverse * glm::vec4(end, 1.0f));
+    float scale = std::max(scales[index].x, std::max(scales[index].y, scales[index].z));
+    return models[index]->sphereSweep(localStart, localEnd, radius / scale, hit);
+}
+
+void EntityStore::move(float deltaTime)
+{
+    unsigned int count = size();
+    for (unsigned int i = 0; i < count; i++)
+        positions[i] += velocities[i] * deltaTime;
+}
+
+void EntityStore::updateTransforms()
+{
+    updateTransforms(0, size());
+}
+
+void EntityStore::updateTransforms(unsigned int begin, unsigned int end)
+{
+    Maths::modelMatrices(end - begin, positions.data() + begin, rotations.data() + begin, angles.data() + begin,
+        scales.data() + begin, transforms.data() + begin);
+
+    // Move the meshes' bounding spheres into the world
+    for (unsigned int i = begin; i < end; i++)
+    {
+        if (!models[i])
+        {
+            bounds[i] = glm::vec4(positions[i], 0.0f);
+            continue;
+        }
+        const MeshBounds& meshBounds = models[i]->bounds();
+        glm::vec3 scale = glm::abs(scales[i]);
+        glm::vec4 centre = transforms[i] * glm::vec4(meshBounds.centre, 1.0f);
+        bounds[i] = glm::vec4(glm::vec3(centre), meshBounds.radius * std::max(scale.x, std::max(scale.y, scale.z)));
+    }
+}
+
+void EntityStore::interpolate(const EntityStore& previous, float alpha)
+{
+    interpolate(previous, alpha, 0, size());
+}
+
+void EntityStore::interpolate(const EntityStore& previous, float alpha, unsigned int begin, unsigned int end)
+{
+    if (previous.size() == size())
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            if (previous.models[i] != models[i])
+                continue;
+            positions[i] = previous.positions[i] + (positions[i] - previous.positions[i]) * alpha;
+            angles[i] = previous.angles[i] + (angles[i] - previous.angles[i]) * alpha;
+        }
+    }
+    updateTransforms(begin, end);
+}
+
+void EntityStore::updateColliders(SpatialHash& grid) const
+{
+    unsigned int count = size();
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (colliders[i] == OBJECT)
+            grid.update(i, positions[i], widths[i]);
+        else if (colliders[i] == ENVINOMENT && models[i])
+        {
+            // The environment doesn't move, so its box is only worked out once
+            if (!grid.contains(i))
+            {
+                glm::vec3 min, max;
+                worldBox(i, min, max);
+                grid.updateBox(i, min, max);
+            }
+        }
+        else
+            grid.remove(i);
+    }
+    grid.resize(count);
+}
+
+void EntityStore::worldBox(unsigned int index, glm::vec3& outMin, glm::vec3& outMax) const
+{
+    // Box around the corners of the mesh's box moved into the world
+    const MeshBounds& meshBounds = models[index]->bounds();
+    outMin = glm::vec3(1e30f);
+    outMax = glm::vec3(-1e30f);
+    for (unsigned int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 local = glm::vec3(corner & 1 ? meshBounds.max.x : meshBounds.min.x,
+                                    corner & 2 ? meshBounds.max.y : meshBounds.min.y,
+                                    corner & 4 ? meshBounds.max.z : meshBounds.min.z);
+        glm::vec3 world = glm::vec3(transforms[index] * glm::vec4(local, 1.0f));
+        outMin = glm::min(outMin, world);
+        outMax = glm::max(outMax, world);
+    }
+}
+
+void EntityStore::cull(Frustum& frustum, std::vector<unsigned int>& outVisible) const
+{
+    frustum.cullSpheres(size(), bounds.data(), outVisible);
+}
+
+void EntityStore::submit(InstanceList& list) const
+{
+    unsigned int count = size();
+    for (unsigned int i = 0; i < count; i++)
+        if (models[i])
+            list.add(*models[i], transforms[i]);
+}
+
+void EntityStore::submit(InstanceList& list, const std::vector<unsigned int>& visible) const
+{
+    for (unsigned int i : visible)
+        if (models[i])
+            list.add(*models[i], transforms[i]);
+}
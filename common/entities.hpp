@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <common/model.hpp>
+#include <common/renderer.hpp>
+#include <common/spatialhash.hpp>
+#include <common/frustum.hpp>
+
+// Entity type IDs (what an entity is, used to pick its behaviour)
+enum EntityTag : unsigned char
+{
+    STATIC_TEAPOT,
+    TEAPOT_GUN,
+    BULLET,
+    WALLS,
+    FLOOR,
+    ROOF,
+    CRATE,
+    NUM_ENTITY_TAGS
+};
+
+// Collider types used to differenciate objects
+enum objectType : unsigned char
+{
+    OBJECT,
+    ENVINOMENT,
+    INTERACTIVE,
+    NO_COLLIDER     // drawn only, never collides
+};
+
+// Description of an entity, copied into the store by EntityStore::spawn
+struct Object
+{
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+    glm::vec3 rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+    glm::vec3 velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+    float angle = 0.0f;
+    float width = 0.0f;
+    EntityTag tag = STATIC_TEAPOT;
+    objectType type = ENVINOMENT;
+    const Model* model = nullptr;
+};
+
+// Structure of arrays entity store. Element i of every component array belongs
+// to entity i, so each system walks only the arrays it needs, front to back.
+class EntityStore
+{
+public:
+    // Tag
+    std::vector<EntityTag> tags;
+
+    // Transform
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> rotations;
+    std::vector<float> angles;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> transforms;  // model matrices from updateTransforms
+    std::vector<glm::vec4> bounds;      // world bounding spheres (centre, radius) from updateTransforms
+
+    // Velocity
+    std::vector<glm::vec3> velocities;
+
+    // Collider
+    std::vector<objectType> colliders;
+    std::vector<float> widths;
+
+    // Mesh (the models are owned elsewhere)
+    std::vector<const Model*> models;
+
+    unsigned int size() const { return static_cast<unsigned int>(tags.size()); }
+
+    // Add an entity, returns its index
+    unsigned int spawn(const Object& object);
+
+    // Overwrite the components of an entity
+    void set(unsigned int index, const Object& object);
+
+    // Remove an entity by moving the last one into its place
+    void remove(unsigned int index);
+
+    void clear();
+    void reserve(unsigned int count);
+
+    // Sweep a sphere against an entity's mesh (world space in, the hit normal is in
+    // model space). The radius is scaled by the entity's largest scale component.
+    bool sphereSweep(unsigned int index, const glm::vec3& start, const glm::vec3& end, float radius,
+        RayHit& hit) const;
+
+    // World space box around an entity's mesh (from its current transform)
+    void worldBox(unsigned int index, glm::vec3& outMin, glm::vec3& outMax) const;
+
+    // Systems
+    void move(float deltaTime);
+    void updateTransforms();
+    void updateTransforms(unsigned int begin, unsigned int end);
+
+    // Blend the positions and angles from an earlier copy of the store (alpha 0)
+    // to this one's (alpha 1) and rebuild the transforms. Entities that changed
+    // model in between aren't blended. Separate ranges can be blended on
+    // separate threads.
+    void interpolate(const EntityStore& previous, float alpha);
+    void interpolate(const EntityStore& previous, float alpha, unsigned int begin, unsigned int end);
+    // OBJECT colliders are kept in the grid as circles of their width. ENVINOMENT
+    // colliders are static boxes, added the first time they are seen (remove an
+    // environment entity from the grid if it moves). Other entities don't collide.
+    void updateColliders(SpatialHash& grid) const;
+    void cull(Frustum& frustum, std::vector<unsigned int>& outVisible) const;
+    void submit(InstanceList& list) const;
+    void submit(InstanceList& list, const std::vector<unsigned int>& visible) const;
+};
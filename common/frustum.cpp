@@ -0,0 +1,100 @@
+#include <common/frustum.hpp>
+#include <common/maths.hpp>
+#include <common/simd.hpp>
+#include <common/cullkernel.hpp>
+
+static_assert(sizeof(glm::vec4) == 4 * sizeof(float), "vec4 arrays are read as packed floats");
+
+// AVX2 kernel (mathsavx2.cpp, built with AVX2 enabled)
+unsigned int cullSpheresAVX2(unsigned int count, const float* spheres, const float* planes, unsigned int* outVisible);
+
+Frustum::Frustum()
+{
+    // Everything is inside until the first update
+    for (int i = 0; i < 6; i++)
+        planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Frustum::update(const glm::mat4& viewProjection)
+{
+    // Rows of the matrix (glm is column major)
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    // A clip space point is inside when -w <= x, y, z <= w
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+
+    for (int i = 0; i < 6; i++)
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool Frustum::sphereVisible(const glm::vec3& centre, float radius)
+{
+    tested++;
+    for (int i = 0; i < 6; i++)
+        if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius)
+            return false;
+    visible++;
+    return true;
+}
+
+bool Frustum::boxVisible(const glm::vec3& min, const glm::vec3& max)
+{
+    tested++;
+    for (int i = 0; i < 6; i++)
+    {
+        // The box corner furthest along the plane's normal
+        glm::vec3 corner(planes[i].x >= 0.0f ? max.x : min.x,
+            planes[i].y >= 0.0f ? max.y : min.y,
+            planes[i].z >= 0.0f ? max.z : min.z);
+        if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+            return false;
+    }
+    visible++;
+    return true;
+}
+
+void Frustum::cullSpheres(unsigned int count, const glm::vec4* spheres, std::vector<unsigned int>& outVisible)
+{
+    outVisible.resize(count);
+    if (count == 0)
+        return;
+
+    // Run the widest kernel allowed, then finish the remainder one sphere at a time
+    const float* packedSpheres = &spheres[0].x;
+    const float* packedPlanes = &planes[0].x;
+    unsigned int done = 0, numVisible = 0;
+#ifdef SIMD_X86
+    if (Maths::simdLevel >= Maths::SIMD_AVX2)
+    {
+        done = count - count % 8;
+        numVisible = cullSpheresAVX2(done, packedSpheres, packedPlanes, outVisible.data());
+    }
+    else if (Maths::simdLevel >= Maths::SIMD_SSE)
+    {
+        done = count - count % 4;
+        numVisible = findVisibleSpheres<Sse>(done, packedSpheres, packedPlanes, outVisible.data());
+    }
+#endif
+    unsigned int* tail = outVisible.data() + numVisible;
+    unsigned int numTail = findVisibleSpheres<Scalar>(count - done, packedSpheres + 4 * done, packedPlanes, tail);
+    for (unsigned int i = 0; i < numTail; i++)
+        tail[i] += done;
+    numVisible += numTail;
+
+    outVisible.resize(numVisible);
+    tested += count;
+    visible += numVisible;
+}
+
+void Frustum::resetCounts()
+{
+    tested = 0;
+    visible = 0;
+}
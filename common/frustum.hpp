@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// View frustum as six world space planes (left, right, bottom, top, near, far).
+// Each plane is (a, b, c, d) with ax + by + cz + d >= 0 on the inside and
+// (a, b, c) unit length, so plane distances are in world units.
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    // Objects tested and objects found at least partly inside since resetCounts
+    // (the culled objects are tested - visible)
+    unsigned int tested = 0;
+    unsigned int visible = 0;
+
+    Frustum();
+
+    // Extract the planes of projection * view
+    void update(const glm::mat4& viewProjection);
+
+    bool sphereVisible(const glm::vec3& centre, float radius);
+    bool boxVisible(const glm::vec3& min, const glm::vec3& max);
+
+    // Find the spheres (centre, radius) at least partly inside, 4 or 8 at a time
+    // depending on Maths::simdLevel
+    void cullSpheres(unsigned int count, const glm::vec4* spheres, std::vector<unsigned int>& outVisible);
+
+    void resetCounts();
+};
@@ -0,0 +1,66 @@
+#include <common/glstats.hpp>
+
+unsigned int GLStats::calls = 0;
+unsigned int GLStats::draws = 0;
+unsigned int GLStats::frameCalls = 0;
+unsigned int GLStats::frameDraws = 0;
+
+// Counting replacement for a GLEW function pointer. Each hooked pointer gets its
+// own instantiation holding the driver's original function.
+template <typename Proc>
+struct GLHook;
+
+template <typename Result, typename... Args>
+struct GLHook<Result (GLAPIENTRY*)(Args...)>
+{
+    template <Result (GLAPIENTRY** slot)(Args...)>
+    struct Slot
+    {
+        static inline Result (GLAPIENTRY* original)(Args...) = nullptr;
+
+        static Result GLAPIENTRY call(Args... args)
+        {
+            GLStats::calls++;
+            return original(args...);
+        }
+
+        static void install()
+        {
+            if (*slot == nullptr || *slot == call)
+                return;
+            original = *slot;
+            *slot = call;
+        }
+    };
+};
+
+// The GLEW names are macros for the function pointers (e.g. glUniform1f is
+// __glewUniform1f), so hook the pointer they expand to
+#define HOOK_GL(name) GLHook<decltype(name)>::Slot<&name>::install()
+
+void GLStats::install()
+{
+    HOOK_GL(glUseProgram);
+    HOOK_GL(glGetUniformLocation);
+    HOOK_GL(glUniform1i);
+    HOOK_GL(glUniform1f);
+    HOOK_GL(glUniform4f);
+    HOOK_GL(glUniform3fv);
+    HOOK_GL(glUniformMatrix3fv);
+    HOOK_GL(glUniformMatrix4fv);
+    HOOK_GL(glBindVertexArray);
+    HOOK_GL(glBindBuffer);
+    HOOK_GL(glBindBufferBase);
+    HOOK_GL(glBufferData);
+    HOOK_GL(glBufferSubData);
+    HOOK_GL(glActiveTexture);
+    HOOK_GL(glDrawElementsInstanced);
+}
+
+void GLStats::endFrame()
+{
+    frameCalls = calls;
+    frameDraws = draws;
+    calls = 0;
+    draws = 0;
+}
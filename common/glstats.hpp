@@ -0,0 +1,25 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Per-frame GL call counters. install() wraps the GLEW function pointers used
+// while rendering (uniforms, programs, buffers, vertex arrays, textures) with
+// counting versions, so it must be called after glewInit. The OpenGL 1.1 entry
+// points (glDrawElements, glBindTexture, glClear) are linked directly rather than
+// loaded through GLEW and are not included in calls; draws are counted by Mesh.
+class GLStats
+{
+public:
+    static unsigned int calls;
+    static unsigned int draws;
+
+    // Counts of the last completed frame
+    static unsigned int frameCalls;
+    static unsigned int frameDraws;
+
+    // Start counting GLEW calls
+    static void install();
+
+    // Store the counts for the frame just finished and reset them
+    static void endFrame();
+};
@@ -0,0 +1,137 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+#include <common/headless.hpp>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+OffscreenContext::~OffscreenContext()
+{
+    destroy();
+}
+
+bool OffscreenContext::create(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+#ifdef HEADLESS_EGL
+    // Mesa's surfaceless platform needs no display server, otherwise try the default display
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if (getPlatformDisplay)
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (eglDisplay == EGL_NO_DISPLAY)
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        printf("Failed to initialise EGL (error 0x%x)\n", eglGetError());
+        return false;
+    }
+    display = eglDisplay;
+
+    // Any desktop GL config will do as nothing is drawn to an EGL surface
+    const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE };
+    EGLConfig config = NULL;
+    EGLint numConfigs = 0;
+    eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs);
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, numConfigs > 0 ? config : NULL, EGL_NO_CONTEXT,
+        contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        printf("Failed to create a surfaceless OpenGL 3.3 context (error 0x%x)\n", eglGetError());
+        return false;
+    }
+    context = eglContext;
+    return true;
+#else
+    printf("Headless mode needs EGL, which this build was made without\n");
+    return false;
+#endif
+}
+
+bool OffscreenContext::createFramebuffer()
+{
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        printf("Offscreen framebuffer is incomplete\n");
+        return false;
+    }
+
+    // Without a surface the viewport starts empty
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+bool OffscreenContext::savePPM(const char* path)
+{
+    pixels.resize(3 * width * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("Couldn't write %s\n", path);
+        return false;
+    }
+
+    // GL reads the bottom row first
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; y--)
+        fwrite(&pixels[3 * width * y], 1, 3 * width, file);
+    fclose(file);
+    return true;
+}
+
+void OffscreenContext::destroy()
+{
+    if (framebuffer != 0)
+    {
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+
+#ifdef HEADLESS_EGL
+    if (context)
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        context = nullptr;
+    }
+    if (display)
+    {
+        eglTerminate(display);
+        display = nullptr;
+    }
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+// OpenGL 3.3 core context with no window or display, rendering into an
+// offscreen framebuffer. It uses a surfaceless EGL context (Mesa's llvmpipe
+// when there is no GPU), so it is only available in builds with EGL
+// (HEADLESS_EGL).
+class OffscreenContext
+{
+public:
+    int width = 0;
+    int height = 0;
+
+    OffscreenContext() {}
+    ~OffscreenContext();
+    OffscreenContext(const OffscreenContext&) = delete;
+    OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+    // Create the context and make it current, returns false if it fails
+    bool create(int width, int height);
+
+    // Create and bind the framebuffer everything is drawn into (once GLEW is
+    // initialised), returns false if it is incomplete
+    bool createFramebuffer();
+
+    // Write the framebuffer to a binary PPM, top row first
+    bool savePPM(const char* path);
+
+    // Delete the framebuffer and the context (also done by the destructor)
+    void destroy();
+
+private:
+    void* display = nullptr;
+    void* context = nullptr;
+    unsigned int framebuffer = 0;
+    unsigned int renderbuffers[2] = { 0, 0 };
+    std::vector<unsigned char> pixels;
+};
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+#include <common/input.hpp>
+
+// GLFW key of each InputKey
+static const int glfwKeys[NUM_INPUT_KEYS] = {
+    GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_SPACE, GLFW_KEY_E, GLFW_KEY_ENTER,
+    GLFW_KEY_BACKSPACE, GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5, GLFW_KEY_Q,
+    GLFW_KEY_ESCAPE
+};
+
+InputFrame pollInput(GLFWwindow* window, int width, int height)
+{
+    InputFrame input;
+    for (unsigned int i = 0; i < NUM_INPUT_KEYS; i++)
+    {
+        if (glfwGetKey(window, glfwKeys[i]) == GLFW_PRESS)
+            input.press(InputKey(i));
+    }
+
+    // Get mouse cursor position and reset to centre
+    double xPos, yPos;
+    glfwGetCursorPos(window, &xPos, &yPos);
+    glfwSetCursorPos(window, width / 2, height / 2);
+    input.cursorX = float(xPos - width / 2);
+    input.cursorY = float(yPos - height / 2);
+    return input;
+}
+
+bool InputLog::save(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Couldn't write the input log %s\n", path);
+        return false;
+    }
+
+    InputLogHeader header;
+    memcpy(header.magic, "INPT", 4);
+    header.version = version;
+    header.frameSize = sizeof(InputFrame);
+    header.numFrames = static_cast<uint32_t>(frames.size());
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !frames.empty())
+        ok = fwrite(frames.data(), sizeof(InputFrame), frames.size(), file) == frames.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        printf("Couldn't write the input log %s\n", path);
+    return ok;
+}
+
+bool InputLog::load(const char* path)
+{
+    frames.clear();
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Couldn't open the input log %s\n", path);
+        return false;
+    }
+
+    InputLogHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "INPT", 4) == 0 &&
+        header.version == version && header.frameSize == sizeof(InputFrame);
+
+    // The frames must fit in the rest of the file, so a bad count can't allocate much
+    if (ok)
+    {
+        long start = ftell(file);
+        ok = fseek(file, 0, SEEK_END) == 0;
+        long end = ftell(file);
+        ok = ok && start >= 0 && end >= start && fseek(file, start, SEEK_SET) == 0 &&
+            uint64_t(header.numFrames) * sizeof(InputFrame) <= uint64_t(end - start);
+    }
+    if (ok)
+    {
+        frames.resize(header.numFrames);
+        ok = header.numFrames == 0 || fread(frames.data(), sizeof(InputFrame), frames.size(), file) == frames.size();
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        printf("%s isn't a valid input log\n", path);
+        frames.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+struct GLFWwindow;
+
+// Keys the game reads, one bit each in InputFrame::keys
+enum InputKey : unsigned char
+{
+    INPUT_W,
+    INPUT_A,
+    INPUT_S,
+    INPUT_D,
+    INPUT_SPACE,
+    INPUT_E,
+    INPUT_ENTER,
+    INPUT_BACKSPACE,
+    INPUT_1,
+    INPUT_2,
+    INPUT_3,
+    INPUT_4,
+    INPUT_5,
+    INPUT_Q,
+    INPUT_ESCAPE,
+    NUM_INPUT_KEYS
+};
+
+// Everything the game reads from the keyboard and mouse in one frame
+struct InputFrame
+{
+    uint16_t keys = 0;          // bit i is set while InputKey i is held
+    uint16_t padding = 0;
+    float cursorX = 0.0f;       // cursor movement since the last frame in pixels
+    float cursorY = 0.0f;
+
+    bool down(InputKey key) const { return (keys >> key) & 1; }
+    void press(InputKey key) { keys |= uint16_t(1 << key); }
+
+    // Whether the key went down since the previous frame
+    bool pressed(InputKey key, const InputFrame& previous) const { return down(key) && !previous.down(key); }
+};
+
+// Read the keys and the cursor movement from the window, recentring the cursor
+InputFrame pollInput(GLFWwindow* window, int width, int height);
+
+// Header at the start of every input log
+struct InputLogHeader
+{
+    char magic[4];              // "INPT"
+    uint32_t version;           // InputLog::version
+    uint32_t frameSize;         // sizeof(InputFrame)
+    uint32_t numFrames;
+};
+
+// Input recorded one frame at a time, saved as the header followed by the frames
+class InputLog
+{
+public:
+    static const uint32_t version = 1;
+
+    std::vector<InputFrame> frames;
+
+    // Write the log, returns false if the file can't be written
+    bool save(const char* path) const;
+
+    // Read a log written by save, returns false if it is missing or invalid
+    bool load(const char* path);
+};
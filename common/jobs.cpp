@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <chrono>
+
+#include <common/jobs.hpp>
+
+// System and index of the calling thread, set by the workers
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local unsigned int currentIndex = 0;
+
+JobDeque::JobDeque()
+{
+    for (unsigned int i = 0; i < capacity; i++)
+        jobs[i].store(nullptr, std::memory_order_relaxed);
+}
+
+bool JobDeque::push(Job* job)
+{
+    long long b = bottom.load(std::memory_order_relaxed);
+    long long t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<long long>(capacity))
+        return false;
+
+    jobs[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* JobDeque::pop()
+{
+    // Claim the bottom job, then check no thief took it first
+    long long b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long t = top.load(std::memory_order_relaxed);
+    if (t > b)
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // The last job, race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* JobDeque::steal()
+{
+    long long t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job* job = jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+JobSystem::JobSystem(unsigned int numThreads) : numThreads(numThreads), mainThread(std::this_thread::get_id())
+{
+    if (this->numThreads == 0)
+        this->numThreads = std::thread::hardware_concurrency();
+    if (this->numThreads == 0)
+        this->numThreads = 1;
+
+    threads.reset(new Thread[this->numThreads]);
+    for (unsigned int i = 0; i < this->numThreads; i++)
+        threads[i].nextVictim = (i + 1) % this->numThreads;
+    for (unsigned int i = 1; i < this->numThreads; i++)
+        workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    stopping = true;
+    wakeAll();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+bool JobSystem::isMainThread() const
+{
+    return std::this_thread::get_id() == mainThread;
+}
+
+unsigned int JobSystem::threadIndex() const
+{
+    if (currentSystem == this)
+        return currentIndex;
+    return isMainThread() ? 0 : numThreads;
+}
+
+void JobSystem::JobQueue::push(Job* job)
+{
+    job->next = nullptr;
+    if (back)
+        back->next = job;
+    else
+        front = job;
+    back = job;
+}
+
+Job* JobSystem::JobQueue::pop()
+{
+    Job* job = front;
+    if (job)
+    {
+        front = job->next;
+        if (!front)
+            back = nullptr;
+    }
+    return job;
+}
+
+Job* JobSystem::allocate()
+{
+    // Threads outside the system have no pool
+    unsigned int index = threadIndex();
+    if (index == numThreads)
+        return new Job;
+
+    // Take back the jobs other threads finished, or add a block when there are none
+    JobPool& pool = threads[index].pool;
+    if (!pool.free)
+        pool.free = pool.returned.exchange(nullptr, std::memory_order_acquire);
+    if (!pool.free)
+    {
+        const unsigned int blockSize = 64;
+        pool.blocks.emplace_back(new Job[blockSize]);
+        Job* block = pool.blocks.back().get();
+        for (unsigned int i = 0; i < blockSize; i++)
+        {
+            block[i].pool = &pool;
+            block[i].next = i + 1 < blockSize ? &block[i + 1] : nullptr;
+        }
+        pool.free = block;
+    }
+
+    Job* job = pool.free;
+    pool.free = job->next;
+    return job;
+}
+
+void JobSystem::release(Job* job)
+{
+    JobPool* pool = job->pool;
+    if (!pool)
+    {
+        delete job;
+        return;
+    }
+
+    // Straight back on our own free list, or pushed on the owner's returned list
+    unsigned int index = threadIndex();
+    if (index < numThreads && pool == &threads[index].pool)
+    {
+        job->next = pool->free;
+        pool->free = job;
+        return;
+    }
+    job->next = pool->returned.load(std::memory_order_relaxed);
+    while (!pool->returned.compare_exchange_weak(job->next, job, std::memory_order_release,
+        std::memory_order_relaxed))
+    {
+    }
+}
+
+void JobSystem::queueAfter(JobCounter& dependency, Job* job)
+{
+    // The lock orders this against finish() taking the waiting jobs
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (!dependency.done())
+        {
+            job->next = dependency.waiting;
+            dependency.waiting = job;
+            return;
+        }
+    }
+    queue(job);
+}
+
+void JobSystem::queueOnMainThread(Job* job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        mainJobs.push(job);
+    }
+    numMainJobs.fetch_add(1);
+    wakeAll();
+}
+
+void JobSystem::queue(Job* job)
+{
+    // The thread's own deque, or the shared queue from outside (or when it is full)
+    unsigned int index = threadIndex();
+    numQueued.fetch_add(1);
+    if (index == numThreads || !threads[index].deque.push(job))
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        sharedJobs.push(job);
+        numSharedJobs.fetch_add(1);
+    }
+
+    if (numSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+Job* JobSystem::find(unsigned int index)
+{
+    if (numQueued.load(std::memory_order_relaxed) == 0)
+        return nullptr;
+
+    // Newest job of our own first, then the shared queue, then steal the oldest of another thread's
+    Job* job = nullptr;
+    if (index < numThreads)
+        job = threads[index].deque.pop();
+    if (!job && numSharedJobs.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        job = sharedJobs.pop();
+        if (job)
+            numSharedJobs.fetch_sub(1);
+    }
+    if (!job)
+    {
+        unsigned int victim = index < numThreads ? threads[index].nextVictim : 0;
+        for (unsigned int i = 0; i < numThreads && !job; i++)
+        {
+            if (victim != index)
+                job = threads[victim].deque.steal();
+            victim = (victim + 1) % numThreads;
+        }
+        if (index < numThreads)
+            threads[index].nextVictim = victim;
+    }
+
+    if (job)
+        numQueued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::execute(Job* job, unsigned int index)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    job->call(job->storage);
+    if (index < numThreads)
+    {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+        threads[index].busyNanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+    }
+
+    JobCounter* counter = job->counter;
+    release(job);
+    if (counter)
+        finish(*counter);
+}
+
+void JobSystem::finish(JobCounter& counter)
+{
+    // Take the jobs waiting on the counter while holding its lock, so a thread in
+    // wait() can't return (and destroy the counter) until this is done with it
+    Job* ready;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (counter.count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        ready = counter.waiting;
+        counter.waiting = nullptr;
+    }
+
+    while (ready)
+    {
+        Job* job = ready;
+        ready = job->next;
+        queue(job);
+    }
+    wakeAll();
+}
+
+void JobSystem::wakeAll()
+{
+    if (numSleeping.load() > 0 || stopping)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_all();
+    }
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    unsigned int index = threadIndex();
+    bool main = isMainThread();
+    unsigned int idle = 0;
+    while (!counter.done())
+    {
+        // Main thread jobs first, they may be what the counter is waiting for
+        if (main && numMainJobs.load(std::memory_order_relaxed) > 0)
+        {
+            runMainThreadJobs();
+            idle = 0;
+            continue;
+        }
+
+        Job* job = find(index);
+        if (job)
+        {
+            execute(job, index);
+            idle = 0;
+            continue;
+        }
+
+        // Spin a little, then sleep until something changes
+        if (++idle < 64)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        numSleeping.fetch_add(1);
+        wake.wait_for(lock, std::chrono::milliseconds(1), [&]
+        {
+            return counter.done() || numQueued.load() > 0 || (main && numMainJobs.load() > 0);
+        });
+        numSleeping.fetch_sub(1);
+    }
+
+    // Let finish() let go of the counter
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::runMainThreadJobs()
+{
+    while (numMainJobs.load() > 0)
+    {
+        Job* job;
+        {
+            std::lock_guard<std::mutex> lock(mainMutex);
+            job = mainJobs.pop();
+        }
+        numMainJobs.fetch_sub(1);
+        execute(job, 0);
+    }
+}
+
+void JobSystem::parallelFor(unsigned int count, unsigned int grain, RangeFunction body)
+{
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = std::max(count / (numThreads * 4), 1u);
+
+    // Queue every range but the first, which the calling thread starts on
+    JobCounter counter;
+    for (unsigned int begin = grain; begin < count; begin += grain)
+    {
+        unsigned int end = count - begin < grain ? count : begin + grain;
+        run([&body, begin, end] { body(begin, end); }, &counter);
+    }
+    body(0, std::min(grain, count));
+    wait(counter);
+}
+
+void JobSystem::busyTimes(std::vector<double>& times) const
+{
+    times.resize(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++)
+        times[i] = threads[i].busyNanoseconds.load(std::memory_order_relaxed) / 1e9;
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+    currentSystem = this;
+    currentIndex = index;
+    while (!stopping)
+    {
+        Job* job = find(index);
+        if (job)
+        {
+            execute(job, index);
+            continue;
+        }
+
+        // Sleep until a job is queued
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        numSleeping.fetch_add(1);
+        wake.wait(lock, [this] { return stopping || numQueued.load() > 0; });
+        numSleeping.fetch_sub(1);
+    }
+}
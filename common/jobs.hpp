@@ -0,0 +1,245 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+class JobCounter;
+struct JobPool;
+
+// A queued job and the counter it takes one off when it finishes. The function
+// is stored in the job when its captures fit in inlineSize bytes, else on the
+// heap. Jobs come from the pool of the thread that queues them.
+struct Job
+{
+    static const unsigned int inlineSize = 48;
+
+    alignas(std::max_align_t) unsigned char storage[inlineSize];
+    void (*call)(void* storage) = nullptr;      // runs the stored function, then destroys it
+    JobCounter* counter = nullptr;
+    JobPool* pool = nullptr;                    // null for jobs from threads outside the system
+    Job* next = nullptr;                        // in a free list or a queue
+};
+
+// Free jobs of one thread. The thread takes jobs from free, and jobs that
+// finished on other threads come back through returned.
+struct JobPool
+{
+    Job* free = nullptr;
+    std::atomic<Job*> returned{nullptr};
+    std::vector<std::unique_ptr<Job[]>> blocks;
+};
+
+// Non-owning reference to a callable taking a range of indices, so parallelFor
+// doesn't copy the body (which must outlive the call, as it does)
+class RangeFunction
+{
+public:
+    template <class F>
+    RangeFunction(const F& function)
+        : object(&function), call([](const void* object, unsigned int begin, unsigned int end)
+            { (*static_cast<const F*>(object))(begin, end); }) {}
+
+    void operator()(unsigned int begin, unsigned int end) const { call(object, begin, end); }
+
+private:
+    const void* object;
+    void (*call)(const void* object, unsigned int begin, unsigned int end);
+};
+
+// Number of unfinished jobs in a group. Running a job with a counter adds one
+// and finishing it takes one off, so waiting on the counter waits for the whole
+// group, including jobs the group's jobs add to it. Jobs can also be held back
+// until a counter reaches zero (JobSystem::runAfter). Wait on a counter before
+// reusing or destroying it.
+class JobCounter
+{
+public:
+    JobCounter() {}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    // Whether every job has finished (for polling, wait() to block)
+    bool done() const { return count.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<unsigned int> count{0};
+    std::mutex mutex;               // held while the count reaches zero and the waiting jobs are taken
+    Job* waiting = nullptr;         // jobs queued by runAfter, linked by next
+};
+
+// Chase-Lev work-stealing deque of jobs. The owning thread pushes and pops at
+// the bottom, other threads steal from the top.
+class JobDeque
+{
+public:
+    static const unsigned int capacity = 4096;
+
+    JobDeque();
+
+    // Owner only, push returns false when the deque is full
+    bool push(Job* job);
+    Job* pop();
+
+    // Any thread, null when empty or another thread got there first
+    Job* steal();
+
+private:
+    std::atomic<long long> top{0};
+    std::atomic<long long> bottom{0};
+    std::atomic<Job*> jobs[capacity];
+};
+
+// Work-stealing job scheduler. Each worker thread has its own deque: it runs the
+// newest job it queued and, when that runs out, steals the oldest from the
+// others. The thread that creates the system is the main thread, thread 0. It
+// runs jobs while it waits, and alone runs the jobs queued with runOnMainThread
+// (for GL calls). Threads outside the system can queue jobs too, they go on a
+// shared queue. Waiting threads run jobs rather than block, so jobs can wait
+// on other jobs without tying up a thread.
+class JobSystem
+{
+public:
+    // numThreads counts the main thread, so numThreads - 1 workers are started
+    // (one thread per core when numThreads is 0)
+    JobSystem(unsigned int numThreads = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int size() const { return numThreads; }
+
+    // Queue a job (on the calling thread's deque if it is in the system)
+    template <class F>
+    void run(F&& function, JobCounter* counter = nullptr)
+    {
+        queue(makeJob(std::forward<F>(function), counter));
+    }
+
+    // Queue a job once the dependency reaches zero (straight away if it is zero)
+    template <class F>
+    void runAfter(JobCounter& dependency, F&& function, JobCounter* counter = nullptr)
+    {
+        queueAfter(dependency, makeJob(std::forward<F>(function), counter));
+    }
+
+    // Queue a job for the main thread, which runs it in wait() or runMainThreadJobs()
+    template <class F>
+    void runOnMainThread(F&& function, JobCounter* counter = nullptr)
+    {
+        queueOnMainThread(makeJob(std::forward<F>(function), counter));
+    }
+
+    // Run jobs until the counter reaches zero (any thread, including jobs)
+    void wait(JobCounter& counter);
+
+    // Run the main thread jobs queued so far (main thread only)
+    void runMainThreadJobs();
+
+    // Call body(begin, end) over [0, count) in ranges of grain indices and wait
+    // for them all. A grain of 0 splits the count four ways per thread.
+    void parallelFor(unsigned int count, unsigned int grain, RangeFunction body);
+
+    // Whether the calling thread is the one that created the system
+    bool isMainThread() const;
+
+    // Seconds each thread has spent running jobs (thread 0 is the main thread),
+    // into times so a caller can reuse it
+    void busyTimes(std::vector<double>& times) const;
+
+private:
+    struct Thread
+    {
+        JobDeque deque;
+        JobPool pool;
+        std::atomic<unsigned long long> busyNanoseconds{0};
+        unsigned int nextVictim = 0;
+    };
+
+    // First and last jobs of a queue linked by next
+    struct JobQueue
+    {
+        Job* front = nullptr;
+        Job* back = nullptr;
+
+        void push(Job* job);
+        Job* pop();
+    };
+
+    unsigned int numThreads;
+    std::unique_ptr<Thread[]> threads;
+    std::vector<std::thread> workers;
+    std::thread::id mainThread;
+
+    // Jobs from threads outside the system and jobs that didn't fit in a deque
+    std::mutex sharedMutex;
+    JobQueue sharedJobs;
+    std::atomic<unsigned int> numSharedJobs{0};
+
+    // Jobs only the main thread runs
+    std::mutex mainMutex;
+    JobQueue mainJobs;
+    std::atomic<unsigned int> numMainJobs{0};
+
+    // Idle threads sleep until a job is queued or a counter reaches zero
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<unsigned int> numQueued{0};     // jobs in the deques and the shared queue
+    std::atomic<unsigned int> numSleeping{0};
+    std::atomic<bool> stopping{false};
+
+    // Index of the calling thread in this system, or numThreads if it isn't in it
+    unsigned int threadIndex() const;
+
+    // Take a job from the calling thread's pool and give it back once it has run
+    Job* allocate();
+    void release(Job* job);
+
+    template <class F>
+    Job* makeJob(F&& function, JobCounter* counter)
+    {
+        typedef typename std::decay<F>::type Function;
+        Job* job = allocate();
+        if constexpr (sizeof(Function) <= Job::inlineSize && alignof(Function) <= alignof(std::max_align_t))
+        {
+            new (job->storage) Function(std::forward<F>(function));
+            job->call = [](void* storage)
+            {
+                Function& stored = *static_cast<Function*>(storage);
+                stored();
+                stored.~Function();
+            };
+        }
+        else
+        {
+            *reinterpret_cast<Function**>(job->storage) = new Function(std::forward<F>(function));
+            job->call = [](void* storage)
+            {
+                Function* stored = *static_cast<Function**>(storage);
+                (*stored)();
+                delete stored;
+            };
+        }
+        job->counter = counter;
+        if (counter)
+            counter->count.fetch_add(1, std::memory_order_relaxed);
+        return job;
+    }
+
+    void queue(Job* job);
+    void queueAfter(JobCounter& dependency, Job* job);
+    void queueOnMainThread(Job* job);
+    Job* find(unsigned int index);
+    void execute(Job* job, unsigned int index);
+    void finish(JobCounter& counter);
+    void wakeAll();
+    void workerLoop(unsigned int index);
+};
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cmath>
+
 #include <common/light.hpp>
+#include <common/clusters.hpp>
+#include <common/profiler.hpp>
 
 void Light::addPointLight(const glm::vec3 position, const glm::vec3 colour,
     const float constant, const float linear,
@@ -40,57 +45,108 @@ void Light::addDirectionalLight(const glm::vec3 direction, const glm::vec3 colou
     lightSources.push_back(light);
 }
 
-void Light::toShader(unsigned int shaderID, glm::mat4 view)
+// Distance at which a light's brightest channel is attenuated below cutoff
+static float lightRange(const LightSource& source, float cutoff)
+{
+    float brightest = std::max(source.colour.r, std::max(source.colour.g, source.colour.b));
+    cutoff = brightest / cutoff;                // attenuation denominator at the range
+    if (cutoff <= source.constant)
+        return 0.0f;
+    if (source.quadratic > 0.0f)
+        return (-source.linear + sqrtf(source.linear * source.linear -
+            4.0f * source.quadratic * (source.constant - cutoff))) / (2.0f * source.quadratic);
+    if (source.linear > 0.0f)
+        return (cutoff - source.constant) / source.linear;
+    return 1e6f;    // never fades
+}
+
+// Light in view space in the layout the shaders read
+static LightBlock viewSpaceLight(const LightSource& source, const glm::mat4& view, float cutoff)
+{
+    LightBlock light = {};
+    light.position = glm::vec3(view * glm::vec4(source.position, 1.0f));
+    light.direction = glm::vec3(view * glm::vec4(source.direction, 0.0f));
+    light.colour = source.colour;
+    light.constant = source.constant;
+    light.linear = source.linear;
+    light.quadratic = source.quadratic;
+    light.cosPhi = source.cosPhi;
+    light.type = source.type;
+    light.range = source.type == 3 ? 0.0f : lightRange(source, cutoff);
+    return light;
+}
+
+void Light::toShader(const glm::mat4& view)
 {
-    unsigned int numLights = static_cast<unsigned int>(lightSources.size());
-    glUniform1i(glGetUniformLocation(shaderID, "numLights"), numLights);
+    ProfileScope scope("Light::toShader");
+    if (buffer.id == 0)
+        buffer.create(sizeof(LightsBlock), ShaderProgram::lightsBinding);
 
+    // Disabled lights are sent with type 0 so the shaders skip them
+    LightsBlock block = {};
+    unsigned int numLights = std::min(static_cast<unsigned int>(lightSources.size()), maxLights);
+    block.numLights = numLights;
     for (unsigned int i = 0; i < numLights; i++)
     {
-        // Ignore disabled lighting
-        if (!lightSources[i].enabled)
-            continue;
+        if (lightSources[i].enabled)
+            block.lights[i] = viewSpaceLight(lightSources[i], view, cutoff);
+    }
+    buffer.update(&block, sizeof(block));
+}
 
-        std::string idx = std::to_string(i);
-        glm::vec3 VSLightPosition = glm::vec3(view * glm::vec4(lightSources[i].position, 1.0f));
-        glm::vec3 VSLightDirection = glm::vec3(view * glm::vec4(lightSources[i].direction, 0.0f));
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].position").c_str()), 1, &VSLightPosition[0]);
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].direction").c_str()), 1, &VSLightDirection[0]);
-        glUniform3fv(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].colour").c_str()), 1, &lightSources[i].colour[0]);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].constant").c_str()), lightSources[i].constant);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].linear").c_str()), lightSources[i].linear);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].quadratic").c_str()), lightSources[i].quadratic);
-        glUniform1f(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].cosPhi").c_str()), lightSources[i].cosPhi);
-        glUniform1i(glGetUniformLocation(shaderID, ("lightSources[" + idx + "].type").c_str()), lightSources[i].type);
+void Light::toClusters(const glm::mat4& view, LightClusters& clusters)
+{
+    ProfileScope scope("Light::toClusters");
+    // Directional lights go first as every cluster uses them
+    clusters.lights.clear();
+    for (const LightSource& source : lightSources)
+    {
+        if (source.enabled && source.type == 3)
+            clusters.lights.push_back(viewSpaceLight(source, view, cutoff));
+    }
+    clusters.numGlobalLights = static_cast<unsigned int>(clusters.lights.size());
+
+    for (const LightSource& source : lightSources)
+    {
+        if (source.enabled && source.type != 3)
+            clusters.lights.push_back(viewSpaceLight(source, view, cutoff));
     }
 }
 
-void Light::draw(unsigned int shaderID, glm::mat4 view, glm::mat4 projection, Model lightModel)
+void Light::draw(const ShaderProgram& program, const Model& lightModel)
 {
-    glUseProgram(shaderID);
+    gizmos.clear();
     for (unsigned int i = 0; i < static_cast<unsigned int>(lightSources.size()); i++)
     {
         // Cases not to draw a light source
         if (lightSources[i].type == 3 || !lightSources[i].enabled || !lightSources[i].drawSource)
             continue;
 
-        // Calculate model matrix
+        // Calculate model matrix (the shader multiplies by the view matrix from
+        // the Camera uniform block)
         glm::mat4 translate = glm::translate(glm::mat4(1.0f), lightSources[i].position);
         glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(0.1f));
-        glm::mat4 model = translate * scale;
 
-        // Send the MVP and MV matrices to the vertex shader
-        glm::mat4 MV = view * model;
-        glm::mat4 MVP = projection * view * model;
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "MV"), 1, GL_FALSE, &MV[0][0]);
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, &MVP[0][0]);
+        Instance instance;
+        instance.setModel(translate * scale);
+        instance.colour = glm::vec4(lightSources[i].colour, 1.0f);
+        gizmos.push_back(instance);
+    }
 
-        // Send model, view, projection matrices and light colour to light shader
-        glUniform3fv(glGetUniformLocation(shaderID, "lightColour"), 1, &lightSources[i].colour[0]);
+    if (gizmos.empty())
+        return;
 
-        // Draw light source
-        lightModel.draw(shaderID);
-    }
+    // Draw all the light sources at once
+    unsigned int count = static_cast<unsigned int>(gizmos.size());
+    gizmoBuffer.update(gizmos.data(), count);
+    glUseProgram(program.id);
+    glUniform1i(program.uniforms.instanced, GL_TRUE);
+    lightModel.drawInstanced(program, gizmoBuffer, count);
+    glUniform1i(program.uniforms.instanced, GL_FALSE);
 }
 
-
+void Light::deleteBuffers()
+{
+    buffer.destroy();
+    gizmoBuffer.destroy();
+}
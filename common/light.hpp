@@ -2,6 +2,12 @@
 
 #include <external/glm-0.9.7.1/glm/gtc/matrix_transform.hpp>
 #include <common/model.hpp>
+#include <common/program.hpp>
+
+// Maximum number of lights (maxLights in the shaders without clustering)
+const unsigned int maxLights = 10;
+
+class LightClusters;
 
 struct LightSource
 {
@@ -18,11 +24,39 @@ struct LightSource
     bool drawSource = true;
 };
 
+// std140 layout of one light in the Lights uniform block
+struct LightBlock
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 colour;
+    float linear;
+    glm::vec3 direction;
+    float quadratic;
+    float cosPhi;
+    int type;
+    float range;        // clustered lighting only
+    float padding;
+};
+static_assert(sizeof(LightBlock) == 64, "LightBlock must match the std140 Light struct");
+
+// std140 layout of the Lights uniform block
+struct LightsBlock
+{
+    LightBlock lights[maxLights];
+    int numLights;
+};
+
 class Light
 {
 public:
     std::vector<LightSource> lightSources;
-    unsigned int lightShaderID;
+    UniformBuffer buffer;
+    InstanceBuffer gizmoBuffer;
+
+    // Clustered lighting ignores a light where its attenuated brightness falls
+    // below this (by default one step of an 8 bit colour)
+    float cutoff = 1.0f / 256.0f;
 
     // Add lightSources
     void addPointLight(const glm::vec3 position, const glm::vec3 colour,
@@ -34,10 +68,21 @@ public:
         const float cosPhi);
     void addDirectionalLight(const glm::vec3 direction, const glm::vec3 colour);
 
-    // Send to shader
-    void toShader(unsigned int shaderID, glm::mat4 view);
+    // Update the Lights uniform block (positions and directions in view space)
+    void toShader(const glm::mat4& view);
+
+    // Copy the enabled lights to the clusters in view space, with the range
+    // each one reaches (assign() then lists them)
+    void toClusters(const glm::mat4& view, LightClusters& clusters);
+
+    // Draw a lightModel at every light source in one instanced draw (the model
+    // is only borrowed for the call)
+    void draw(const ShaderProgram& program, const Model& lightModel);
+
+    // Delete the uniform and instance buffers
+    void deleteBuffers();
 
-    // Draw light source
-    void draw(unsigned int shaderID, glm::mat4 view, glm::mat4 projection, Model lightModel);
+private:
+    std::vector<Instance> gizmos;   // reused every frame to avoid reallocating
 };
 
@@ -1,4 +1,9 @@
 #include <common/maths.hpp>
+#include <common/simd.hpp>
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // Quaternions
 Quaternion::Quaternion() {}
@@ -162,4 +167,86 @@ float Maths::square(float value)
 float Maths::lerp(float a, float b, float t)
 {
     return (a + t * (b - a));
-}
\ No newline at end of file
+}
+
+// Batched transforms
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "vec3 arrays are read as packed floats");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "mat4 arrays are written as packed floats");
+
+#include <common/transformkernel.hpp>
+
+// AVX2 kernel (mathsavx2.cpp, built with AVX2 enabled)
+extern const bool avx2KernelsBuilt;
+void composeTransformsAVX2(unsigned int count, const float* positions, const float* axes, const float* angles,
+    const float* scales, const float* view, const float* projection, float* outModelView, float* outMVP);
+
+Maths::SimdLevel Maths::maxSimdLevel()
+{
+#ifdef SIMD_X86
+    bool avx2 = false;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    avx2 = osSavesAvx && fma && (info[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return avx2 && avx2KernelsBuilt ? SIMD_AVX2 : SIMD_SSE;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+Maths::SimdLevel Maths::simdLevel = Maths::maxSimdLevel();
+
+const char* Maths::simdName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE: return "SSE";
+    default: return "scalar";
+    }
+}
+
+// Run the widest kernel allowed, then finish the remainder one object at a time
+static void composeTransformsBatch(unsigned int count, const float* positions, const float* axes,
+    const float* angles, const float* scales, const float* view, const float* projection,
+    float* outModelView, float* outMVP)
+{
+    unsigned int done = 0;
+#ifdef SIMD_X86
+    if (Maths::simdLevel >= Maths::SIMD_AVX2)
+    {
+        done = count - count % 8;
+        composeTransformsAVX2(done, positions, axes, angles, scales, view, projection, outModelView, outMVP);
+    }
+    else if (Maths::simdLevel >= Maths::SIMD_SSE)
+    {
+        done = count - count % 4;
+        composeTransforms<Sse>(done, positions, axes, angles, scales, view, projection, outModelView, outMVP);
+    }
+#endif
+    composeTransforms<Scalar>(count - done, positions + 3 * done, axes + 3 * done, angles + done,
+        scales + 3 * done, view, projection, outModelView ? outModelView + 16 * done : nullptr,
+        outMVP ? outMVP + 16 * done : nullptr);
+}
+
+void Maths::modelMatrices(unsigned int count, const glm::vec3* positions, const glm::vec3* axes,
+    const float* angles, const glm::vec3* scales, glm::mat4* outModel)
+{
+    composeTransformsBatch(count, &positions[0].x, &axes[0].x, angles, &scales[0].x, nullptr, nullptr,
+        &outModel[0][0][0], nullptr);
+}
+
+void Maths::modelViewMatrices(unsigned int count, const glm::vec3* positions, const glm::vec3* axes,
+    const float* angles, const glm::vec3* scales, const glm::mat4& view, const glm::mat4& projection,
+    glm::mat4* outMV, glm::mat4* outMVP)
+{
+    composeTransformsBatch(count, &positions[0].x, &axes[0].x, angles, &scales[0].x, &view[0][0],
+        &projection[0][0], outMV ? &outMV[0][0][0] : nullptr, outMVP ? &outMVP[0][0][0] : nullptr);
+}
@@ -46,4 +46,20 @@ public:
     static float lerp(float a, float b, float t);
 
     static Quaternion SLERP(const Quaternion q1, const Quaternion q2, const float t);
+
+    // Batched transforms. Element i of each array belongs to object i, whose matrix
+    // is translate(position) * rotate(angle, axis) * scale(scale). The product is
+    // composed directly (no full matrix multiplies) for 4 or 8 objects at a time.
+    enum SimdLevel { SIMD_SCALAR, SIMD_SSE, SIMD_AVX2 };
+    static SimdLevel simdLevel;     // instruction set used, the best available unless lowered
+    static SimdLevel maxSimdLevel();
+    static const char* simdName(SimdLevel level);
+
+    static void modelMatrices(unsigned int count, const glm::vec3* positions, const glm::vec3* axes,
+        const float* angles, const glm::vec3* scales, glm::mat4* outModel);
+
+    // View * model and projection * view * model (either output may be null)
+    static void modelViewMatrices(unsigned int count, const glm::vec3* positions, const glm::vec3* axes,
+        const float* angles, const glm::vec3* scales, const glm::mat4& view, const glm::mat4& projection,
+        glm::mat4* outMV, glm::mat4* outMVP);
 };
@@ -0,0 +1,135 @@
+// AVX2 builds of the batched kernels (see transformkernel.hpp and cullkernel.hpp).
+// This file is compiled with AVX2 and FMA enabled and only called when the CPU
+// has them, so it must not include headers with inline functions used elsewhere
+// (e.g. glm).
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace
+{
+
+// Eight objects per register
+struct Avx2
+{
+    static const unsigned int width = 8;
+    __m256 v;
+
+    Avx2() {}
+    Avx2(__m256 value) : v(value) {}
+    Avx2(float value) : v(_mm256_set1_ps(value)) {}
+
+    friend Avx2 operator+(Avx2 a, Avx2 b) { return _mm256_add_ps(a.v, b.v); }
+    friend Avx2 operator-(Avx2 a, Avx2 b) { return _mm256_sub_ps(a.v, b.v); }
+    friend Avx2 operator*(Avx2 a, Avx2 b) { return _mm256_mul_ps(a.v, b.v); }
+    friend Avx2 operator/(Avx2 a, Avx2 b) { return _mm256_div_ps(a.v, b.v); }
+
+    static Avx2 load(const float* p) { return _mm256_loadu_ps(p); }
+    static Avx2 load3(const float* p)
+    {
+        return _mm256_setr_ps(p[0], p[3], p[6], p[9], p[12], p[15], p[18], p[21]);
+    }
+    static Avx2 sqrt(Avx2 a) { return _mm256_sqrt_ps(a.v); }
+    static Avx2 min(Avx2 a, Avx2 b) { return _mm256_min_ps(a.v, b.v); }
+    static int signMask(Avx2 a) { return _mm256_movemask_ps(a.v); }
+
+    // Eight consecutive vec4s, one per lane
+    static void load4Transposed(const float* p, Avx2& x, Avx2& y, Avx2& z, Avx2& w)
+    {
+        // Objects 0-3 go in the low halves and 4-7 in the high halves
+        __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 16), 1);
+        __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 20), 1);
+        __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 24), 1);
+        __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 12)), _mm_loadu_ps(p + 28), 1);
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        w = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    // Sine and cosine (Cephes polynomials after reducing to [-pi/4, pi/4])
+    static void sincos(Avx2 x, Avx2& outSin, Avx2& outCos)
+    {
+        __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x.v, _mm256_set1_ps(0.636619772f)));
+        __m256 j = _mm256_cvtepi32_ps(quadrant);
+        __m256 y = _mm256_fnmadd_ps(j, _mm256_set1_ps(1.5703125f), x.v);
+        y = _mm256_fnmadd_ps(j, _mm256_set1_ps(4.837512969970703125e-4f), y);
+        y = _mm256_fnmadd_ps(j, _mm256_set1_ps(7.54978995489188216e-8f), y);
+        __m256 z = _mm256_mul_ps(y, y);
+
+        __m256 sinPoly = _mm256_fmadd_ps(z, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+        sinPoly = _mm256_fmadd_ps(z, sinPoly, _mm256_set1_ps(-1.6666654611e-1f));
+        sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(z, y), sinPoly, y);
+
+        __m256 cosPoly = _mm256_fmadd_ps(z, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+        cosPoly = _mm256_fmadd_ps(z, cosPoly, _mm256_set1_ps(4.166664568298827e-2f));
+        cosPoly = _mm256_fmadd_ps(_mm256_mul_ps(z, z), cosPoly, _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), _mm256_set1_ps(1.0f)));
+
+        // Odd quadrants swap sine and cosine, then the signs follow the quadrant
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+        __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+            _mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+        outSin = _mm256_xor_ps(_mm256_blendv_ps(sinPoly, cosPoly, swap), sinSign);
+        outCos = _mm256_xor_ps(_mm256_blendv_ps(cosPoly, sinPoly, swap), cosSign);
+    }
+
+    // Store one column of eight matrices (16 floats apart) from its four rows
+    static void storeColumn(float* out, Avx2 r0, Avx2 r1, Avx2 r2, Avx2 r3)
+    {
+        __m256 t0 = _mm256_unpacklo_ps(r0.v, r1.v);
+        __m256 t1 = _mm256_unpackhi_ps(r0.v, r1.v);
+        __m256 t2 = _mm256_unpacklo_ps(r2.v, r3.v);
+        __m256 t3 = _mm256_unpackhi_ps(r2.v, r3.v);
+        __m256 c0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 c1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 c2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 c3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+        // Objects 0-3 are in the low halves and 4-7 in the high halves
+        _mm_storeu_ps(out, _mm256_castps256_ps128(c0));
+        _mm_storeu_ps(out + 16, _mm256_castps256_ps128(c1));
+        _mm_storeu_ps(out + 32, _mm256_castps256_ps128(c2));
+        _mm_storeu_ps(out + 48, _mm256_castps256_ps128(c3));
+        _mm_storeu_ps(out + 64, _mm256_extractf128_ps(c0, 1));
+        _mm_storeu_ps(out + 80, _mm256_extractf128_ps(c1, 1));
+        _mm_storeu_ps(out + 96, _mm256_extractf128_ps(c2, 1));
+        _mm_storeu_ps(out + 112, _mm256_extractf128_ps(c3, 1));
+    }
+};
+
+}
+
+#include <common/transformkernel.hpp>
+#include <common/cullkernel.hpp>
+
+extern const bool avx2KernelsBuilt = true;
+
+void composeTransformsAVX2(unsigned int count, const float* positions, const float* axes, const float* angles,
+    const float* scales, const float* view, const float* projection, float* outModelView, float* outMVP)
+{
+    composeTransforms<Avx2>(count, positions, axes, angles, scales, view, projection, outModelView, outMVP);
+}
+
+unsigned int cullSpheresAVX2(unsigned int count, const float* spheres, const float* planes, unsigned int* outVisible)
+{
+    return findVisibleSpheres<Avx2>(count, spheres, planes, outVisible);
+}
+#else
+// Built without AVX2 (not an x86 target), these kernels are never selected
+extern const bool avx2KernelsBuilt = false;
+
+void composeTransformsAVX2(unsigned int, const float*, const float*, const float*, const float*,
+    const float*, const float*, float*, float*)
+{
+}
+
+unsigned int cullSpheresAVX2(unsigned int, const float*, const float*, unsigned int*)
+{
+    return 0;
+}
+#endif
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <new>
+
+#include <common/memstats.hpp>
+
+std::atomic<unsigned int> MemStats::allocations{0};
+std::atomic<size_t> MemStats::bytes{0};
+unsigned int MemStats::frameAllocations = 0;
+size_t MemStats::frameBytes = 0;
+
+void MemStats::endFrame()
+{
+    frameAllocations = allocations.exchange(0, std::memory_order_relaxed);
+    frameBytes = bytes.exchange(0, std::memory_order_relaxed);
+}
+
+// Count an allocation and get the memory from malloc
+static void* countedAlloc(size_t size)
+{
+    MemStats::allocations.fetch_add(1, std::memory_order_relaxed);
+    MemStats::bytes.fetch_add(size, std::memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+// Replacement global allocation functions
+void* operator new(size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+// Heap allocation counters. Linking memstats.cpp replaces the global operator
+// new and delete with versions that count every allocation, from any thread.
+class MemStats
+{
+public:
+    static std::atomic<unsigned int> allocations;
+    static std::atomic<size_t> bytes;
+
+    // Counts of the last completed frame
+    static unsigned int frameAllocations;
+    static size_t frameBytes;
+
+    // Store the counts for the frame just finished and reset them
+    static void endFrame();
+};
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <common/meshcache.hpp>
+
+// Memory mapped files
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        mapping = nullptr;
+        close();
+        return false;
+    }
+
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    data = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    size = 0;
+}
+#else
+bool MappedFile::open(const char* path)
+{
+    close();
+
+    file = ::open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+
+    void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (address == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    data = static_cast<const unsigned char*>(address);
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data)
+        munmap(const_cast<unsigned char*>(data), size);
+    if (file >= 0)
+        ::close(file);
+    data = nullptr;
+    file = -1;
+    size = 0;
+}
+#endif
+
+// Mesh cache
+uint64_t MeshCache::hash(const void* data, size_t size)
+{
+    // FNV-1a over 64-bit words with a final avalanche step
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * 0x100000001b3ull;
+        h ^= h >> 32;
+    }
+    for (; i < size; i++)
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+bool MeshCache::hashFile(const char* path, uint64_t& outHash, uint64_t& outSize)
+{
+    MappedFile source;
+    if (!source.open(path))
+        return false;
+
+    outHash = hash(source.data, source.size);
+    outSize = source.size;
+    return true;
+}
+
+uint64_t MeshCache::hashGeometry(const MeshData& mesh)
+{
+    uint64_t vertexHash = hash(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    uint64_t indexHash = hash(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+    return vertexHash ^ (indexHash * 0x9e3779b97f4a7c15ull);
+}
+
+std::string MeshCache::cachePath(const char* objPath)
+{
+    return std::string(objPath) + ".mesh";
+}
+
+bool MeshCache::write(const char* path, uint64_t sourceHash, uint64_t sourceSize,
+    const MeshData& mesh, const BVH* bvh)
+{
+    std::vector<unsigned char> indices;
+    mesh.packIndices(indices);
+
+    BVH built;
+    if (!bvh)
+    {
+        built.build(mesh.vertices.data(), indices.data(), static_cast<unsigned int>(mesh.indices.size()),
+            mesh.indexSize());
+        bvh = &built;
+    }
+
+    MeshCacheHeader header;
+    memcpy(header.magic, "MESH", 4);
+    header.version = version;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.vertexStride = sizeof(Vertex);
+    header.numVertices = static_cast<uint32_t>(mesh.vertices.size());
+    header.vertexOffset = sizeof(MeshCacheHeader);
+    header.indexSize = mesh.indexSize();
+    header.numIndices = static_cast<uint32_t>(mesh.indices.size());
+    header.indexOffset = header.vertexOffset + mesh.vertices.size() * sizeof(Vertex);
+    header.geometryHash = hashGeometry(mesh);
+    header.numNodes = static_cast<uint32_t>(bvh->nodes.size());
+    header.padding = 0;
+    header.nodeOffset = (header.indexOffset + indices.size() + 15) & ~uint64_t(15);
+    header.triangleOrderOffset = header.nodeOffset + bvh->nodes.size() * sizeof(BVHNode);
+
+    // Write to a temporary file first so a half written cache is never mapped
+    std::string tempPath = std::string(path) + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !mesh.vertices.empty())
+        ok = fwrite(mesh.vertices.data(), sizeof(Vertex), mesh.vertices.size(), file) == mesh.vertices.size();
+    if (ok && !indices.empty())
+        ok = fwrite(indices.data(), 1, indices.size(), file) == indices.size();
+
+    // Pad so the nodes are aligned
+    static const unsigned char zeros[16] = {};
+    size_t padding = header.nodeOffset - header.indexOffset - indices.size();
+    if (ok && padding > 0)
+        ok = fwrite(zeros, 1, padding, file) == padding;
+    if (ok && !bvh->nodes.empty())
+        ok = fwrite(bvh->nodes.data(), sizeof(BVHNode), bvh->nodes.size(), file) == bvh->nodes.size();
+    if (ok && !bvh->triangleOrder.empty())
+        ok = fwrite(bvh->triangleOrder.data(), sizeof(uint32_t), bvh->triangleOrder.size(), file) == bvh->triangleOrder.size();
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok)
+    {
+        remove(path);
+        ok = rename(tempPath.c_str(), path) == 0;
+    }
+    if (!ok)
+        remove(tempPath.c_str());
+
+    return ok;
+}
+
+bool MeshCache::open(const char* path, uint64_t sourceHash, uint64_t sourceSize)
+{
+    close();
+    if (!file.open(path))
+        return false;
+
+    // Validate the header against the source file and this build's vertex layout
+    if (file.size < sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, "MESH", 4) != 0 || header.version != version ||
+        header.sourceHash != sourceHash || header.sourceSize != sourceSize ||
+        header.vertexStride != sizeof(Vertex) ||
+        (header.indexSize != 2 && header.indexSize != 4) ||
+        header.vertexOffset + uint64_t(header.numVertices) * sizeof(Vertex) > file.size ||
+        header.indexOffset + uint64_t(header.numIndices) * header.indexSize > file.size ||
+        header.nodeOffset % 16 != 0 ||
+        header.nodeOffset + uint64_t(header.numNodes) * sizeof(BVHNode) > file.size ||
+        header.triangleOrderOffset + uint64_t(header.numIndices / 3) * sizeof(uint32_t) > file.size)
+    {
+        close();
+        return false;
+    }
+
+    vertices = reinterpret_cast<const Vertex*>(file.data + header.vertexOffset);
+    numVertices = header.numVertices;
+    indices = file.data + header.indexOffset;
+    numIndices = header.numIndices;
+    indexSize = header.indexSize;
+    geometryHash = header.geometryHash;
+    nodes = reinterpret_cast<const BVHNode*>(file.data + header.nodeOffset);
+    numNodes = header.numNodes;
+    triangleOrder = reinterpret_cast<const uint32_t*>(file.data + header.triangleOrderOffset);
+    return true;
+}
+
+void MeshCache::close()
+{
+    file.close();
+    vertices = nullptr;
+    numVertices = 0;
+    indices = nullptr;
+    numIndices = 0;
+    indexSize = 0;
+    geometryHash = 0;
+    nodes = nullptr;
+    numNodes = 0;
+    triangleOrder = nullptr;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <common/model.hpp>
+#include <common/bvh.hpp>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+private:
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
+
+// Header at the start of every .mesh file
+struct MeshCacheHeader
+{
+    char magic[4];              // "MESH"
+    uint32_t version;           // MeshCache::version
+    uint64_t sourceHash;        // hash of the .obj file contents
+    uint64_t sourceSize;        // size of the .obj file in bytes
+    uint32_t vertexStride;      // sizeof(Vertex)
+    uint32_t numVertices;
+    uint64_t vertexOffset;      // byte offset of the interleaved vertex data
+    uint32_t indexSize;         // 2 or 4 bytes per index
+    uint32_t numIndices;
+    uint64_t indexOffset;       // byte offset of the index data
+    uint64_t geometryHash;      // hash of the vertex and index data
+    uint32_t numNodes;          // BVH nodes
+    uint32_t padding;
+    uint64_t nodeOffset;        // byte offset of the BVH nodes
+    uint64_t triangleOrderOffset;   // byte offset of the BVH leaf triangle order
+};
+
+// Binary mesh cache. The first time an .obj is parsed the indexed, interleaved
+// vertex data and its BVH are written to <path>.mesh, later runs map that file
+// and skip the parser and the BVH build.
+class MeshCache
+{
+public:
+    static const uint32_t version = 6;
+
+    // Vertex and index data of an open cache file (points into the mapping)
+    const Vertex* vertices = nullptr;
+    unsigned int numVertices = 0;
+    const void* indices = nullptr;
+    unsigned int numIndices = 0;
+    unsigned int indexSize = 0;
+    uint64_t geometryHash = 0;
+    const BVHNode* nodes = nullptr;
+    unsigned int numNodes = 0;
+    const uint32_t* triangleOrder = nullptr;
+
+    // Hash of a block of memory (used to detect edited .obj files)
+    static uint64_t hash(const void* data, size_t size);
+
+    // Hash and size of a source file, returns false if it can't be read
+    static bool hashFile(const char* path, uint64_t& outHash, uint64_t& outSize);
+
+    // Hash of the vertex and index data (identical meshes from different files
+    // have the same geometry hash)
+    static uint64_t hashGeometry(const MeshData& mesh);
+
+    // Name of the cache file for an .obj file
+    static std::string cachePath(const char* objPath);
+
+    // Write a cache file (the BVH is built if none is given)
+    static bool write(const char* path, uint64_t sourceHash, uint64_t sourceSize,
+        const MeshData& mesh, const BVH* bvh = nullptr);
+
+    // Map a cache file, fails if it is missing, corrupt or out of date
+    bool open(const char* path, uint64_t sourceHash, uint64_t sourceSize);
+    void close();
+
+private:
+    MappedFile file;
+};
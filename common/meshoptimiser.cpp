@@ -0,0 +1,194 @@
+#include <cmath>
+#include <algorithm>
+
+#include <common/meshoptimiser.hpp>
+
+// Forsyth's scoring parameters
+static const unsigned int cacheSize = 32;
+static const float cacheDecayPower = 1.5f;
+static const float lastTriangleScore = 0.75f;
+static const float valenceBoostScale = 2.0f;
+static const float valenceBoostPower = 0.5f;
+
+// Score of a vertex from its position in the simulated LRU cache and the number
+// of triangles still using it (vertices with few triangles left are preferred)
+static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = lastTriangleScore;
+        else
+        {
+            float scale = 1.0f / static_cast<float>(cacheSize - 3);
+            score = powf(1.0f - (cachePosition - 3) * scale, cacheDecayPower);
+        }
+    }
+
+    score += valenceBoostScale * powf(static_cast<float>(remainingTriangles), -valenceBoostPower);
+    return score;
+}
+
+void MeshOptimiser::optimiseVertexCache(std::vector<unsigned int>& indices, unsigned int numVertices)
+{
+    unsigned int numTriangles = static_cast<unsigned int>(indices.size() / 3);
+    if (numTriangles == 0)
+        return;
+
+    // Build the vertex to triangle adjacency lists
+    std::vector<unsigned int> remaining(numVertices, 0);
+    for (unsigned int i = 0; i < indices.size(); i++)
+        remaining[indices[i]]++;
+
+    std::vector<unsigned int> offsets(numVertices + 1, 0);
+    for (unsigned int v = 0; v < numVertices; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int t = 0; t < numTriangles; t++)
+        for (unsigned int k = 0; k < 3; k++)
+            adjacency[fill[indices[3 * t + k]]++] = t;
+
+    // Initial vertex and triangle scores
+    std::vector<int> cachePosition(numVertices, -1);
+    std::vector<float> vertexScores(numVertices);
+    for (unsigned int v = 0; v < numVertices; v++)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScores(numTriangles);
+    std::vector<bool> emitted(numTriangles, false);
+    for (unsigned int t = 0; t < numTriangles; t++)
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    // LRU cache with room for the three vertices being added
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(cacheSize + 3);
+    newCache.reserve(cacheSize + 3);
+
+    unsigned int bestTriangle = ~0u;
+    unsigned int scanPosition = 0;
+    for (unsigned int n = 0; n < numTriangles; n++)
+    {
+        // No candidate from the cache, restart from the first triangle not yet
+        // emitted (a full search for the best score here is quadratic on meshes
+        // made of many small pieces)
+        if (bestTriangle == ~0u)
+        {
+            while (emitted[scanPosition])
+                scanPosition++;
+            bestTriangle = scanPosition;
+        }
+
+        // Emit the triangle
+        const unsigned int* triangle = &indices[3 * bestTriangle];
+        output.insert(output.end(), triangle, triangle + 3);
+        emitted[bestTriangle] = true;
+
+        // Remove it from the adjacency lists of its vertices
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            unsigned int* begin = &adjacency[offsets[v]];
+            unsigned int* end = begin + remaining[v];
+            *std::find(begin, end, bestTriangle) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // Move its vertices to the front of the cache
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int i = 0; i < cache.size(); i++)
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                newCache.push_back(cache[i]);
+        std::swap(cache, newCache);
+
+        // Update the scores of the vertices in (and just evicted from) the cache
+        for (unsigned int i = 0; i < cache.size(); i++)
+        {
+            unsigned int v = cache[i];
+            cachePosition[v] = i < cacheSize ? static_cast<int>(i) : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        // Rescore the triangles using those vertices and pick the best one
+        float bestScore = -1.0f;
+        bestTriangle = ~0u;
+        for (unsigned int i = 0; i < cache.size(); i++)
+        {
+            unsigned int v = cache[i];
+            for (unsigned int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+            {
+                unsigned int t = adjacency[j];
+                float score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+        if (cache.size() > cacheSize)
+            cache.resize(cacheSize);
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimiser::optimiseVertexFetch(MeshData& mesh)
+{
+    // New index of each vertex in order of first use
+    std::vector<unsigned int> remap(mesh.vertices.size(), ~0u);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (unsigned int i = 0; i < mesh.indices.size(); i++)
+    {
+        unsigned int& index = mesh.indices[i];
+        if (remap[index] == ~0u)
+        {
+            remap[index] = static_cast<unsigned int>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    // Unreferenced vertices are dropped
+    mesh.vertices.swap(vertices);
+}
+
+VertexCacheStats MeshOptimiser::simulateFifoCache(const std::vector<unsigned int>& indices,
+    unsigned int numVertices, unsigned int size)
+{
+    // Time each vertex entered the cache, a vertex is cached if it entered
+    // within the last size misses
+    std::vector<unsigned int> entered(numVertices, 0);
+    std::vector<bool> seen(numVertices, false);
+    unsigned int misses = 0, unique = 0;
+    for (unsigned int i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        if (!seen[v] || misses - entered[v] >= size)
+        {
+            if (!seen[v])
+                unique++;
+            seen[v] = true;
+            entered[v] = misses;
+            misses++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.transforms = misses;
+    if (!indices.empty())
+        stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    if (unique > 0)
+        stats.atvr = static_cast<float>(misses) / unique;
+    return stats;
+}
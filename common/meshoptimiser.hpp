@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include <common/model.hpp>
+
+// Results of running an index buffer through a simulated vertex cache
+struct VertexCacheStats
+{
+    unsigned int transforms = 0;    // cache misses (vertex shader invocations)
+    float acmr = 0.0f;              // average cache miss ratio (misses per triangle)
+    float atvr = 0.0f;              // average transform to vertex ratio (1.0 is ideal)
+};
+
+// Mesh reordering passes applied at load time
+class MeshOptimiser
+{
+public:
+    // Reorder triangles for post-transform vertex cache locality (Tom Forsyth's
+    // linear-speed vertex cache optimisation)
+    static void optimiseVertexCache(std::vector<unsigned int>& indices, unsigned int numVertices);
+
+    // Reorder vertices into the order the index buffer first uses them so that
+    // vertex fetches walk through memory linearly
+    static void optimiseVertexFetch(MeshData& mesh);
+
+    // Simulate a FIFO post-transform cache of the given size
+    static VertexCacheStats simulateFifoCache(const std::vector<unsigned int>& indices,
+        unsigned int numVertices, unsigned int cacheSize);
+};
@@ -3,111 +3,354 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <cstddef>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #include "model.hpp"
-#include "stb_image.hpp"
+#include "meshcache.hpp"
+#include "bvh.hpp"
+#include "objparser.hpp"
+#include "meshoptimiser.hpp"
+#include "assets.hpp"
+#include "glstats.hpp"
+#include "profiler.hpp"
+#include "maths.hpp"
+#include "simd.hpp"
+#include "jobs.hpp"
+
+void MeshData::packIndices(std::vector<unsigned char>& out) const
+{
+    out.resize(indices.size() * indexSize());
+    if (indexSize() == 2)
+    {
+        unsigned short* packed = reinterpret_cast<unsigned short*>(out.data());
+        for (size_t i = 0; i < indices.size(); i++)
+            packed[i] = static_cast<unsigned short>(indices[i]);
+    }
+    else if (!indices.empty())
+        memcpy(out.data(), indices.data(), out.size());
+}
 
 Model::Model(const char* path)
 {
-    // Load object
-    bool res = loadObj(path, vertices, uvs, normals);
+    name = path;
+    mesh = AssetCache::global().loadMesh(path);
+}
+
+void Model::draw(const ShaderProgram& program) const
+{
+    ProfileScope scope("Model::draw");
+    bindMaterial(program);
+
+    // Draw the triangles
+    if (mesh)
+        mesh->draw();
+}
+
+void Model::drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances,
+    unsigned int count) const
+{
+    bindMaterial(program);
+
+    // Draw the triangles
+    if (mesh)
+        mesh->drawInstanced(instances, count);
+}
+
+bool Model::sameMaterial(const Model& other) const
+{
+    if (ka != other.ka || kd != other.kd || ks != other.ks || Ns != other.Ns ||
+        textures.size() != other.textures.size())
+        return false;
+
+    for (unsigned int i = 0; i < textures.size(); i++)
+        if (textures[i].resource != other.textures[i].resource || textures[i].unit != other.textures[i].unit)
+            return false;
+    return true;
+}
+
+bool Model::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+    RayHit& hit) const
+{
+    return mesh && mesh->bvh && mesh->bvh->raycast(origin, direction, maxDistance, hit);
+}
 
-    // Calculate tangent and bitangent vectors
-    calculateTangents();
+bool Model::sphereSweep(const glm::vec3& start, const glm::vec3& end, float radius, RayHit& hit) const
+{
+    return mesh && mesh->bvh && mesh->bvh->sphereSweep(start, end, radius, hit);
+}
 
-    // Setup buffers
-    setupBuffers();
+bool Model::overlapBox(const glm::vec3& min, const glm::vec3& max) const
+{
+    return mesh && mesh->bvh && mesh->bvh->overlapBox(min, max);
 }
 
-void Model::draw(unsigned int& shaderID)
+const MeshBounds& Model::bounds() const
+{
+    static const MeshBounds empty;
+    return mesh ? mesh->bounds : empty;
+}
+
+void Model::bindMaterial(const ShaderProgram& program) const
 {
     // Send material properties to the shader
-    glUniform1f(glGetUniformLocation(shaderID, "ka"), ka);
-    glUniform1f(glGetUniformLocation(shaderID, "kd"), kd);
-    glUniform1f(glGetUniformLocation(shaderID, "ks"), ks);
-    glUniform1f(glGetUniformLocation(shaderID, "Ns"), Ns);
-
-    // Bind the textures 
-    unsigned int diffuseNum = 0;
-    unsigned int normalNum = 0;
+    glUniform1f(program.uniforms.ka, ka);
+    glUniform1f(program.uniforms.kd, kd);
+    glUniform1f(program.uniforms.ks, ks);
+    glUniform1f(program.uniforms.Ns, Ns);
+
+    // Bind the textures to their samplers' units
     for (unsigned int i = 0; i < textures.size(); i++)
     {
-        // Bind texture
-        std::string name = textures[i].type;
-        glActiveTexture(GL_TEXTURE0 + i);
-        glUniform1i(glGetUniformLocation(shaderID, (name + "Map").c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        if (textures[i].unit < 0)
+            continue;
+        glActiveTexture(GL_TEXTURE0 + textures[i].unit);
+        glBindTexture(GL_TEXTURE_2D, textures[i].resource ? textures[i].resource->id : 0);
     }
+}
 
-    // Draw the triangles
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<unsigned int>(vertices.size()));
-    glBindVertexArray(0);
+bool Mesh::packVertices = true;
+
+MeshBuffers::~MeshBuffers()
+{
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void Mesh::draw() const
+{
+    if (!buffers)
+        return;
+
+    glBindVertexArray(buffers->VAO);
+    glDrawElements(GL_TRIANGLES, numIndices, buffers->indexType, (void*)0);
+    GLStats::draws++;
+}
+
+void Mesh::drawInstanced(const InstanceBuffer& instances, unsigned int count) const
+{
+    if (!buffers || count == 0)
+        return;
+
+    glBindVertexArray(buffers->VAO);
+
+    // Point the instance attributes at the buffer (kept in the VAO until a
+    // different instance buffer is used)
+    if (buffers->instanceBuffer != instances.id)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instances.id);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                (void*)(offsetof(Instance, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, colour));
+        glVertexAttribDivisor(9, 1);
+        for (unsigned int column = 0; column < 3; column++)
+        {
+            glEnableVertexAttribArray(10 + column);
+            glVertexAttribPointer(10 + column, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                (void*)(offsetof(Instance, normal) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(10 + column, 1);
+        }
+        buffers->instanceBuffer = instances.id;
+    }
+
+    glDrawElementsInstanced(GL_TRIANGLES, numIndices, buffers->indexType, (void*)0, count);
+    GLStats::draws++;
+}
+
+// Instances
+void Instance::setModel(const glm::mat4& modelMatrix)
+{
+    model = modelMatrix;
+    normal = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+}
+
+// Instance buffers
+InstanceBuffer::~InstanceBuffer()
+{
+    destroy();
+}
+
+void InstanceBuffer::update(const Instance* instances, unsigned int count)
+{
+    if (id == 0)
+        glGenBuffers(1, &id);
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+
+    // Grow to at least double so a slowly growing count doesn't reallocate
+    // every frame, otherwise orphan the old storage
+    if (count > capacity)
+        capacity = std::max(count, 2 * capacity);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Instance), NULL, GL_STREAM_DRAW);
+    if (count > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Instance), instances);
+}
+
+void InstanceBuffer::destroy()
+{
+    if (id != 0)
+        glDeleteBuffers(1, &id);
+    id = 0;
+    capacity = 0;
+}
+
+void Mesh::shareBuffers(const Mesh& other)
+{
+    numVertices = other.numVertices;
+    numIndices = other.numIndices;
+    geometryHash = other.geometryHash;
+    vertexBytes = other.vertexBytes;
+    indexBytes = other.indexBytes;
+    buffers = other.buffers;
+    bvh = other.bvh;
+    bounds = other.bounds;
+}
+
+MeshBounds MeshBounds::fromVertices(const Vertex* vertices, unsigned int count)
+{
+    MeshBounds bounds;
+    if (count == 0)
+        return bounds;
+
+    bounds.min = bounds.max = vertices[0].position;
+    for (unsigned int i = 1; i < count; i++)
+    {
+        bounds.min = glm::min(bounds.min, vertices[i].position);
+        bounds.max = glm::max(bounds.max, vertices[i].position);
+    }
+
+    // Tighter than half the box's diagonal for most meshes
+    bounds.centre = 0.5f * (bounds.min + bounds.max);
+    float radiusSquared = 0.0f;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        glm::vec3 offset = vertices[i].position - bounds.centre;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.radius = sqrtf(radiusSquared);
+    return bounds;
+}
+
+// Convert a float to a 16-bit half float (rounding to nearest, no denormals)
+static unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000u;
+    int exponent = static_cast<int>((bits >> 23) & 0xffu) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffffu;
+
+    if (exponent <= 0)
+        return static_cast<unsigned short>(sign);
+    if (exponent >= 31)
+        return static_cast<unsigned short>(sign | 0x7bffu);
+
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)
+        half++;
+    return static_cast<unsigned short>(half);
+}
+
+// Convert a vector to GL_INT_2_10_10_10_REV with signed normalised components
+static unsigned int packSnorm1010102(const glm::vec3& v, float w)
+{
+    int x = static_cast<int>(roundf(glm::clamp(v.x, -1.0f, 1.0f) * 511.0f));
+    int y = static_cast<int>(roundf(glm::clamp(v.y, -1.0f, 1.0f) * 511.0f));
+    int z = static_cast<int>(roundf(glm::clamp(v.z, -1.0f, 1.0f) * 511.0f));
+    int a = static_cast<int>(roundf(glm::clamp(w, -1.0f, 1.0f)));
+    return (x & 0x3ff) | ((y & 0x3ff) << 10) | ((z & 0x3ff) << 20) | ((a & 0x3) << 30);
+}
+
+PackedVertex Mesh::packVertex(const Vertex& vertex)
+{
+    PackedVertex packed;
+    packed.position = vertex.position;
+    packed.uv[0] = floatToHalf(vertex.uv.x);
+    packed.uv[1] = floatToHalf(vertex.uv.y);
+    packed.normal = packSnorm1010102(vertex.normal, 0.0f);
+    packed.tangent = packSnorm1010102(glm::vec3(vertex.tangent), vertex.tangent.w);
+    return packed;
 }
 
-void Model::setupBuffers()
+void Mesh::setupBuffers(const Vertex* vertices, unsigned int vertexCount,
+    const void* indices, unsigned int indexCount, unsigned int indexSize)
 {
+    numVertices = vertexCount;
+    numIndices = indexCount;
+    indexBytes = indexCount * indexSize;
+    bounds = MeshBounds::fromVertices(vertices, vertexCount);
+    buffers = std::make_shared<MeshBuffers>();
+    buffers->indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
     // Create and bind the Vertex Array Object (VAO)
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    // Create Vertex Buffer Object
-    unsigned int vertexBuffer;
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-    // Create uv buffer
-    unsigned int uvBuffer;
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
-    // Create normal buffer
-    unsigned int normalBuffer;
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-
-    // Bind the vertex buffer
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    // Bind the uv buffer
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    // Bind the normal buffer
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    // Create tangent buffer
-    GLuint tangentBuffer;
-    glGenBuffers(1, &tangentBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
-    glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec3), &tangents[0], GL_STATIC_DRAW);
-
-    // Create bitangent buffer
-    GLuint bitangentBuffer;
-    glGenBuffers(1, &bitangentBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentBuffer);
-    glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec3), &bitangents[0], GL_STATIC_DRAW);
-
-    // Bind the tangent buffer
-    glEnableVertexAttribArray(3);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentBuffer);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    // Bind the bitangent buffer
-    glEnableVertexAttribArray(4);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentBuffer);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glGenVertexArrays(1, &buffers->VAO);
+    glBindVertexArray(buffers->VAO);
+
+    // Create the interleaved Vertex Buffer Object
+    glGenBuffers(1, &buffers->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers->vertexBuffer);
+
+    // Create the Element Buffer Object (this stays bound to the VAO)
+    glGenBuffers(1, &buffers->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+
+    if (packVertices)
+    {
+        // Pack the vertices and upload them
+        std::vector<PackedVertex> packed(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; i++)
+            packed[i] = packVertex(vertices[i]);
+        vertexBytes = vertexCount * sizeof(PackedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, packed.data(), GL_STATIC_DRAW);
+
+        // Position
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+
+        // UV
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, uv));
+
+        // Normal
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+
+        // Tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+    }
+    else
+    {
+        // Upload the vertices as they are
+        vertexBytes = vertexCount * sizeof(Vertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+
+        // Position
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+
+        // UV
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+
+        // Normal
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+        // Tangent and handedness
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
+    }
 
     // Unbind the VAO
     glBindVertexArray(0);
@@ -115,121 +358,76 @@ void Model::setupBuffers()
 
 void Model::deleteBuffers()
 {
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &uvBuffer);
-    glDeleteBuffers(1, &normalBuffer);
-    glDeleteVertexArrays(1, &VAO);
+    mesh.reset();
+    textures.clear();
 }
 
-bool Model::loadObj(const char* path,
-    std::vector<glm::vec3>& outVertices,
-    std::vector<glm::vec2>& outUVs,
-    std::vector<glm::vec3>& outNormals)
+void Model::memoryReport() const
 {
+    size_t textureBytes = 0;
+    for (unsigned int i = 0; i < textures.size(); i++)
+        textureBytes += textures[i].resource->bytes;
+
+    size_t vertexBytes = mesh ? mesh->vertexBytes : 0;
+    size_t indexBytes = mesh ? mesh->indexBytes : 0;
+    size_t numVertices = mesh ? mesh->numVertices : 0;
+    printf("%-28s vertices %8.1f KB (%zu x %zu bytes), indices %7.1f KB, textures %8.1f KB\n",
+        name.c_str(), vertexBytes / 1024.0, numVertices, numVertices ? vertexBytes / numVertices : 0,
+        indexBytes / 1024.0, textureBytes / 1024.0);
+}
 
-    printf("Loading file %s\n", path);
+bool Model::loadObj(const char* path, std::vector<Vertex>& outVertices)
+{
 
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> tempVertices;
-    std::vector<glm::vec2> tempUVs;
-    std::vector<glm::vec3> tempNormals;
+    printf("Loading file %s\n", path);
 
-    FILE* file = fopen(path, "r");
-    if (file == NULL)
+    // Map the whole file into memory
+    MappedFile file;
+    if (!file.open(path))
     {
         printf("Impossible to open the file. Check paths and directories.");
         getchar();
         return false;
     }
 
-    while (true)
+    // Parse the file
+    ObjData obj;
+    if (!ObjParser::parse(reinterpret_cast<const char*>(file.data), file.size, obj))
     {
-        // Read the first word of the line
-        char lineHeader[128];
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-        {
-            // If end of file reached exit the loop
-            break;
-        }
-
-        if (strcmp(lineHeader, "v") == 0)
-        {
-            // Read vertices
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            tempVertices.push_back(vertex);
-        }
-        else if (strcmp(lineHeader, "vt") == 0)
-        {
-            // Read texture co-ordinates
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            tempUVs.push_back(uv);
-        }
-        else if (strcmp(lineHeader, "vn") == 0)
-        {
-            // Read vertex normals
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            tempNormals.push_back(normal);
-        }
-        else if (strcmp(lineHeader, "f") == 0)
-        {
-            // Read vertex indices
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n",
-                &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-
-            // Check for error
-            if (matches != 9)
-            {
-                printf("File can't be read by loadObj().\n");
-                fclose(file);
-                return false;
-            }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices.push_back(uvIndex[0]);
-            uvIndices.push_back(uvIndex[1]);
-            uvIndices.push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
-        }
-        else
-        {
-            // Remove comment line
-            char commentBuffer[1000];
-            fgets(commentBuffer, 1000, file);
-        }
+        printf("File can't be read by loadObj().\n");
+        return false;
     }
 
-    // For each vertex of the triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++)
+    // For each vertex of each triangle
+    outVertices.resize(obj.corners.size());
+    for (size_t i = 0; i < obj.corners.size(); i++)
     {
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-
-        // Get the attributes
-        glm::vec3 vertex = tempVertices[vertexIndex - 1];
-        glm::vec2 uv = tempUVs[uvIndex - 1];
-        glm::vec3 normal = tempNormals[normalIndex - 1];
-
-        // Copy the attributes to the buffers
-        outVertices.push_back(vertex);
-        outUVs.push_back(uv);
-        outNormals.push_back(normal);
+        // Copy the attributes to the vertex (faces without uvs get (0, 0))
+        const ObjIndex& corner = obj.corners[i];
+        Vertex& vertex = outVertices[i];
+        vertex = Vertex();
+        vertex.position = obj.positions[corner.position];
+        if (corner.uv >= 0)
+            vertex.uv = obj.uvs[corner.uv];
+        if (corner.normal >= 0)
+            vertex.normal = obj.normals[corner.normal];
     }
 
-    // Close .obj file
-    fclose(file);
+    // Faces without normals use the face normal
+    for (size_t i = 0; i + 2 < obj.corners.size(); i += 3)
+    {
+        if (obj.corners[i].normal >= 0 && obj.corners[i + 1].normal >= 0 && obj.corners[i + 2].normal >= 0)
+            continue;
+
+        glm::vec3 faceNormal = glm::cross(outVertices[i + 1].position - outVertices[i].position,
+            outVertices[i + 2].position - outVertices[i].position);
+        float length = glm::length(faceNormal);
+        if (length > 0.0f)
+            faceNormal /= length;
+        for (size_t j = i; j < i + 3; j++)
+            if (obj.corners[j].normal < 0)
+                outVertices[j].normal = faceNormal;
+    }
 
     return true;
 }
@@ -237,72 +435,252 @@ bool Model::loadObj(const char* path,
 void Model::addTexture(const char* path, const std::string type)
 {
     Texture texture;
-    texture.id = loadTexture(path);
+    texture.resource = AssetCache::global().loadTexture(path);
     texture.type = type;
+    texture.unit = ShaderProgram::textureUnit(type);
     textures.push_back(texture);
 }
 
-unsigned int Model::loadTexture(const char* path)
+void Model::buildIndexed(const std::vector<Vertex>& corners, MeshData& outMesh)
 {
+    // Open addressing hash table from vertex to index (size is a power of two
+    // at least twice the number of corners so the probes stay short)
+    size_t tableSize = 1;
+    while (tableSize < 2 * corners.size())
+        tableSize <<= 1;
+    std::vector<unsigned int> table(tableSize, ~0u);
+
+    outMesh.vertices.clear();
+    outMesh.indices.clear();
+    outMesh.vertices.reserve(corners.size());
+    outMesh.indices.reserve(corners.size());
+
+    // Only position, uv and normal are compared (tangents are calculated later)
+    const size_t keySize = offsetof(Vertex, tangent);
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        const Vertex& corner = corners[i];
+        size_t slot = MeshCache::hash(&corner, keySize) & (tableSize - 1);
+        while (table[slot] != ~0u && memcmp(&outMesh.vertices[table[slot]], &corner, keySize) != 0)
+            slot = (slot + 1) & (tableSize - 1);
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+        if (table[slot] == ~0u)
+        {
+            table[slot] = static_cast<unsigned int>(outMesh.vertices.size());
+            outMesh.vertices.push_back(corner);
+        }
+        outMesh.indices.push_back(table[slot]);
+    }
+}
 
-    int width, height, numComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &numComponents, 0);
-    if (data)
+bool Model::loadMesh(const char* path, MeshData& outMesh, JobSystem* jobSystem)
+{
+    std::vector<Vertex> corners;
+    if (!loadObj(path, corners))
+        return false;
+
+    buildIndexed(corners, outMesh);
+
+    // Reorder the triangles for the vertex cache and the vertices for fetching
+    MeshOptimiser::optimiseVertexCache(outMesh.indices, static_cast<unsigned int>(outMesh.vertices.size()));
+    MeshOptimiser::optimiseVertexFetch(outMesh);
+
+    calculateTangents(outMesh, jobSystem);
+
+    size_t before = corners.size() * sizeof(Vertex);
+    size_t after = outMesh.vertices.size() * sizeof(Vertex) + outMesh.indices.size() * outMesh.indexSize();
+    printf("  %zu vertices (%zu before indexing), upload %.1f KB (was %.1f KB)\n",
+        outMesh.vertices.size(), corners.size(), after / 1024.0, before / 1024.0);
+
+    return true;
+}
+
+namespace
+{
+
+// Run body(part) for each of numParts parts, as jobs if there is a job system
+template <class F>
+void runParts(JobSystem* jobSystem, unsigned int numParts, F body)
+{
+    if (jobSystem == nullptr || numParts == 1)
     {
-        GLenum format;
-        if (numComponents == 1)
-            format = GL_RED;
-        else if (numComponents == 3)
-            format = GL_RGB;
-        else if (numComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        for (unsigned int part = 0; part < numParts; part++)
+            body(part);
+        return;
     }
-    else
+    jobSystem->parallelFor(numParts, 1, [&](unsigned int begin, unsigned int end)
     {
-        std::cout << "Texture " << path << " failed to load." << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+        for (unsigned int part = begin; part < end; part++)
+            body(part);
+    });
 }
 
-void Model::calculateTangents()
+// Tangent contribution to a vertex owned by another thread
+struct DeferredTangent
+{
+    unsigned int vertex;
+    glm::vec4 tangent;
+};
+
+// Add the angle weighted unit tangent (the direction of increasing u) and the
+// uv winding of triangles [begin, end) to the tangents of their vertices,
+// V::width triangles at a time. Only vertices in [ownedBegin, ownedEnd) are
+// written, the other corners are deferred. Returns the first triangle not done.
+template <class V>
+unsigned int accumulateTangents(Vertex* vertices, const unsigned int* indices, unsigned int begin, unsigned int end,
+    unsigned int ownedBegin, unsigned int ownedEnd, std::vector<DeferredTangent>& deferred)
 {
-    for (unsigned int i = 0; i < vertices.size(); i += 3)
+    const V zero(0.0f), one(1.0f), tiny(1e-20f);
+    unsigned int t = begin;
+    for (; t + V::width <= end; t += V::width)
     {
-        // Calculate edge vectors and deltas
-        glm::vec3 E1 = vertices[i + 1] - vertices[i];
-        glm::vec3 E2 = vertices[i + 2] - vertices[i + 1];
-        float deltaU1 = uvs[i + 1].x - uvs[i].x;
-        float deltaV1 = uvs[i + 1].y - uvs[i].y;
-        float deltaU2 = uvs[i + 2].x - uvs[i + 1].x;
-        float deltaV2 = uvs[i + 2].y - uvs[i + 1].y;
-
-        // Calculate tangents
-        float denom = 1.0f / (deltaU1 * deltaV2 - deltaU2 * deltaV1);
-        glm::vec3 tangent = (deltaV2 * E1 - deltaV1 * E2) * denom;
-        glm::vec3 bitangent = (deltaU1 * E2 - deltaU2 * E1) * denom;
-
-        // Set the same tangents for the three vertices of the triangle
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        tangents.push_back(tangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
-        bitangents.push_back(bitangent);
+        // Gather the position and uv of each corner into lanes
+        float gathered[3][5][V::width];
+        for (unsigned int k = 0; k < V::width; k++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const Vertex& vertex = vertices[indices[3 * (t + k) + c]];
+                gathered[c][0][k] = vertex.position.x;
+                gathered[c][1][k] = vertex.position.y;
+                gathered[c][2][k] = vertex.position.z;
+                gathered[c][3][k] = vertex.uv.x;
+                gathered[c][4][k] = vertex.uv.y;
+            }
+        }
+        V p[3][3], u[3], v[3];
+        for (int c = 0; c < 3; c++)
+        {
+            for (int a = 0; a < 3; a++)
+                p[c][a] = V::load(gathered[c][a]);
+            u[c] = V::load(gathered[c][3]);
+            v[c] = V::load(gathered[c][4]);
+        }
+
+        // Edges and their lengths (edge c leaves corner c)
+        V edge[3][3], inverseLength[3];
+        for (int c = 0; c < 3; c++)
+        {
+            for (int a = 0; a < 3; a++)
+                edge[c][a] = p[(c + 1) % 3][a] - p[c][a];
+            V lengthSquared = edge[c][0] * edge[c][0] + edge[c][1] * edge[c][1] + edge[c][2] * edge[c][2];
+            inverseLength[c] = one / V::sqrt(V::max(lengthSquared, tiny));
+        }
+
+        // Tangent, flipped for mirrored uvs so it always follows u. Triangles with
+        // degenerate uvs or positions get a zero tangent and sign.
+        V du1 = u[1] - u[0], dv1 = v[1] - v[0];
+        V du2 = u[2] - u[0], dv2 = v[2] - v[0];
+        V area = du1 * dv2 - du2 * dv1;
+        V x = edge[0][0] * dv2 + edge[2][0] * dv1;
+        V y = edge[0][1] * dv2 + edge[2][1] * dv1;
+        V z = edge[0][2] * dv2 + edge[2][2] * dv1;
+        V lengthSquared = x * x + y * y + z * z;
+        V sign = V::selectLess(area, zero, V(-1.0f), one);
+        sign = V::selectLess(V::abs(area), tiny, zero, sign);
+        sign = V::selectLess(lengthSquared, tiny, zero, sign);
+        V scale = sign / V::sqrt(V::max(lengthSquared, tiny));
+
+        float face[7][V::width];
+        V::store(face[0], x * scale);
+        V::store(face[1], y * scale);
+        V::store(face[2], z * scale);
+        V::store(face[3], sign);
+
+        // Angle at each corner, between the edge leaving it and the edge arriving at it
+        for (int c = 0; c < 3; c++)
+        {
+            const V* leaving = edge[c];
+            const V* arriving = edge[(c + 2) % 3];
+            V cosAngle = (leaving[0] * arriving[0] + leaving[1] * arriving[1] + leaving[2] * arriving[2]) *
+                (zero - inverseLength[c] * inverseLength[(c + 2) % 3]);
+            V::store(face[4 + c], V::acos(V::min(V::max(cosAngle, V(-1.0f)), one)));
+        }
+
+        for (unsigned int k = 0; k < V::width; k++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float weight = face[4 + c][k];
+                glm::vec4 tangent(face[0][k] * weight, face[1][k] * weight, face[2][k] * weight, face[3][k]);
+                unsigned int vertex = indices[3 * (t + k) + c];
+                if (vertex >= ownedBegin && vertex < ownedEnd)
+                    vertices[vertex].tangent += tangent;
+                else
+                    deferred.push_back({ vertex, tangent });
+            }
+        }
     }
+    return t;
 }
 
+}
+
+void Model::calculateTangents(MeshData& mesh, JobSystem* jobSystem)
+{
+    std::vector<Vertex>& vertices = mesh.vertices;
+    const unsigned int* indices = mesh.indices.data();
+    unsigned int numTriangles = static_cast<unsigned int>(mesh.indices.size() / 3);
+    unsigned int numVertices = static_cast<unsigned int>(vertices.size());
+
+    // Small meshes aren't worth splitting into jobs
+    const unsigned int minTrianglesPerPart = 8192;
+    unsigned int numParts = jobSystem ? std::min(jobSystem->size(), numTriangles / minTrianglesPerPart) : 1;
+    numParts = std::max(numParts, 1u);
+
+    // Each part takes an equal share of the triangles and owns the same share
+    // of the vertices. After MeshOptimiser::optimiseVertexFetch the vertices are
+    // numbered in the order the triangles use them, so few corners are deferred.
+    std::vector<std::vector<DeferredTangent>> deferred(numParts);
+    runParts(jobSystem, numParts, [&](unsigned int part)
+    {
+        unsigned int triangleBegin = static_cast<unsigned int>(uint64_t(numTriangles) * part / numParts);
+        unsigned int triangleEnd = static_cast<unsigned int>(uint64_t(numTriangles) * (part + 1) / numParts);
+        unsigned int ownedBegin = static_cast<unsigned int>(uint64_t(numVertices) * part / numParts);
+        unsigned int ownedEnd = static_cast<unsigned int>(uint64_t(numVertices) * (part + 1) / numParts);
+        for (unsigned int v = ownedBegin; v < ownedEnd; v++)
+            vertices[v].tangent = glm::vec4(0.0f);
+
+        // Four triangles at a time with SSE (unless Maths::simdLevel is lowered), then the rest one at a time
+        unsigned int done = triangleBegin;
+#ifdef SIMD_X86
+        if (Maths::simdLevel >= Maths::SIMD_SSE)
+            done = accumulateTangents<Sse>(vertices.data(), indices, triangleBegin, triangleEnd,
+                ownedBegin, ownedEnd, deferred[part]);
+#endif
+        accumulateTangents<Scalar>(vertices.data(), indices, done, triangleEnd, ownedBegin, ownedEnd, deferred[part]);
+    });
+
+    for (const std::vector<DeferredTangent>& corners : deferred)
+        for (const DeferredTangent& corner : corners)
+            vertices[corner.vertex].tangent += corner.tangent;
+
+    // Orthonormalise against the normal and keep the handedness most triangles agree on
+    runParts(jobSystem, numParts, [&](unsigned int part)
+    {
+        unsigned int begin = static_cast<unsigned int>(uint64_t(numVertices) * part / numParts);
+        unsigned int end = static_cast<unsigned int>(uint64_t(numVertices) * (part + 1) / numParts);
+        for (unsigned int v = begin; v < end; v++)
+        {
+            glm::vec3 normal = vertices[v].normal;
+            float normalLength = glm::length(normal);
+            if (normalLength > 0.0f)
+                normal /= normalLength;
+            glm::vec3 sum(vertices[v].tangent);
+            glm::vec3 tangent = sum - normal * glm::dot(normal, sum);
+            tangent -= normal * glm::dot(normal, tangent);  // again for sums almost along the normal
+            float length = glm::length(tangent);
+            if (length > 1e-10f)
+                tangent /= length;
+            else
+            {
+                // No usable uvs, so any direction in the normal plane will do
+                glm::vec3 axis = fabsf(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                tangent = glm::cross(normal, axis);
+                length = glm::length(tangent);
+                tangent = length > 0.0f ? tangent / length : axis;
+            }
+            vertices[v].tangent = glm::vec4(tangent, vertices[v].tangent.w < 0.0f ? -1.0f : 1.0f);
+        }
+    });
+}
@@ -2,65 +2,227 @@
 
 #include <vector>
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
+#include <memory>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <common/program.hpp>
+
+class BVH;
+struct RayHit;
+class JobSystem;
+
+// GPU texture, shared between models through the AssetCache (the id is 0 until
+// the texture has been uploaded)
+struct TextureResource
+{
+    unsigned int id = 0;
+    size_t bytes = 0;   // GPU memory including mipmaps
+    std::string path;
+
+    TextureResource() {}
+    ~TextureResource();
+    TextureResource(const TextureResource&) = delete;
+    TextureResource& operator=(const TextureResource&) = delete;
+};
+
 // Texture struct
 struct Texture
 {
-    unsigned int id;
     std::string type;
+    int unit = -1;      // texture unit of the <type>Map sampler
+    std::shared_ptr<TextureResource> resource;
+};
+
+// Interleaved vertex struct (this is the layout stored in the binary mesh cache
+// and uploaded to the vertex buffer)
+struct Vertex
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+    glm::vec4 tangent;      // w is the handedness, bitangent = w * cross(normal, tangent)
+};
+
+// Packed vertex struct used when Mesh::packVertices is set (24 bytes instead of
+// 48). Normals and tangents are GL_INT_2_10_10_10_REV (the tangent's handedness
+// goes in the 2-bit w) and uvs are half floats.
+struct PackedVertex
+{
+    glm::vec3 position;
+    unsigned short uv[2];
+    unsigned int normal;
+    unsigned int tangent;
+};
+
+// CPU side mesh data with one entry per unique vertex and three indices per triangle
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+
+    // Bytes per index when uploaded (16-bit indices whenever they fit)
+    unsigned int indexSize() const { return vertices.size() <= 65536 ? 2 : 4; }
+
+    // Indices converted to indexSize() bytes each
+    void packIndices(std::vector<unsigned char>& out) const;
+};
+
+// Model space bounding box and sphere of a mesh
+struct MeshBounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 centre = glm::vec3(0.0f);    // centre of the box and the sphere
+    float radius = 0.0f;
+
+    // Fit the box around the vertex positions, then the sphere around the box's centre
+    static MeshBounds fromVertices(const Vertex* vertices, unsigned int count);
+};
+
+// Vertex array and buffers of an uploaded mesh
+struct MeshBuffers
+{
+    unsigned int VAO = 0;
+    unsigned int vertexBuffer = 0;
+    unsigned int indexBuffer = 0;
+    unsigned int indexType = GL_UNSIGNED_INT;
+    unsigned int instanceBuffer = 0;    // buffer the instance attributes read from
+
+    MeshBuffers() {}
+    ~MeshBuffers();
+    MeshBuffers(const MeshBuffers&) = delete;
+    MeshBuffers& operator=(const MeshBuffers&) = delete;
+};
+
+// Per-instance attributes (locations 5-8 model matrix, 9 colour, 10-12 normal matrix)
+struct Instance
+{
+    glm::mat4 model;
+    glm::vec4 colour;
+    glm::mat3 normal;   // world space, so the shader only applies the view's rotation
+
+    // Set the model matrix and its normal matrix
+    void setModel(const glm::mat4& modelMatrix);
+};
+
+// Stream buffer of per-instance attributes, rewritten every frame
+class InstanceBuffer
+{
+public:
+    unsigned int id = 0;
+    unsigned int capacity = 0;
+
+    InstanceBuffer() {}
+    ~InstanceBuffer();
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // Upload the instances, growing the buffer if needed
+    void update(const Instance* instances, unsigned int count);
+
+    // Delete the buffer (also done by the destructor)
+    void destroy();
+};
+
+// Mesh shared between models through the AssetCache. The buffers are deleted
+// when the last mesh using them is released. With asynchronous loading a mesh
+// has no buffers (and draws nothing) until AssetCache::finishLoading uploads it.
+class Mesh
+{
+public:
+    std::string name;
+    unsigned int numVertices = 0;
+    unsigned int numIndices = 0;
+    uint64_t geometryHash = 0;
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+    std::shared_ptr<MeshBuffers> buffers;
+    std::shared_ptr<const BVH> bvh;     // triangles for collision queries (CPU side)
+    MeshBounds bounds;                  // calculated by setupBuffers
+
+    // Setup buffers
+    void setupBuffers(const Vertex* vertices, unsigned int vertexCount,
+        const void* indices, unsigned int indexCount, unsigned int indexSize);
+
+    // Use the buffers of an identical mesh
+    void shareBuffers(const Mesh& other);
+
+    // Draw the triangles
+    void draw() const;
+
+    // Draw one copy of the triangles per instance
+    void drawInstanced(const InstanceBuffer& instances, unsigned int count) const;
+
+    // Upload PackedVertex rather than Vertex (set before loading meshes)
+    static bool packVertices;
+
+    // Convert a vertex to the packed format
+    static PackedVertex packVertex(const Vertex& vertex);
 };
 
 class Model
 {
 public:
     // Model attributes
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec2> uvs;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec3> tangents;
-    std::vector<glm::vec3> bitangents;
+    std::shared_ptr<Mesh> mesh;
+    std::string name;
     std::vector<Texture>   textures;
     unsigned int textureID;
     float ka, kd, ks, Ns;
 
-    // Constructor
+    // Constructor (the mesh and textures come from AssetCache::global())
     Model(const char* path);
 
+    // Empty model with no mesh (used where there is no GL context, e.g. benchmarks)
+    Model() : textureID(0), ka(0.0f), kd(0.0f), ks(0.0f), Ns(0.0f) {}
+
     // Draw model
-    void draw(unsigned int& shaderID);
+    void draw(const ShaderProgram& program) const;
+
+    // Draw a copy of the model per instance (the shader's instanced path)
+    void drawInstanced(const ShaderProgram& program, const InstanceBuffer& instances,
+        unsigned int count) const;
+
+    // Collision queries against the mesh triangles in model space (false if the
+    // mesh has no BVH, e.g. while it is still loading). See BVH for the details.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        RayHit& hit) const;
+    bool sphereSweep(const glm::vec3& start, const glm::vec3& end, float radius, RayHit& hit) const;
+    bool overlapBox(const glm::vec3& min, const glm::vec3& max) const;
+
+    // Model space bounds of the mesh (empty until the mesh has loaded)
+    const MeshBounds& bounds() const;
+
+    // Send the material and bind the textures
+    void bindMaterial(const ShaderProgram& program) const;
+
+    // True if both models use the same textures and material constants
+    bool sameMaterial(const Model& other) const;
 
     // Add textures
     void addTexture(const char* path, const std::string type);
 
-    // Cleanup
+    // Cleanup (releases this model's mesh and textures)
     void deleteBuffers();
 
-private:
-
-    // Array buffers
-    unsigned int VAO;
-    unsigned int vertexBuffer;
-    unsigned int uvBuffer;
-    unsigned int normalBuffer;
-    unsigned int tangentBuffer;
-    unsigned int bitangentBuffer;
+    // Print the GPU memory used by the buffers and textures
+    void memoryReport() const;
 
-    // Load .obj file method
-    bool loadObj(const char* path,
-        std::vector<glm::vec3>& inVertices,
-        std::vector<glm::vec2>& inUVs,
-        std::vector<glm::vec3>& inNormals);
+    // Load .obj file method (expands the faces into one vertex per corner)
+    static bool loadObj(const char* path, std::vector<Vertex>& outVertices);
 
-    // Setup buffers
-    void setupBuffers();
+    // Merge identical (position, uv, normal) corners into an indexed mesh
+    static void buildIndexed(const std::vector<Vertex>& corners, MeshData& outMesh);
 
-    // Calculate tangents and bitangents
-    void calculateTangents();
+    // Calculate smooth per-vertex tangents and their handedness (MikkTSpace
+    // weighting). Large meshes are split into jobs, one per thread of the job
+    // system (on the calling thread when it is null).
+    static void calculateTangents(MeshData& mesh, JobSystem* jobSystem = nullptr);
 
-    // Load texture
-    unsigned int loadTexture(const char* path);
+    // Load an .obj file into an indexed mesh with tangents
+    static bool loadMesh(const char* path, MeshData& outMesh, JobSystem* jobSystem = nullptr);
 };
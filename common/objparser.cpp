@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <cmath>
+
+#include <common/objparser.hpp>
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && isSpace(*p))
+        p++;
+    return p;
+}
+
+static inline const char* skipLine(const char* p, const char* end)
+{
+    while (p < end && *p != '\n')
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+// Parse an integer, returns nullptr if there isn't one
+static inline const char* parseInt(const char* p, const char* end, int& out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= end || !isDigit(*p))
+        return nullptr;
+
+    int value = 0;
+    while (p < end && isDigit(*p))
+        value = value * 10 + (*p++ - '0');
+
+    out = negative ? -value : value;
+    return p;
+}
+
+const char* ObjParser::parseFloat(const char* p, const char* end, float& out)
+{
+    // Powers of ten that are exact as doubles
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Accumulate up to 19 significant digits in an integer
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0, significant = 0;
+    while (p < end && isDigit(*p))
+    {
+        if (significant < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            significant += mantissa != 0;
+        }
+        else
+            exponent++;
+        digits++;
+        p++;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && isDigit(*p))
+        {
+            if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                significant += mantissa != 0;
+                exponent--;
+            }
+            digits++;
+            p++;
+        }
+    }
+    if (digits == 0)
+        return nullptr;
+
+    // Exponent
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int e;
+        const char* next = parseInt(p + 1, end, e);
+        if (next)
+        {
+            exponent += e;
+            p = next;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0)
+        value = -exponent <= 22 ? value / powers[-exponent] : value * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        value = exponent <= 22 ? value * powers[exponent] : value * std::pow(10.0, exponent);
+
+    out = static_cast<float>(negative ? -value : value);
+    return p;
+}
+
+// Parse n floats separated by spaces
+static inline const char* parseFloats(const char* p, const char* end, float* out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        p = ObjParser::parseFloat(skipSpaces(p, end), end, out[i]);
+        if (p == nullptr)
+            return nullptr;
+    }
+    return p;
+}
+
+// Convert a 1-based or negative (relative) .obj index to a 0-based index
+static inline bool resolveIndex(int index, size_t count, int& out)
+{
+    out = index < 0 ? static_cast<int>(count) + index : index - 1;
+    return out >= 0 && static_cast<size_t>(out) < count;
+}
+
+// Parse a corner of a face (v, v/vt, v//vn or v/vt/vn)
+static inline const char* parseCorner(const char* p, const char* end, const ObjData& out, ObjIndex& corner)
+{
+    int index;
+    corner.uv = -1;
+    corner.normal = -1;
+
+    p = parseInt(p, end, index);
+    if (p == nullptr || !resolveIndex(index, out.positions.size(), corner.position))
+        return nullptr;
+
+    if (p < end && *p == '/')
+    {
+        p++;
+        if (p < end && *p != '/')
+        {
+            p = parseInt(p, end, index);
+            if (p == nullptr || !resolveIndex(index, out.uvs.size(), corner.uv))
+                return nullptr;
+        }
+        if (p < end && *p == '/')
+        {
+            p = parseInt(p + 1, end, index);
+            if (p == nullptr || !resolveIndex(index, out.normals.size(), corner.normal))
+                return nullptr;
+        }
+    }
+    return p;
+}
+
+bool ObjParser::parse(const char* data, size_t size, ObjData& out)
+{
+    const char* end = data + size;
+
+    // Counting pass so that the vectors are only allocated once
+    size_t numPositions = 0, numUVs = 0, numNormals = 0, numCorners = 0;
+    for (const char* p = data; p < end; )
+    {
+        p = skipSpaces(p, end);
+        if (end - p > 1 && p[0] == 'v')
+        {
+            if (isSpace(p[1]))
+                numPositions++;
+            else if (p[1] == 't')
+                numUVs++;
+            else if (p[1] == 'n')
+                numNormals++;
+        }
+        else if (end - p > 1 && p[0] == 'f' && isSpace(p[1]))
+        {
+            // Count the corners of the face, a polygon with n corners is n - 2 triangles
+            int n = 0;
+            p++;
+            while (true)
+            {
+                p = skipSpaces(p, end);
+                if (p >= end || *p == '\n' || *p == '#')
+                    break;
+                n++;
+                while (p < end && !isSpace(*p) && *p != '\n')
+                    p++;
+            }
+            if (n > 2)
+                numCorners += 3 * (n - 2);
+        }
+        p = skipLine(p, end);
+    }
+
+    out.positions.clear();
+    out.uvs.clear();
+    out.normals.clear();
+    out.corners.clear();
+    out.positions.reserve(numPositions);
+    out.uvs.reserve(numUVs);
+    out.normals.reserve(numNormals);
+    out.corners.reserve(numCorners);
+
+    // Parsing pass
+    unsigned int line = 1;
+    const char* p = data;
+    for (; p != nullptr && p < end; line++)
+    {
+        p = skipSpaces(p, end);
+        if (end - p > 1 && p[0] == 'v' && isSpace(p[1]))
+        {
+            // Read vertices (an optional w is ignored)
+            glm::vec3 position;
+            p = parseFloats(p + 1, end, &position.x, 3);
+            if (p == nullptr)
+                break;
+            out.positions.push_back(position);
+        }
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+        {
+            // Read texture co-ordinates (an optional w is ignored)
+            glm::vec2 uv;
+            p = parseFloats(p + 2, end, &uv.x, 2);
+            if (p == nullptr)
+                break;
+            out.uvs.push_back(uv);
+        }
+        else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+        {
+            // Read vertex normals
+            glm::vec3 normal;
+            p = parseFloats(p + 2, end, &normal.x, 3);
+            if (p == nullptr)
+                break;
+            out.normals.push_back(normal);
+        }
+        else if (end - p > 1 && p[0] == 'f' && isSpace(p[1]))
+        {
+            // Read the corners and triangulate the polygon as a fan
+            ObjIndex first, previous, corner;
+            int n = 0;
+            p++;
+            while (true)
+            {
+                p = skipSpaces(p, end);
+                if (p >= end || *p == '\n' || *p == '#')
+                    break;
+                p = parseCorner(p, end, out, corner);
+                if (p == nullptr)
+                    break;
+
+                if (n == 0)
+                    first = corner;
+                else if (n >= 2)
+                {
+                    out.corners.push_back(first);
+                    out.corners.push_back(previous);
+                    out.corners.push_back(corner);
+                }
+                previous = corner;
+                n++;
+            }
+            if (p == nullptr)
+                break;
+        }
+        p = skipLine(p, end);
+    }
+
+    if (p == nullptr)
+    {
+        printf("Error in .obj file on line %u.\n", line);
+        return false;
+    }
+
+    return true;
+}
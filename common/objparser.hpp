@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+// Indices of the attributes used by one face corner (0-based, -1 if missing)
+struct ObjIndex
+{
+    int position;
+    int uv;
+    int normal;
+};
+
+// Contents of an .obj file with the faces triangulated
+struct ObjData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjIndex>  corners;     // three per triangle
+};
+
+// Streaming .obj parser that works on the whole file in one buffer. A counting
+// pass sizes the output vectors first so the parsing pass never reallocates.
+// Supports v, v/vt, v//vn and v/vt/vn corners, negative (relative) indices and
+// polygons with any number of corners (triangulated as a fan).
+class ObjParser
+{
+public:
+    static bool parse(const char* data, size_t size, ObjData& out);
+
+    // Parse a float, returns the character after it or nullptr if there isn't one
+    static const char* parseFloat(const char* p, const char* end, float& out);
+};
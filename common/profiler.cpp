@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <common/profiler.hpp>
+
+bool Profiler::enabled = false;
+
+// A timed scope, tracks 0 and up are threads in the order they first recorded
+struct ProfileEvent
+{
+    const char* name;
+    double start;
+    double duration;
+    unsigned int track;
+};
+
+// Track shown for the GPU in the trace
+static const unsigned int gpuTrack = 1000;
+
+// The trace stops growing here (about 32 MB), the histograms keep going
+static const size_t maxTraceEvents = 1 << 20;
+
+// Queries issued during one frame. GPU results are read when the slot comes
+// round again two frames later.
+struct GPUFrame
+{
+    std::vector<GLuint> queries;
+    std::vector<const char*> names;
+    std::vector<double> issued;
+    unsigned int used = 0;
+    unsigned int frame = 0;
+};
+
+static std::mutex mutex;
+static std::vector<ProfileEvent> frameEvents;
+static std::vector<ProfileEvent> traceEvents;
+static size_t droppedTraceEvents = 0;
+
+// Time per frame of each scope, in the order the scopes first appeared
+static std::vector<std::string> scopeNames;
+static std::map<std::string, std::vector<float>> scopeTimes;
+
+static GPUFrame gpuFrames[2];
+static unsigned int frameIndex = 0;
+static double frameStart = 0.0;
+static double gpuEnd = 0.0;
+static bool gpuActive = false;
+static unsigned int droppedQueries = 0;
+
+static std::atomic<unsigned int> numTracks{0};
+
+static unsigned int threadTrack()
+{
+    thread_local unsigned int track = numTracks.fetch_add(1);
+    return track;
+}
+
+void Profiler::enable()
+{
+    now();
+    threadTrack();
+    traceEvents.reserve(1 << 16);
+    enabled = true;
+}
+
+double Profiler::now()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Add an event to the trace and the frame's events (mutex must be held)
+static void addEvent(const ProfileEvent& event)
+{
+    frameEvents.push_back(event);
+    if (traceEvents.size() < maxTraceEvents)
+        traceEvents.push_back(event);
+    else
+        droppedTraceEvents++;
+}
+
+void Profiler::record(const char* name, double start, double end)
+{
+    if (!enabled)
+        return;
+
+    ProfileEvent event = { name, start, end - start, threadTrack() };
+    std::lock_guard<std::mutex> lock(mutex);
+    addEvent(event);
+}
+
+void Profiler::beginGPU(const char* name)
+{
+    // GL_TIME_ELAPSED queries can't nest, so an inner scope is ignored
+    if (!enabled || gpuActive)
+        return;
+
+    GPUFrame& slot = gpuFrames[frameIndex % 2];
+    if (slot.used == slot.queries.size())
+    {
+        GLuint query;
+        glGenQueries(1, &query);
+        slot.queries.push_back(query);
+        slot.names.push_back(nullptr);
+        slot.issued.push_back(0.0);
+    }
+    slot.frame = frameIndex;
+    slot.names[slot.used] = name;
+    slot.issued[slot.used] = now();
+    glBeginQuery(GL_TIME_ELAPSED, slot.queries[slot.used]);
+    gpuActive = true;
+}
+
+void Profiler::endGPU()
+{
+    if (!gpuActive)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuFrames[frameIndex % 2].used++;
+    gpuActive = false;
+}
+
+// Add up each scope's events and append the totals to the histograms
+static void addFrameTotals(const std::vector<ProfileEvent>& events)
+{
+    std::vector<std::pair<std::string, float>> totals;
+    for (const ProfileEvent& event : events)
+    {
+        std::string name = event.track == gpuTrack ? std::string("GPU ") + event.name : std::string(event.name);
+        unsigned int i = 0;
+        while (i < totals.size() && totals[i].first != name)
+            i++;
+        if (i == totals.size())
+            totals.push_back(std::make_pair(name, 0.0f));
+        totals[i].second += float(event.duration / 1000.0);
+    }
+
+    for (const auto& total : totals)
+    {
+        std::vector<float>& times = scopeTimes[total.first];
+        if (times.empty())
+            scopeNames.push_back(total.first);
+        times.push_back(total.second);
+    }
+}
+
+// Read a slot's query results. The queries only say how long the GPU took, so
+// each event is placed on the GPU track when its commands were issued or when
+// the previous event finished, whichever is later.
+static void resolveGPUFrame(GPUFrame& slot, bool wait)
+{
+    // The first frame is left out as it includes the driver warming up (and
+    // llvmpipe gives a garbage time for the first query)
+    if (slot.frame == 0)
+        slot.used = 0;
+
+    std::vector<ProfileEvent> events;
+    for (unsigned int i = 0; i < slot.used; i++)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available && !wait)
+        {
+            // Drop the rest rather than stall, they finish in order
+            droppedQueries += slot.used - i;
+            break;
+        }
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &elapsed);
+        double start = std::max(slot.issued[i], gpuEnd);
+        double duration = elapsed / 1000.0;
+        gpuEnd = start + duration;
+        events.push_back({ slot.names[i], start, duration, gpuTrack });
+    }
+    slot.used = 0;
+
+    if (events.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const ProfileEvent& event : events)
+    {
+        if (traceEvents.size() < maxTraceEvents)
+            traceEvents.push_back(event);
+        else
+            droppedTraceEvents++;
+    }
+    addFrameTotals(events);
+}
+
+void Profiler::beginFrame()
+{
+    if (!enabled)
+        return;
+
+    // This frame reuses the queries from two frames ago
+    resolveGPUFrame(gpuFrames[frameIndex % 2], false);
+    frameStart = now();
+}
+
+void Profiler::endFrame()
+{
+    if (!enabled)
+        return;
+
+    endGPU();
+    record("Frame", frameStart, now());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    addFrameTotals(frameEvents);
+    frameEvents.clear();
+    frameIndex++;
+}
+
+void Profiler::finish()
+{
+    if (!enabled)
+        return;
+
+    endGPU();
+    glFinish();
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        GPUFrame& slot = gpuFrames[(frameIndex + i) % 2];
+        resolveGPUFrame(slot, true);
+        if (!slot.queries.empty())
+            glDeleteQueries(GLsizei(slot.queries.size()), slot.queries.data());
+        slot = GPUFrame();
+    }
+}
+
+void Profiler::report()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    printf("Profile over %u frames (ms per frame)\n", frameIndex);
+    printf("    %-28s %7s %8s %8s %8s %8s\n", "scope", "frames", "mean", "p50", "p95", "p99");
+    for (const std::string& name : scopeNames)
+    {
+        std::vector<float> times = scopeTimes[name];
+        std::sort(times.begin(), times.end());
+        double total = 0.0;
+        for (float time : times)
+            total += time;
+
+        // Nearest rank percentiles
+        size_t n = times.size();
+        float p50 = times[std::min(n - 1, n * 50 / 100)];
+        float p95 = times[std::min(n - 1, n * 95 / 100)];
+        float p99 = times[std::min(n - 1, n * 99 / 100)];
+        printf("    %-28s %7zu %8.3f %8.3f %8.3f %8.3f\n", name.c_str(), n, total / n, p50, p95, p99);
+    }
+    if (droppedQueries > 0)
+        printf("    %u GPU queries weren't ready two frames later and were dropped\n", droppedQueries);
+}
+
+bool Profiler::writeTrace(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        printf("Couldn't write %s\n", path);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Name the tracks, then one complete ("X") event per scope. The names are
+    // string literals from the code, so they need no escaping.
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+        gpuTrack);
+    unsigned int tracks = numTracks.load();
+    for (unsigned int track = 0; track < tracks; track++)
+    {
+        char name[32] = "Main thread";
+        if (track > 0)
+            snprintf(name, sizeof(name), "Worker %u", track);
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            track, name);
+    }
+    for (const ProfileEvent& event : traceEvents)
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.name, event.track == gpuTrack ? "gpu" : "cpu", event.track, event.start, event.duration);
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %zu trace events to %s", traceEvents.size(), path);
+    if (droppedTraceEvents > 0)
+        printf(" (%zu more left out)", droppedTraceEvents);
+    printf("\n");
+    return true;
+}
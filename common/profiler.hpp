@@ -0,0 +1,93 @@
+#pragma once
+
+// Frame profiler. CPU scopes (ProfileScope) time a block of code on any thread
+// and GPU scopes (GPUProfileScope) time the GL commands issued inside them with
+// GL_TIME_ELAPSED queries. GPU scopes can't nest, and their results are read
+// two frames later so the CPU never waits for them. Every scope's total time
+// per frame goes into a histogram for report(), and every event into a trace
+// for writeTrace() that loads in chrome://tracing. Nothing is recorded until
+// enable() is called, so the scopes can stay in the code.
+class Profiler
+{
+public:
+    static bool enabled;
+
+    // Start recording (GPU scopes need a current GL context)
+    static void enable();
+
+    // Microseconds since the profiler was first used
+    static double now();
+
+    // Add a CPU event (ProfileScope calls this), safe from any thread
+    static void record(const char* name, double start, double end);
+
+    // Time the GL commands between these calls on the GPU
+    static void beginGPU(const char* name);
+    static void endGPU();
+
+    // Mark the frame boundaries (the frame itself is recorded as "Frame")
+    static void beginFrame();
+    static void endFrame();
+
+    // Wait for the GPU, read the outstanding queries and delete them
+    static void finish();
+
+    // Print the p50, p95 and p99 time per frame of every scope
+    static void report();
+
+    // Write every event as a chrome://tracing JSON file
+    static bool writeTrace(const char* path);
+};
+
+// Times the enclosing block (or until stop() is called)
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : name(Profiler::enabled ? name : nullptr)
+    {
+        if (this->name)
+            start = Profiler::now();
+    }
+
+    ~ProfileScope() { stop(); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    void stop()
+    {
+        if (name)
+            Profiler::record(name, start, Profiler::now());
+        name = nullptr;
+    }
+
+private:
+    const char* name;
+    double start = 0.0;
+};
+
+// Times the GL commands issued in the enclosing block (or until stop() is called)
+class GPUProfileScope
+{
+public:
+    GPUProfileScope(const char* name) : active(Profiler::enabled)
+    {
+        if (active)
+            Profiler::beginGPU(name);
+    }
+
+    ~GPUProfileScope() { stop(); }
+
+    GPUProfileScope(const GPUProfileScope&) = delete;
+    GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+
+    void stop()
+    {
+        if (active)
+            Profiler::endGPU();
+        active = false;
+    }
+
+private:
+    bool active;
+};
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <vector>
+
+#include <common/program.hpp>
+#include <common/shader.hpp>
+
+// Samplers in texture unit order
+static const char* textureTypes[] = { "diffuse", "normal", "specular" };
+static const int numTextureTypes = sizeof(textureTypes) / sizeof(textureTypes[0]);
+
+bool ShaderProgram::load(const char* vertexPath, const char* fragmentPath)
+{
+    id = LoadShaders(vertexPath, fragmentPath);
+
+    int linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        printf("Shader program %s, %s failed to link\n", vertexPath, fragmentPath);
+        return false;
+    }
+
+    // Reflect the active uniforms (arrays of structs are listed one member at a
+    // time, e.g. "lightSources[0].position")
+    int numUniforms = 0, maxLength = 0;
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+    locations.clear();
+    for (int i = 0; i < numUniforms; i++)
+    {
+        int size;
+        GLenum type;
+        glGetActiveUniform(id, i, maxLength + 1, NULL, &size, &type, name.data());
+        int location = glGetUniformLocation(id, name.data());
+        if (location < 0)
+            continue;   // uniform block member
+
+        // Arrays are reported as "name[0]", make "name" find them too
+        std::string key = name.data();
+        locations[key] = location;
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+            locations[key.substr(0, key.size() - 3)] = location;
+    }
+
+    uniforms.MV = location("MV");
+    uniforms.normalMatrix = location("normalMatrix");
+    uniforms.ka = location("ka");
+    uniforms.kd = location("kd");
+    uniforms.ks = location("ks");
+    uniforms.Ns = location("Ns");
+    uniforms.lightColour = location("lightColour");
+    uniforms.instanced = location("instanced");
+    uniforms.clusterParams = location("clusterParams");
+    uniforms.numGlobalLights = location("numGlobalLights");
+
+    // Bind the uniform blocks to the shared binding points
+    unsigned int cameraBlock = glGetUniformBlockIndex(id, "Camera");
+    if (cameraBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(id, cameraBlock, cameraBinding);
+    unsigned int lightsBlock = glGetUniformBlockIndex(id, "Lights");
+    if (lightsBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(id, lightsBlock, lightsBinding);
+
+    // Samplers never change unit so set them once
+    glUseProgram(id);
+    for (int i = 0; i < numTextureTypes; i++)
+    {
+        int sampler = location(std::string(textureTypes[i]) + "Map");
+        if (sampler >= 0)
+            glUniform1i(sampler, i);
+    }
+    const char* clusterSamplers[] = { "clusterLights", "clusterGrid", "clusterIndices" };
+    const int clusterUnits[] = { clusterLightsUnit, clusterGridUnit, clusterIndicesUnit };
+    for (int i = 0; i < 3; i++)
+    {
+        int sampler = location(clusterSamplers[i]);
+        if (sampler >= 0)
+            glUniform1i(sampler, clusterUnits[i]);
+    }
+
+    return true;
+}
+
+void ShaderProgram::setModelView(const glm::mat4& modelView) const
+{
+    // Normals need the inverse transpose so they stay perpendicular under non-uniform scales
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelView)));
+    glUniformMatrix4fv(uniforms.MV, 1, GL_FALSE, &modelView[0][0]);
+    glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, &normalMatrix[0][0]);
+}
+
+int ShaderProgram::location(const std::string& name) const
+{
+    auto it = locations.find(name);
+    return it == locations.end() ? -1 : it->second;
+}
+
+int ShaderProgram::textureUnit(const std::string& type)
+{
+    for (int i = 0; i < numTextureTypes; i++)
+        if (type == textureTypes[i])
+            return i;
+    return -1;
+}
+
+// Uniform buffers
+UniformBuffer::~UniformBuffer()
+{
+    destroy();
+}
+
+void UniformBuffer::create(size_t bufferSize, unsigned int binding)
+{
+    size = bufferSize;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::destroy()
+{
+    if (id != 0)
+        glDeleteBuffers(1, &id);
+    id = 0;
+    size = 0;
+}
+
+void UniformBuffer::update(const void* data, size_t dataSize)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, dataSize, data);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Uniform locations used on every draw, looked up once when the program is loaded
+struct UniformLocations
+{
+    int MV = -1;
+    int normalMatrix = -1;
+    int ka = -1;
+    int kd = -1;
+    int ks = -1;
+    int Ns = -1;
+    int lightColour = -1;
+    int instanced = -1;
+    int clusterParams = -1;
+    int numGlobalLights = -1;
+};
+
+// Linked shader program with every active uniform location reflected at load
+// time, so nothing is looked up by name while rendering
+class ShaderProgram
+{
+public:
+    unsigned int id = 0;
+    UniformLocations uniforms;
+
+    // Uniform block binding points shared by every program
+    static const unsigned int cameraBinding = 0;
+    static const unsigned int lightsBinding = 1;
+
+    // Texture units of the clustered lighting buffers (after the material maps)
+    static const unsigned int clusterLightsUnit = 3;
+    static const unsigned int clusterGridUnit = 4;
+    static const unsigned int clusterIndicesUnit = 5;
+
+    // Compile and link a program, returns false if it fails to link
+    bool load(const char* vertexPath, const char* fragmentPath);
+
+    // Send the model-view matrix of a draw that isn't instanced, with its normal
+    // matrix (the program must be in use)
+    void setModelView(const glm::mat4& modelView) const;
+
+    // Location of an active uniform, -1 if the program doesn't use it
+    int location(const std::string& name) const;
+
+    // Texture unit the <type>Map sampler reads from (-1 for unknown types)
+    static int textureUnit(const std::string& type);
+
+private:
+    std::unordered_map<std::string, int> locations;
+};
+
+// std140 layout of the Camera uniform block
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// Uniform buffer object bound to a uniform block binding point
+class UniformBuffer
+{
+public:
+    unsigned int id = 0;
+    size_t size = 0;
+
+    UniformBuffer() {}
+    ~UniformBuffer();
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // Create the buffer and bind it to a binding point
+    void create(size_t bufferSize, unsigned int binding);
+
+    // Replace the buffer contents
+    void update(const void* data, size_t dataSize);
+
+    // Delete the buffer (also done by the destructor)
+    void destroy();
+};
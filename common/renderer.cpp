@@ -0,0 +1,121 @@
+#include <common/renderer.hpp>
+#include <common/profiler.hpp>
+
+void InstanceList::clear()
+{
+    for (unsigned int i = 0; i < instances.size(); i++)
+        instances[i].clear();
+}
+
+unsigned int InstanceList::materialId(const Model& model)
+{
+    // Same material as the last model added
+    if (lastMaterial < materials.size() && materials[lastMaterial] == &model)
+        return lastMaterial;
+
+    // There are only a handful of materials so a linear search is fine
+    for (unsigned int i = 0; i < materials.size(); i++)
+    {
+        const Model* other = materials[i];
+        if (other == &model || (other->mesh == model.mesh && other->sameMaterial(model)))
+        {
+            lastMaterial = i;
+            return i;
+        }
+    }
+
+    lastMaterial = static_cast<unsigned int>(materials.size());
+    materials.push_back(&model);
+    instances.emplace_back();
+    return lastMaterial;
+}
+
+void InstanceList::add(const Model& model, const glm::mat4& modelMatrix)
+{
+    add(materialId(model), modelMatrix);
+}
+
+void InstanceList::add(unsigned int material, const glm::mat4& modelMatrix)
+{
+    Instance instance;
+    instance.setModel(modelMatrix);
+    instance.colour = glm::vec4(1.0f);
+    instances[material].push_back(instance);
+}
+
+void InstanceList::append(const InstanceList& other)
+{
+    for (unsigned int i = 0; i < other.materials.size(); i++)
+    {
+        if (other.instances[i].empty())
+            continue;
+        std::vector<Instance>& group = instances[materialId(*other.materials[i])];
+        group.insert(group.end(), other.instances[i].begin(), other.instances[i].end());
+    }
+}
+
+unsigned int InstanceList::numBatches() const
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < instances.size(); i++)
+        if (!instances[i].empty())
+            count++;
+    return count;
+}
+
+unsigned int InstanceList::numInstances() const
+{
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < instances.size(); i++)
+        count += static_cast<unsigned int>(instances[i].size());
+    return count;
+}
+
+void InstancedRenderer::begin()
+{
+    instances.clear();
+}
+
+void InstancedRenderer::add(const Model& model, const glm::mat4& modelMatrix)
+{
+    instances.add(model, modelMatrix);
+}
+
+void InstancedRenderer::draw(const ShaderProgram& program)
+{
+    draw(program, instances);
+}
+
+void InstancedRenderer::draw(const ShaderProgram& program, const InstanceList& list)
+{
+    ProfileScope scope("InstancedRenderer::draw");
+    while (buffers.size() < list.materials.size())
+        buffers.emplace_back(new InstanceBuffer);
+
+    glUniform1i(program.uniforms.instanced, GL_TRUE);
+    for (unsigned int i = 0; i < list.materials.size(); i++)
+    {
+        if (list.instances[i].empty())
+            continue;
+
+        unsigned int count = static_cast<unsigned int>(list.instances[i].size());
+        buffers[i]->update(list.instances[i].data(), count);
+        list.materials[i]->drawInstanced(program, *buffers[i], count);
+    }
+    glUniform1i(program.uniforms.instanced, GL_FALSE);
+}
+
+unsigned int InstancedRenderer::numBatches() const
+{
+    return instances.numBatches();
+}
+
+unsigned int InstancedRenderer::numInstances() const
+{
+    return instances.numInstances();
+}
+
+void InstancedRenderer::deleteBuffers()
+{
+    buffers.clear();
+}
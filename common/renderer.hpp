@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include <common/model.hpp>
+#include <common/program.hpp>
+
+// Instances grouped by material. Material ID i is every model sharing the mesh
+// and material of materials[i], and instances[i] are its copies. Filling a list
+// makes no GL calls, so worker threads can each build one and the main thread
+// draws them with InstancedRenderer.
+class InstanceList
+{
+public:
+    std::vector<const Model*> materials;
+    std::vector<std::vector<Instance>> instances;
+
+    // Empty the list (the materials and memory are kept for reuse)
+    void clear();
+
+    // ID of the model's material, added if it is new
+    unsigned int materialId(const Model& model);
+
+    // Queue a copy of a model (the model must outlive the draw call)
+    void add(const Model& model, const glm::mat4& modelMatrix);
+    void add(unsigned int material, const glm::mat4& modelMatrix);
+
+    // Add every instance of another list
+    void append(const InstanceList& other);
+
+    // Number of materials with instances and instances queued
+    unsigned int numBatches() const;
+    unsigned int numInstances() const;
+
+private:
+    unsigned int lastMaterial = 0;  // consecutive adds are usually the same material
+};
+
+// Collects the objects drawn in a frame and draws each group sharing a mesh and
+// material with one instanced draw call
+class InstancedRenderer
+{
+public:
+    InstanceList instances;
+
+    // Start a new frame (the groups and their buffers are kept for reuse)
+    void begin();
+
+    // Queue a copy of a model (the model must outlive the draw call)
+    void add(const Model& model, const glm::mat4& modelMatrix);
+
+    // Draw every group
+    void draw(const ShaderProgram& program);
+
+    // Draw every group of a list built elsewhere
+    void draw(const ShaderProgram& program, const InstanceList& list);
+
+    // Number of groups drawn and instances queued this frame
+    unsigned int numBatches() const;
+    unsigned int numInstances() const;
+
+    // Delete the instance buffers
+    void deleteBuffers();
+
+private:
+    std::vector<std::unique_ptr<InstanceBuffer>> buffers;   // one per material ID
+};
@@ -7,8 +7,8 @@
 #include <fstream>
 #include <sstream>
 
-unsigned int LoadShaders(const char *vertex_file_path,
-                         const char *fragment_file_path)
+inline unsigned int LoadShaders(const char *vertex_file_path,
+                                const char *fragment_file_path)
 {
 
     // Create the shaders
@@ -0,0 +1,170 @@
+#pragma once
+
+// Lane wrappers for the batched kernels (see transformkernel.hpp, cullkernel.hpp
+// and Model::calculateTangents). Each wrapper holds V::width floats, one object per
+// lane, so a kernel written once as a template runs with Scalar (one object at
+// a time, also used for the leftovers) or Sse (four at a time). The AVX2
+// wrapper lives in mathsavx2.cpp as it needs its own compiler flags.
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// One object at a time
+struct Scalar
+{
+    static const unsigned int width = 1;
+    float v;
+
+    Scalar() {}
+    Scalar(float value) : v(value) {}
+
+    friend Scalar operator+(Scalar a, Scalar b) { return a.v + b.v; }
+    friend Scalar operator-(Scalar a, Scalar b) { return a.v - b.v; }
+    friend Scalar operator*(Scalar a, Scalar b) { return a.v * b.v; }
+    friend Scalar operator/(Scalar a, Scalar b) { return a.v / b.v; }
+
+    static Scalar load(const float* p) { return p[0]; }
+    static Scalar load3(const float* p) { return p[0]; }
+    static void load4Transposed(const float* p, Scalar& x, Scalar& y, Scalar& z, Scalar& w)
+    {
+        x = p[0];
+        y = p[1];
+        z = p[2];
+        w = p[3];
+    }
+    static void store(float* p, Scalar a) { p[0] = a.v; }
+    static Scalar sqrt(Scalar a) { return sqrtf(a.v); }
+    static Scalar abs(Scalar a) { return fabsf(a.v); }
+    static Scalar min(Scalar a, Scalar b) { return a.v < b.v ? a.v : b.v; }
+    static Scalar max(Scalar a, Scalar b) { return a.v > b.v ? a.v : b.v; }
+    static Scalar acos(Scalar a) { return acosf(a.v); }
+    static int signMask(Scalar a) { return std::signbit(a.v) ? 1 : 0; }
+
+    // a < b ? ifLess : otherwise
+    static Scalar selectLess(Scalar a, Scalar b, Scalar ifLess, Scalar otherwise)
+    {
+        return a.v < b.v ? ifLess : otherwise;
+    }
+
+    static void sincos(Scalar x, Scalar& outSin, Scalar& outCos)
+    {
+        outSin = sinf(x.v);
+        outCos = cosf(x.v);
+    }
+
+    static void storeColumn(float* out, Scalar r0, Scalar r1, Scalar r2, Scalar r3)
+    {
+        out[0] = r0.v;
+        out[1] = r1.v;
+        out[2] = r2.v;
+        out[3] = r3.v;
+    }
+};
+
+#ifdef SIMD_X86
+// Four objects per register (SSE2 is always there on x86-64)
+struct Sse
+{
+    static const unsigned int width = 4;
+    __m128 v;
+
+    Sse() {}
+    Sse(__m128 value) : v(value) {}
+    Sse(float value) : v(_mm_set1_ps(value)) {}
+
+    friend Sse operator+(Sse a, Sse b) { return _mm_add_ps(a.v, b.v); }
+    friend Sse operator-(Sse a, Sse b) { return _mm_sub_ps(a.v, b.v); }
+    friend Sse operator*(Sse a, Sse b) { return _mm_mul_ps(a.v, b.v); }
+    friend Sse operator/(Sse a, Sse b) { return _mm_div_ps(a.v, b.v); }
+
+    static Sse load(const float* p) { return _mm_loadu_ps(p); }
+    static Sse load3(const float* p) { return _mm_setr_ps(p[0], p[3], p[6], p[9]); }
+
+    // Four consecutive vec4s, one per lane
+    static void load4Transposed(const float* p, Sse& x, Sse& y, Sse& z, Sse& w)
+    {
+        __m128 r0 = _mm_loadu_ps(p), r1 = _mm_loadu_ps(p + 4), r2 = _mm_loadu_ps(p + 8), r3 = _mm_loadu_ps(p + 12);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        x = r0;
+        y = r1;
+        z = r2;
+        w = r3;
+    }
+    static void store(float* p, Sse a) { _mm_storeu_ps(p, a.v); }
+    static Sse sqrt(Sse a) { return _mm_sqrt_ps(a.v); }
+    static Sse abs(Sse a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+    static Sse min(Sse a, Sse b) { return _mm_min_ps(a.v, b.v); }
+    static Sse max(Sse a, Sse b) { return _mm_max_ps(a.v, b.v); }
+    static int signMask(Sse a) { return _mm_movemask_ps(a.v); }
+
+    static Sse selectLess(Sse a, Sse b, Sse ifLess, Sse otherwise)
+    {
+        __m128 mask = _mm_cmplt_ps(a.v, b.v);
+        return _mm_or_ps(_mm_and_ps(mask, ifLess.v), _mm_andnot_ps(mask, otherwise.v));
+    }
+
+    // Arc cosine of [-1, 1] (Abramowitz and Stegun 4.4.46, error below 2e-8)
+    static Sse acos(Sse x)
+    {
+        Sse a = abs(x);
+        Sse poly = Sse(-0.0012624911f) * a + Sse(0.0066700901f);
+        poly = poly * a + Sse(-0.0170881256f);
+        poly = poly * a + Sse(0.0308918810f);
+        poly = poly * a + Sse(-0.0501743046f);
+        poly = poly * a + Sse(0.0889789874f);
+        poly = poly * a + Sse(-0.2145988016f);
+        poly = poly * a + Sse(1.5707963050f);
+        Sse result = sqrt(Sse(1.0f) - a) * poly;
+        return selectLess(x, Sse(0.0f), Sse(3.14159265f) - result, result);
+    }
+
+    // Sine and cosine (Cephes polynomials after reducing to [-pi/4, pi/4])
+    static void sincos(Sse x, Sse& outSin, Sse& outCos)
+    {
+        __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x.v, _mm_set1_ps(0.636619772f)));
+        __m128 j = _mm_cvtepi32_ps(quadrant);
+        __m128 y = _mm_sub_ps(x.v, _mm_mul_ps(j, _mm_set1_ps(1.5703125f)));
+        y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(4.837512969970703125e-4f)));
+        y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(7.54978995489188216e-8f)));
+        __m128 z = _mm_mul_ps(y, y);
+
+        __m128 sinPoly = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(-1.9515295891e-4f)), _mm_set1_ps(8.3321608736e-3f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(z, sinPoly), _mm_set1_ps(-1.6666654611e-1f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z, y), sinPoly), y);
+
+        __m128 cosPoly = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(2.443315711809948e-5f)), _mm_set1_ps(-1.388731625493765e-3f));
+        cosPoly = _mm_add_ps(_mm_mul_ps(z, cosPoly), _mm_set1_ps(4.166664568298827e-2f));
+        cosPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z, z), cosPoly),
+            _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, _mm_set1_ps(0.5f))));
+
+        // Odd quadrants swap sine and cosine, then the signs follow the quadrant
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+        __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+            _mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        __m128 sinValue = _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly));
+        __m128 cosValue = _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly));
+        outSin = _mm_xor_ps(sinValue, sinSign);
+        outCos = _mm_xor_ps(cosValue, cosSign);
+    }
+
+    // Store one column of four matrices (16 floats apart) from its four rows
+    static void storeColumn(float* out, Sse r0, Sse r1, Sse r2, Sse r3)
+    {
+        _MM_TRANSPOSE4_PS(r0.v, r1.v, r2.v, r3.v);
+        _mm_storeu_ps(out, r0.v);
+        _mm_storeu_ps(out + 16, r1.v);
+        _mm_storeu_ps(out + 32, r2.v);
+        _mm_storeu_ps(out + 48, r3.v);
+    }
+};
+#endif
+
+}
@@ -0,0 +1,222 @@
+#include <cmath>
+#include <algorithm>
+
+#include <common/spatialhash.hpp>
+
+SpatialHash::SpatialHash(float cellSize, unsigned int numBuckets)
+    : cellSize(cellSize)
+{
+    // Round the bucket count up to a power of two so the hash can be masked
+    unsigned int count = 1;
+    while (count < numBuckets)
+        count *= 2;
+    buckets.resize(count);
+}
+
+glm::ivec4 SpatialHash::cellRange(const glm::vec2& min, const glm::vec2& max) const
+{
+    float scale = 1.0f / cellSize;
+    return glm::ivec4(
+        static_cast<int>(floorf(min.x * scale)),
+        static_cast<int>(floorf(min.y * scale)),
+        static_cast<int>(floorf(max.x * scale)),
+        static_cast<int>(floorf(max.y * scale)));
+}
+
+// Whether two colliders overlap, given the offset between their centres and
+// their radii and box half sizes summed (a circle is a box of half size zero)
+static bool overlaps(const glm::vec2& offset, float radius, const glm::vec2& extent)
+{
+    glm::vec2 gap = glm::max(glm::abs(offset) - extent, glm::vec2(0.0f));
+    return gap.x * gap.x + gap.y * gap.y <= radius * radius;
+}
+
+unsigned int SpatialHash::bucket(int x, int z) const
+{
+    unsigned int hash = static_cast<unsigned int>(x) * 73856093u ^ static_cast<unsigned int>(z) * 19349663u;
+    return hash & static_cast<unsigned int>(buckets.size() - 1);
+}
+
+void SpatialHash::insertCells(unsigned int id, const glm::ivec4& cells)
+{
+    for (int z = cells.y; z <= cells.w; z++)
+        for (int x = cells.x; x <= cells.z; x++)
+            buckets[bucket(x, z)].push_back(id);
+}
+
+void SpatialHash::removeCells(unsigned int id, const glm::ivec4& cells)
+{
+    for (int z = cells.y; z <= cells.w; z++)
+    {
+        for (int x = cells.x; x <= cells.z; x++)
+        {
+            // Buckets are short, so find the id and swap the last one into its place
+            std::vector<unsigned int>& ids = buckets[bucket(x, z)];
+            for (unsigned int i = 0; i < ids.size(); i++)
+            {
+                if (ids[i] == id)
+                {
+                    ids[i] = ids.back();
+                    ids.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::update(unsigned int id, const glm::vec3& position, float radius)
+{
+    place(id, glm::vec2(position.x, position.z), radius, glm::vec2(0.0f));
+}
+
+void SpatialHash::updateBox(unsigned int id, const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec2 low = glm::vec2(min.x, min.z);
+    glm::vec2 high = glm::vec2(max.x, max.z);
+    place(id, (low + high) * 0.5f, 0.0f, (high - low) * 0.5f);
+}
+
+bool SpatialHash::contains(unsigned int id) const
+{
+    return id < colliders.size() && colliders[id].present;
+}
+
+void SpatialHash::place(unsigned int id, const glm::vec2& centre, float radius, const glm::vec2& extent)
+{
+    if (id >= colliders.size())
+    {
+        colliders.resize(id + 1);
+        stamps.resize(id + 1, 0);
+    }
+
+    Collider& collider = colliders[id];
+    glm::ivec4 cells = cellRange(centre - extent - radius, centre + extent + radius);
+    if (!collider.present)
+    {
+        insertCells(id, cells);
+    }
+    else if (cells != collider.cells)
+    {
+        removeCells(id, collider.cells);
+        insertCells(id, cells);
+    }
+
+    collider.position = centre;
+    collider.radius = radius;
+    collider.extent = extent;
+    collider.cells = cells;
+    collider.present = true;
+}
+
+void SpatialHash::remove(unsigned int id)
+{
+    if (id >= colliders.size() || !colliders[id].present)
+        return;
+
+    removeCells(id, colliders[id].cells);
+    colliders[id].present = false;
+}
+
+void SpatialHash::resize(unsigned int count)
+{
+    for (unsigned int id = count; id < colliders.size(); id++)
+        remove(id);
+    if (count < colliders.size())
+    {
+        colliders.resize(count);
+        stamps.resize(count);
+    }
+}
+
+unsigned int SpatialHash::nextStamp()
+{
+    // Restart the stamps when the counter wraps
+    if (++stamp == 0)
+    {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+    return stamp;
+}
+
+void SpatialHash::query(const glm::vec3& position, float radius, std::vector<unsigned int>& hits,
+    unsigned int ignore)
+{
+    hits.clear();
+    glm::vec2 centre = glm::vec2(position.x, position.z);
+    glm::ivec4 cells = cellRange(centre - radius, centre + radius);
+    unsigned int current = nextStamp();
+
+    for (int z = cells.y; z <= cells.w; z++)
+    {
+        for (int x = cells.x; x <= cells.z; x++)
+        {
+            for (unsigned int id : buckets[bucket(x, z)])
+            {
+                // Colliders spanning several cells (or sharing a bucket) are only tested once
+                if (stamps[id] == current || id == ignore)
+                    continue;
+                stamps[id] = current;
+
+                const Collider& collider = colliders[id];
+                pairsTested++;
+                if (overlaps(collider.position - centre, radius + collider.radius, collider.extent))
+                {
+                    pairsFound++;
+                    hits.push_back(id);
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::pairs(std::vector<glm::uvec2>& hits)
+{
+    hits.clear();
+    for (unsigned int id = 0; id < colliders.size(); id++)
+    {
+        const Collider& collider = colliders[id];
+        if (!collider.present)
+            continue;
+
+        unsigned int current = nextStamp();
+        for (int z = collider.cells.y; z <= collider.cells.w; z++)
+        {
+            for (int x = collider.cells.x; x <= collider.cells.z; x++)
+            {
+                for (unsigned int other : buckets[bucket(x, z)])
+                {
+                    // Each pair is tested from its lower id only
+                    if (other <= id || stamps[other] == current)
+                        continue;
+                    stamps[other] = current;
+
+                    const Collider& second = colliders[other];
+                    pairsTested++;
+                    if (overlaps(second.position - collider.position, collider.radius + second.radius,
+                        collider.extent + second.extent))
+                    {
+                        pairsFound++;
+                        hits.push_back(glm::uvec2(id, other));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::resetCounts()
+{
+    pairsTested = 0;
+    pairsFound = 0;
+}
+
+void SpatialHash::clear()
+{
+    for (std::vector<unsigned int>& ids : buckets)
+        ids.clear();
+    colliders.clear();
+    stamps.clear();
+    stamp = 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Broadphase for circles and boxes on the xz plane (collision ignores y). Each
+// collider is stored in every grid cell it overlaps, and the cells are hashed
+// into a fixed number of buckets so the grid has no bounds. Colliders are
+// identified by an id chosen by the caller (the entity index). Boxes are for
+// large static colliders such as walls, whose bounding circle would cover far
+// more of the grid.
+class SpatialHash
+{
+public:
+    float cellSize;
+
+    // Collider pairs checked exactly and pairs that overlapped since resetCounts
+    unsigned int pairsTested = 0;
+    unsigned int pairsFound = 0;
+
+    SpatialHash(float cellSize = 1.0f, unsigned int numBuckets = 4096);
+
+    // Add or move a collider. Only touches the buckets if the collider's cells change.
+    void update(unsigned int id, const glm::vec3& position, float radius);
+
+    // Add or move a box collider covering min to max on the xz plane
+    void updateBox(unsigned int id, const glm::vec3& min, const glm::vec3& max);
+
+    // Whether the id has a collider in the grid
+    bool contains(unsigned int id) const;
+
+    // Remove a collider (does nothing if it isn't in the grid)
+    void remove(unsigned int id);
+
+    // Remove every collider with an id >= count
+    void resize(unsigned int count);
+
+    // Find the colliders overlapping a circle, skipping the collider ignore
+    void query(const glm::vec3& position, float radius, std::vector<unsigned int>& hits,
+        unsigned int ignore = ~0u);
+
+    // Find every overlapping pair of colliders (each pair once, lower id first)
+    void pairs(std::vector<glm::uvec2>& hits);
+
+    void resetCounts();
+    void clear();
+
+private:
+    struct Collider
+    {
+        glm::vec2 position;
+        float radius = 0.0f;
+        glm::vec2 extent = glm::vec2(0.0f);         // half size of a box, zero for a circle
+        glm::ivec4 cells = glm::ivec4(0, 0, -1, -1);  // min x, min z, max x, max z
+        bool present = false;
+    };
+
+    std::vector<std::vector<unsigned int>> buckets;
+    std::vector<Collider> colliders;
+    std::vector<unsigned int> stamps;   // last query that visited each collider
+    unsigned int stamp = 0;
+
+    glm::ivec4 cellRange(const glm::vec2& min, const glm::vec2& max) const;
+    void place(unsigned int id, const glm::vec2& centre, float radius, const glm::vec2& extent);
+    unsigned int bucket(int x, int z) const;
+    void insertCells(unsigned int id, const glm::ivec4& cells);
+    void removeCells(unsigned int id, const glm::ivec4& cells);
+    unsigned int nextStamp();
+};
@@ -0,0 +1,27 @@
+#include <cmath>
+
+#include <common/timestep.hpp>
+
+FixedTimestep::FixedTimestep(double rate, unsigned int maxSteps)
+    : step(1.0 / rate), maxSteps(maxSteps)
+{
+}
+
+unsigned int FixedTimestep::advance(double time)
+{
+    // The small bias stops a time that is a whole number of ticks rounding down
+    double due = floor((time - skipped) / step + 1e-6) - double(ticks);
+    if (due < 1.0)
+        return 0;
+
+    unsigned int count = due > maxSteps ? maxSteps : static_cast<unsigned int>(due);
+    skipped += (due - count) * step;
+    ticks += count;
+    return count;
+}
+
+float FixedTimestep::alpha(double time, double tickTime) const
+{
+    double alpha = (time - tickTime) / step;
+    return float(alpha < 0.0 ? 0.0 : alpha > 1.0 ? 1.0 : alpha);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Fixed rate simulation clock. Each frame advance() says how many ticks to run
+// to catch up with the time, and alpha() how far the time is past the last
+// tick, to interpolate the drawn state between the last two ticks. Ticks are
+// counted rather than time accumulated, so a run stepped with the same times
+// always runs the same ticks.
+class FixedTimestep
+{
+public:
+    double step;                    // seconds per tick
+    unsigned int maxSteps;          // most ticks run in one advance
+    unsigned long long ticks = 0;   // ticks run so far
+    double skipped = 0.0;           // seconds dropped when more than maxSteps ticks were due
+
+    FixedTimestep(double rate = 120.0, unsigned int maxSteps = 8);
+
+    // Number of ticks to run to reach the time (in seconds). If more than
+    // maxSteps are due the rest are skipped, so a slow frame can't snowball.
+    unsigned int advance(double time);
+
+    // How far the time is past a tick that was due at tickTime, in steps (0 to 1)
+    float alpha(double time, double tickTime) const;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+// Batched translate * rotate * scale kernel behind Maths::modelMatrices and
+// Maths::modelViewMatrices. V wraps V::width floats and holds one object per
+// lane, so the same code builds the scalar, SSE (simd.hpp) and AVX2
+// (mathsavx2.cpp) versions. Everything is in an anonymous namespace so the
+// AVX2 build never leaks into the other translation units.
+//
+// Matrices are column major float[16]. Positions, axes and scales are packed
+// float triples, one per object.
+
+namespace
+{
+
+template <class V>
+void composeTransforms(unsigned int count, const float* positions, const float* axes, const float* angles,
+    const float* scales, const float* view, const float* projection, float* outModelView, float* outMVP)
+{
+    // Splat the view and projection matrices once
+    V viewSplat[16], projectionSplat[16];
+    for (int k = 0; k < 16; k++)
+    {
+        viewSplat[k] = V(view ? view[k] : 0.0f);
+        projectionSplat[k] = V(projection ? projection[k] : 0.0f);
+    }
+
+    const V zero(0.0f), one(1.0f), two(2.0f), half(0.5f);
+    for (unsigned int i = 0; i + V::width <= count; i += V::width)
+    {
+        V px = V::load3(positions + 3 * i), py = V::load3(positions + 3 * i + 1), pz = V::load3(positions + 3 * i + 2);
+        V ax = V::load3(axes + 3 * i), ay = V::load3(axes + 3 * i + 1), az = V::load3(axes + 3 * i + 2);
+        V sx = V::load3(scales + 3 * i), sy = V::load3(scales + 3 * i + 1), sz = V::load3(scales + 3 * i + 2);
+
+        // Unit quaternion of the axis and angle (as Maths::rotate)
+        V inverseLength = one / V::sqrt(ax * ax + ay * ay + az * az);
+        V s, c;
+        V::sincos(V::load(angles + i) * half, s, c);
+        s = s * inverseLength;
+        V qx = s * ax, qy = s * ay, qz = s * az, qw = c;
+
+        // Rotation matrix (as Quaternion::matrix) with the scale applied to its columns
+        V x2 = qx * two, y2 = qy * two, z2 = qz * two;
+        V xx = qx * x2, xy = qx * y2, xz = qx * z2;
+        V yy = qy * y2, yz = qy * z2, zz = qz * z2;
+        V wx = qw * x2, wy = qw * y2, wz = qw * z2;
+
+        V m[3][3] = {
+            { (one - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx },
+            { (xy - wz) * sy, (one - (xx + zz)) * sy, (yz + wx) * sy },
+            { (xz + wy) * sz, (yz - wx) * sz, (one - (xx + yy)) * sz } };
+
+        if (!view)
+        {
+            float* out = outModelView + 16 * i;
+            V::storeColumn(out, m[0][0], m[0][1], m[0][2], zero);
+            V::storeColumn(out + 4, m[1][0], m[1][1], m[1][2], zero);
+            V::storeColumn(out + 8, m[2][0], m[2][1], m[2][2], zero);
+            V::storeColumn(out + 12, px, py, pz, one);
+            continue;
+        }
+
+        // View * model, using the zero fourth row of the model's rotation columns
+        V mv[4][4];
+        for (int col = 0; col < 3; col++)
+            for (int row = 0; row < 4; row++)
+                mv[col][row] = viewSplat[row] * m[col][0] + viewSplat[4 + row] * m[col][1] + viewSplat[8 + row] * m[col][2];
+        for (int row = 0; row < 4; row++)
+            mv[3][row] = viewSplat[row] * px + viewSplat[4 + row] * py + viewSplat[8 + row] * pz + viewSplat[12 + row];
+
+        if (outModelView)
+            for (int col = 0; col < 4; col++)
+                V::storeColumn(outModelView + 16 * i + 4 * col, mv[col][0], mv[col][1], mv[col][2], mv[col][3]);
+
+        // Projection * view * model
+        if (outMVP)
+        {
+            for (int col = 0; col < 4; col++)
+            {
+                V mvp[4];
+                for (int row = 0; row < 4; row++)
+                    mvp[row] = projectionSplat[row] * mv[col][0] + projectionSplat[4 + row] * mv[col][1] +
+                        projectionSplat[8 + row] * mv[col][2] + projectionSplat[12 + row] * mv[col][3];
+                V::storeColumn(outMVP + 16 * i + 4 * col, mvp[0], mvp[1], mvp[2], mvp[3]);
+            }
+        }
+    }
+}
+
+}
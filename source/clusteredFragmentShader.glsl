@@ -0,0 +1,205 @@
+#version 330 core
+
+// Cluster grid (matches LightClusters in clusters.hpp)
+# define tilesX 16
+# define tilesY 12
+# define slices 24
+
+// Inputs
+in vec2 UV;
+in vec3 viewPosition;
+in vec3 viewNormal;
+in vec4 viewTangent;
+
+// Outputs
+out vec3 fragmentColour;
+out vec3 colour;
+
+// Lights in view space, 4 texels each laid out as LightBlock in light.hpp (read
+// as raw bits), the offset and count of each cluster's lights in clusterIndices,
+// and the light indices
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+
+// Uniforms
+uniform sampler2D diffuseMap;
+uniform sampler2D normalMap;
+uniform sampler2D specularMap;
+uniform float ka;
+uniform float kd;
+uniform float ks;
+uniform float Ns;
+uniform vec3 lightColour;
+uniform vec4 clusterParams;     // tiles per pixel (xy), depth slice scale and bias (zw)
+uniform int numGlobalLights;    // directional lights, at the start of clusterLights
+
+// Function prototypes
+vec3 shadeLight(int index);
+
+vec3 pointLight(vec3 lightPosition, vec3 lightColour,
+                float constant, float linear, float quadratic);
+
+vec3 spotLight(vec3 lightPosition, vec3 direction, vec3 lightColour,
+               float cosPhi, float constant, float linear, float quadratic);
+
+vec3 directionalLight(vec3 lightDirection, vec3 lightColour);
+
+// View space fragment position and normal (from the normal map)
+vec3 fragmentPosition;
+vec3 Normal;
+
+void main ()
+{
+    colour = lightColour;
+    fragmentPosition = viewPosition;
+
+    // Move the normal map sample from tangent space to view space
+    vec3 n = normalize(viewNormal);
+    vec3 t = normalize(viewTangent.xyz);
+    t = normalize(t - dot(t, n) * n);
+    // The packed handedness only keeps its sign (GL 3.3 decodes a 2-bit -1 as -1/3)
+    vec3 b = cross(n, t) * (viewTangent.w < 0.0 ? -1.0 : 1.0);
+    Normal = normalize(mat3(t, b, n) * (2.0 * vec3(texture(normalMap, UV)) - 1.0));
+
+    // Directional lights reach every fragment
+    fragmentColour = vec3(0.0, 0.0, 0.0);
+    for (int i = 0; i < numGlobalLights; i++)
+        fragmentColour += shadeLight(i);
+
+    // Then the lights listed for this fragment's cluster
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterParams.xy), ivec2(0), ivec2(tilesX - 1, tilesY - 1));
+    int slice  = clamp(int(floor(log(max(-viewPosition.z, 1e-4)) * clusterParams.z + clusterParams.w)), 0, slices - 1);
+    uvec2 cluster = texelFetch(clusterGrid, (slice * tilesY + tile.y) * tilesX + tile.x).xy;
+    for (uint i = 0u; i < cluster.y; i++)
+        fragmentColour += shadeLight(int(texelFetch(clusterIndices, int(cluster.x + i)).x));
+}
+
+// Calculate the light at clusterLights[index]
+vec3 shadeLight(int index)
+{
+    uvec4 texel0 = texelFetch(clusterLights, 4 * index);       // position, constant
+    uvec4 texel1 = texelFetch(clusterLights, 4 * index + 1);   // colour, linear
+    uvec4 texel2 = texelFetch(clusterLights, 4 * index + 2);   // direction, quadratic
+    uvec4 texel3 = texelFetch(clusterLights, 4 * index + 3);   // cosPhi, type, range
+
+    vec3 lightPosition  = uintBitsToFloat(texel0.xyz);
+    vec3 lightColour    = uintBitsToFloat(texel1.xyz);
+    vec3 lightDirection = uintBitsToFloat(texel2.xyz);
+    float constant      = uintBitsToFloat(texel0.w);
+    float linear        = uintBitsToFloat(texel1.w);
+    float quadratic     = uintBitsToFloat(texel2.w);
+    float cosPhi        = uintBitsToFloat(texel3.x);
+    uint type           = texel3.y;
+
+    // Calculate point light
+    if (type == 1u)
+        return pointLight(lightPosition, lightColour, constant, linear, quadratic);
+
+    // Calculate spotlight
+    if (type == 2u)
+        return spotLight(lightPosition, lightDirection, lightColour,
+                         cosPhi, constant, linear, quadratic);
+
+    // Calculate directional light
+    if (type == 3u)
+        return directionalLight(lightDirection, lightColour);
+
+    return vec3(0.0);
+}
+
+// Calculate point light
+vec3 pointLight(vec3 lightPosition, vec3 lightColour,
+                float constant, float linear, float quadratic)
+{
+    // Object colour
+    vec3 objectColour = vec3(texture(diffuseMap, UV));
+
+    // Ambient reflection
+    vec3 ambient = ka * objectColour;
+
+    // Diffuse reflection
+    vec3 light      = normalize(lightPosition - fragmentPosition);
+    vec3 normal     = normalize(Normal);
+    float cosTheta  = max(dot(normal, light), 0);
+    vec3 diffuse    = kd * lightColour * objectColour * cosTheta;
+
+    // Specular reflection
+    vec3 reflection = - light + 2 * dot(light, normal) * normal;
+    vec3 camera     = normalize(-fragmentPosition);
+    float cosAlpha  = max(dot(camera, reflection), 0);
+    vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
+    specular       *= vec3(texture(specularMap, UV));
+
+    // Attenuation
+    float distance    = length(lightPosition - fragmentPosition);
+    float attenuation = 1.0 / (constant + linear * distance +
+                               quadratic * distance * distance);
+
+    // Fragment colour
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+// Calculate spotlight
+vec3 spotLight(vec3 lightPosition, vec3 lightDirection, vec3 lightColour,
+               float cosPhi, float constant, float linear, float quadratic)
+{
+    // Object colour
+    vec3 objectColour = vec3(texture(diffuseMap, UV));
+
+    // Ambient reflection
+    vec3 ambient = ka * objectColour;
+
+    // Diffuse reflection
+    vec3 light     = normalize(lightPosition - fragmentPosition);
+    vec3 normal    = normalize(Normal);
+    float cosTheta = max(dot(normal, light), 0);
+    vec3 diffuse   = kd * lightColour * objectColour * cosTheta;
+
+    // Specular reflection
+    vec3 reflection = - light + 2 * dot(light, normal) * normal;
+    vec3 camera     = normalize(-fragmentPosition);
+    float cosAlpha  = max(dot(camera, reflection), 0);
+    vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
+    specular       *= vec3(texture(specularMap, UV));
+
+    // Attenuation
+    float distance    = length(lightPosition - fragmentPosition);
+    float attenuation = 1.0 / (constant + linear * distance +
+                               quadratic * distance * distance);
+
+    // Directional light intensity
+    vec3 direction  = normalize(lightDirection);
+    cosTheta        = dot(-light, direction);
+    float delta     = radians(2.0);
+    float intensity = clamp((cosTheta - cosPhi) / delta, 0.0, 1.0);
+
+    // Return fragment colour
+    return (ambient + diffuse + specular) * attenuation * intensity;
+}
+
+// Calculate directional light
+vec3 directionalLight(vec3 lightDirection, vec3 lightColour)
+{
+    // Object colour
+    vec3 objectColour = vec3(texture(diffuseMap, UV));
+
+    // Ambient reflection
+    vec3 ambient = ka * objectColour;
+
+    // Diffuse reflection
+    vec3 light     = normalize(-lightDirection);
+    vec3 normal    = normalize(Normal);
+    float cosTheta = max(dot(normal, light), 0);
+    vec3 diffuse   = kd * lightColour * objectColour * cosTheta;
+
+    // Specular reflection
+    vec3 reflection = - light + 2 * dot(light, normal) * normal;
+    vec3 camera     = normalize(-fragmentPosition);
+    float cosAlpha  = max(dot(camera, reflection), 0);
+    vec3 specular   = ks * lightColour * pow(cosAlpha, Ns);
+    specular       *= vec3(texture(specularMap, UV));
+
+    // Return fragment colour
+    return ambient + diffuse + specular;
+}
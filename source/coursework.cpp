@@ -1,5 +1,13 @@
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -10,40 +18,43 @@
 #include <common/camera.hpp>
 #include <common/model.hpp>
 #include <common/light.hpp>
+#include <common/clusters.hpp>
+#include <common/assets.hpp>
+#include <common/jobs.hpp>
+#include <common/program.hpp>
+#include <common/glstats.hpp>
+#include <common/memstats.hpp>
+#include <common/renderer.hpp>
+#include <common/bullets.hpp>
+#include <common/spatialhash.hpp>
+#include <common/bvh.hpp>
+#include <common/entities.hpp>
+#include <common/frustum.hpp>
+#include <common/headless.hpp>
+#include <common/profiler.hpp>
+#include <common/input.hpp>
+#include <common/timestep.hpp>
 
 #define PI 3.1415926536
 
 // Function prototypes
-void keyboardInput(GLFWwindow* window);
-void mouseInput(GLFWwindow* window);
-
-// Frame timers
-float previousTime = 0.0f;  // time of previous iteration of the loop
-float deltaTime = 0.0f;  // time elapsed since the previous frame
+void keyboardInput(const InputFrame& input, const InputFrame& previous);
+void mouseInput(const InputFrame& input);
+void lightInput(const InputFrame& input, const InputFrame& previous);
+void scriptedInput(float time);
+void submitInput(const InputFrame& input);
+InputFrame takeInput();
+void publishSnapshot(double tickTime);
+double elapsedTime();
+
+// Simulation timers
+float currentTime = 0.0f;  // simulation time of the current tick
+float deltaTime = 0.0f;  // time step of the current tick
 
 // Create camera object
 Camera camera(glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 glm::vec3 previousCameraPosition = camera.eye;
 
-// Object types used to differenciate objects
-enum objectType {
-    OBJECT,
-    ENVINOMENT,
-    INTERACTIVE
-};
-
-// Object struct
-struct Object
-{
-    glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 rotation = glm::vec3(0.0f, 1.0f, 0.0f);
-    glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-    float angle = 0.0f;
-    float width = 0.0f;
-    std::string name;
-    objectType type;
-};
-
 // Player attributes
 glm::vec3 playerPosition = camera.eye;
 glm::vec3 playerDirection = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -52,86 +63,312 @@ glm::vec3 previousPlayerPosition = playerPosition;
 float playerAngle = 0.0f;
 float playerTargetAngle = 360.0f;
 
-// Object vector to collect objects
-std::vector<Object> objects;
+// Entity store holding every object in the scene
+EntityStore entities;
+
+// Broadphase grid of the entities' colliders and the scratch list for its queries
+SpatialHash collisionGrid(1.0f);
+std::vector<unsigned int> nearbyObjects;
 
 // Light object that contains all of the lights
 Light lightSources;
 
-//Bullet object (needs to be outside main to be accessed by key inputs)
-Object bulletObject;
+// Clustered lighting (--forward uses the old shaders, limited to maxLights)
+bool forwardLighting = false;
+
+// Extra point and spot lights scattered around the room (--lights N)
+unsigned int extraLights = 0;
+
+// Spinning crates on the floor (--objects N), to load the frame pipeline
+unsigned int extraObjects = 0;
+
+// Bullet pool (needs to be outside main to be accessed by key inputs)
+BulletPool bullets(4096, 3.0f, 10.5f);
 glm::vec3 bulletDirection = glm::vec3(1.0f, 0.0f, 0.0f);
+glm::vec3 bulletScale = glm::vec3(0.05f, 0.05f, 0.05f);
+float bulletRadius = 0.05f;
+
+// Player collision capsule (from a step above the floor to just above the
+// camera), swept against the triangles of the objects and the room
+float playerRadius = 0.3f;
+float playerFeet = -1.0f;
+float playerStep = 0.1f;
+float playerHead = 0.3f;
+
+// Input of the last tick, so the toggles act once per press
+InputFrame previousTickInput;
+
+// Stress mode (--stress N fires N bullets every tick)
+unsigned int stressBullets = 0;
+
+// Headless mode (--headless N draws N frames offscreen with a scripted camera,
+// --dump PREFIX writes every --dump-every Nth frame to PREFIX0000.ppm and so on)
+unsigned int headlessFrames = 0;
+const char* dumpPrefix = nullptr;
+unsigned int dumpEvery = 1;
+
+// Profiling (--profile PATH prints the scope times and writes a chrome://tracing file on exit)
+const char* profilePath = nullptr;
+
+// Input logs (--record PATH saves the keys and cursor movement of every frame,
+// --replay PATH plays them back headless with the fixed step) and the headless
+// frame statistics as JSON (--stats-json PATH)
+const char* recordPath = nullptr;
+const char* replayPath = nullptr;
+const char* statsPath = nullptr;
+InputLog inputLog;
+
+// State copied after each simulation tick, the frames draw a blend of the last two
+struct SimSnapshot
+{
+    double tickTime = 0.0;      // time the tick was due
+    Camera camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+    glm::vec3 playerPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+    float playerAngle = 0.0f;
+    bool teapotTrigger = false;
+    bool playerCollided = false;
+    EntityStore entities;
+    BulletPool bullets = BulletPool(0, 0.0f, 0.0f);
+    unsigned int pairsTested = 0;
+    unsigned int pairsFound = 0;
+};
+
+// Fixed rate simulation (--tick-rate N ticks a second, --sim-thread runs the
+// ticks on their own thread so the frame rate doesn't hold them up). The mutex
+// guards the snapshots and the input waiting for the next tick. The ticks never
+// touch the lights, the light keys are handled on the main thread as they are
+// polled (before the frame's build job reads the lights).
+double tickRate = 120.0;
+bool threadedSimulation = false;
+std::mutex simulationMutex;
+SimSnapshot latestSnapshot;
+SimSnapshot previousSnapshot;
+InputFrame pendingInput;
+uint16_t pendingPresses = 0;
+
+// Everything the main thread needs to draw a frame, built in jobs. The main
+// thread draws one packet while the jobs build the other
+// (--no-pipeline builds and draws each frame's packet in turn). The main thread
+// reads only the packet, never the simulation state the jobs are changing.
+struct RenderPacket
+{
+    float alpha = 0.0f;             // how far the frame is past the last tick, in ticks
+    Camera camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+    Frustum frustum;
+    bool drawPlayer = false;
+    glm::mat4 playerModel;
+    Light lights;                   // lightSources with the flashlight moved to the camera
+    LightClusters clusters;
+    InstanceList objects;           // the entities in view and the bullets, by material
+    bool playerCollided = false;
+
+    // Stats
+    unsigned int culledTested = 0;
+    unsigned int culledVisible = 0;
+    unsigned int pairsTested = 0;
+    unsigned int pairsFound = 0;
+    unsigned int numBullets = 0;
+    size_t bulletBytes = 0;
+    unsigned int numEntities = 0;
+};
+
+// A range of the entities blended, culled and queued by one job
+struct BuildChunk
+{
+    unsigned int begin = 0;
+    unsigned int end = 0;
+    Frustum frustum;
+    std::vector<unsigned int> visible;
+    InstanceList instances;
+};
+
+// Whether a frame's packet builds while the last one is drawn (--no-pipeline)
+bool pipelined = true;
 
 // Game variables
 bool playerCollided = false;
 bool teapotTrigger = false;
+std::atomic<bool> quitRequested(false);
+unsigned int bulletsFired = 0;
 float tick;
 float cameraBaseY;
 
-int main(void)
+int main(int argc, char** argv)
 {
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "--stress") == 0)
+            stressBullets = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--lights") == 0)
+            extraLights = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--objects") == 0)
+            extraObjects = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--headless") == 0)
+            headlessFrames = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--dump") == 0)
+            dumpPrefix = argv[i + 1];
+        if (strcmp(argv[i], "--dump-every") == 0)
+            dumpEvery = std::max(atoi(argv[i + 1]), 1);
+        if (strcmp(argv[i], "--profile") == 0)
+            profilePath = argv[i + 1];
+        if (strcmp(argv[i], "--record") == 0)
+            recordPath = argv[i + 1];
+        if (strcmp(argv[i], "--replay") == 0)
+            replayPath = argv[i + 1];
+        if (strcmp(argv[i], "--stats-json") == 0)
+            statsPath = argv[i + 1];
+        if (strcmp(argv[i], "--tick-rate") == 0)
+            tickRate = std::max(atof(argv[i + 1]), 1.0);
+        if (strcmp(argv[i], "--light-cutoff") == 0)
+            lightSources.cutoff = std::max(static_cast<float>(atof(argv[i + 1])), 1e-6f);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--forward") == 0)
+            forwardLighting = true;
+        if (strcmp(argv[i], "--sim-thread") == 0)
+            threadedSimulation = true;
+        if (strcmp(argv[i], "--no-pipeline") == 0)
+            pipelined = false;
+    }
+
+    // A replay runs headless for as many frames as were recorded
+    if (replayPath != nullptr)
+    {
+        if (!inputLog.load(replayPath))
+            return -1;
+        headlessFrames = static_cast<unsigned int>(inputLog.frames.size());
+        recordPath = nullptr;
+    }
+
+    // Start the clock
+    elapsedTime();
+    bool headless = headlessFrames > 0;
+
+    // Headless runs tick in step with their fixed frame times to stay repeatable
+    if (headless && threadedSimulation)
+    {
+        printf("--sim-thread is ignored in headless mode\n");
+        threadedSimulation = false;
+    }
+
     // =========================================================================
     // Window creation - you shouldn't need to change this code
     // -------------------------------------------------------------------------
-    // Initialise GLFW
-    if (!glfwInit())
+    GLFWwindow* window = NULL;
+    OffscreenContext offscreen;
+    if (headless)
     {
-        fprintf(stderr, "Failed to initialize GLFW\n");
-        getchar();
-        return -1;
+        // Headless mode draws into a framebuffer of the window's size
+        if (!offscreen.create(1024, 768))
+            return -1;
     }
+    else
+    {
+        // Initialise GLFW
+        if (!glfwInit())
+        {
+            fprintf(stderr, "Failed to initialize GLFW\n");
+            getchar();
+            return -1;
+        }
 
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // Open a window and create its OpenGL context
-    GLFWwindow* window;
-    window = glfwCreateWindow(1024, 768, "Graphics Coursework", NULL, NULL);
-
-    if (window == NULL) {
-        fprintf(stderr, "Failed to open GLFW window.\n");
-        getchar();
-        glfwTerminate();
-        return -1;
+        glfwWindowHint(GLFW_SAMPLES, 4);
+        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Open a window and create its OpenGL context
+        window = glfwCreateWindow(1024, 768, "Graphics Coursework", NULL, NULL);
+
+        if (window == NULL) {
+            fprintf(stderr, "Failed to open GLFW window.\n");
+            getchar();
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
     }
-    glfwMakeContextCurrent(window);
 
     // Initialize GLEW
     glewExperimental = true; // Needed for core profile
     if (glewInit() != GLEW_OK) {
         fprintf(stderr, "Failed to initialize GLEW\n");
-        getchar();
-        glfwTerminate();
+        if (!headless)
+        {
+            getchar();
+            glfwTerminate();
+        }
         return -1;
     }
     // -------------------------------------------------------------------------
     // End of window creation
     // =========================================================================
 
+    // GLEW can leave a GL_INVALID_ENUM behind on core contexts
+    while (glGetError() != GL_NO_ERROR) {}
+    if (headless && !offscreen.createFramebuffer())
+        return -1;
+
+    // Start profiling once there is a context for the GPU queries
+    if (profilePath != nullptr)
+        Profiler::enable();
+
     // Enable depth test
     glEnable(GL_DEPTH_TEST);
 
     // Use back face culling
     glEnable(GL_CULL_FACE);
 
-    // Ensure we can capture keyboard inputs
-    glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+    if (!headless)
+    {
+        // Ensure we can capture keyboard inputs
+        glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
-    // Capture mouse inputs
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwPollEvents();
-    glfwSetCursorPos(window, 1024 / 2, 768 / 2);
+        // Capture mouse inputs
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwPollEvents();
+        glfwSetCursorPos(window, 1024 / 2, 768 / 2);
+    }
 
     // Compile shader program
-    unsigned int shaderID;
-    shaderID = LoadShaders("vertexShader.glsl", "fragmentShader.glsl");
+    double windowTime = elapsedTime();
+    ShaderProgram program;
+    bool loaded = forwardLighting ? program.load("vertexShader.glsl", "fragmentShader.glsl") :
+        program.load("vertexShader.glsl", "clusteredFragmentShader.glsl");
+    if (!loaded)
+    {
+        if (!headless)
+        {
+            getchar();
+            glfwTerminate();
+        }
+        return -1;
+    }
+    double shaderTime = elapsedTime() - windowTime;
 
     // Activate shader
-    glUseProgram(shaderID);
+    glUseProgram(program.id);
+
+    // Camera matrices are sent once per frame in a uniform buffer
+    UniformBuffer cameraBuffer;
+    cameraBuffer.create(sizeof(CameraBlock), ShaderProgram::cameraBinding);
+
+    // Count the GL calls and heap allocations made each frame
+    GLStats::install();
+    double statsTime = elapsedTime();
+    unsigned int statsFrames = 0;
+    unsigned int stressFired = 0;
+
+    // Objects sharing a mesh and material are drawn with one instanced call
+    InstancedRenderer renderer;
+
+    // Read the models and textures in jobs while the main thread uploads whatever
+    // has finished (the jobs later simulate, cull and batch the frames)
+    JobSystem jobSystem;
+    AssetCache::global().beginAsyncLoading(jobSystem);
 
     // Load models
     Model lightSphere("../assets/sphere.obj");
@@ -141,6 +378,7 @@ int main(void)
     Model bullet("../assets/bullet.obj");
     Model walls("../assets/wall.obj");
     Model floor("../assets/floor.obj");
+    Model crate("../assets/cube.obj");
 
     // Load the textures
     lightSphere.addTexture("../assets/LightSource.png", "diffuse");
@@ -171,6 +409,12 @@ int main(void)
     floor.addTexture("../assets/neutral_normal.png", "normal");
     floor.addTexture("../assets/neutral_specular.png", "specular");
 
+    crate.addTexture("../assets/crate.jpg", "diffuse");
+    crate.addTexture("../assets/neutral_normal.png", "normal");
+    crate.addTexture("../assets/neutral_specular.png", "specular");
+
+    AssetCache::global().finishLoading();
+
     // Define object lighting properties
     float ambient = 0.2f;
 
@@ -209,6 +453,22 @@ int main(void)
     floor.ks = 1.0f;
     floor.Ns = 20.0f;
 
+    crate.ka = ambient;
+    crate.kd = 0.7f;
+    crate.ks = 1.0f;
+    crate.Ns = 20.0f;
+
+    // Print the GPU memory used by each model
+    lightSphere.memoryReport();
+    teapot.memoryReport();
+    teapotGun.memoryReport();
+    catSphere.memoryReport();
+    bullet.memoryReport();
+    walls.memoryReport();
+    floor.memoryReport();
+    crate.memoryReport();
+    AssetCache::global().report();
+
     // Add light sources
 
     lightSources.addSpotLight(glm::vec3(0.0f, 5.0f, 0.0f),          // position
@@ -220,6 +480,20 @@ int main(void)
                                     glm::vec3(1.0f, 1.0f, 1.0f));  // colour
     
     lightSources.lightSources[1].enabled = false;
+
+    // Small coloured lights around the room, every fourth one a spotlight facing down
+    for (unsigned int i = 0; i < extraLights; i++)
+    {
+        glm::vec3 position = glm::vec3(20.0f * rand() / RAND_MAX - 10.0f, 2.3f * rand() / RAND_MAX - 0.8f,
+                                       20.0f * rand() / RAND_MAX - 10.0f);
+        glm::vec3 colour = glm::vec3(float(rand()) / RAND_MAX, float(rand()) / RAND_MAX, float(rand()) / RAND_MAX);
+        colour /= std::max(colour.r, std::max(colour.g, colour.b));
+        if (i % 4 == 3)
+            lightSources.addSpotLight(position, glm::vec3(0.0f, -1.0f, 0.0f), colour,
+                                      1.0f, 0.7f, 20.0f, std::cos(Maths::radians(30.0f)));
+        else
+            lightSources.addPointLight(position, colour, 1.0f, 0.7f, 20.0f);
+    }
     
     // Flashlight to be enabled after the teapot has been picked up;
     //LightSource flashLight;
@@ -235,22 +509,24 @@ int main(void)
     //flashLight.enabled = false;
     //lightSources.lightSources.push_back(flashLight);
 
-    // Add objects to objects vector
+    // Add objects to the entity store
     Object object;
 
     // staticTeapot
-    object.name = "staticTeapot";
+    object.tag = STATIC_TEAPOT;
+    object.model = &teapot;
     object.type = OBJECT;
     object.position = glm::vec3(0.0f, 0.0f, 0.0f);
     object.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
     object.angle = 0.0f;
     object.width = 1.0f;
     object.scale = glm::vec3(0.5f, 0.5f, 0.5f);
-    objects.push_back(object);
+    entities.spawn(object);
 
     // <Room>
     // Walls
-    object.name = "walls";
+    object.tag = WALLS;
+    object.model = &walls;
     object.type = ENVINOMENT;
     //object.position = glm::vec3(0.0f, -1.0f, 0.0f);
     object.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
@@ -258,7 +534,7 @@ int main(void)
     float wallAngle = 0.0f;
     glm::vec3 xWallPosition = glm::vec3(-3.5f * object.scale.x, -1.0f, 0.0f);
     glm::vec3 zWallPosition = glm::vec3(0.0f, -1.0f, -3.5f * object.scale.z);
-    glm::vec3 wallPosition = glm::vec3(xWallPosition.x, 0.0f, zWallPosition.z); // Positions used for "collision"
+    glm::vec3 wallPosition = glm::vec3(xWallPosition.x, 0.0f, zWallPosition.z); // Corner of the room, bounds the bullets
     for (unsigned int i = 0; i < 4; i++)
     {
         object.angle = Maths::radians(wallAngle);
@@ -272,29 +548,49 @@ int main(void)
             object.position = xWallPosition;
             xWallPosition.x *= -1.0f;
         }
-        objects.push_back(object);
+        entities.spawn(object);
         wallAngle += 90.0f;
         
     }
 
     // Floor
-    object.name = "floor";
+    object.tag = FLOOR;
+    object.model = &floor;
     object.position = glm::vec3(0.0f, -1.0f, 0.0f);
     object.angle = 0.0f;
     object.width = 0.0f;
-    objects.push_back(object);
+    entities.spawn(object);
 
     // Roof
-    object.name = "roof";
+    object.tag = ROOF;
     object.position = glm::vec3(0.0f, 20.0f, 0.0f);
     object.rotation = glm::vec3(0.0f, 0.0f, 1.0f);
     object.angle = Maths::radians(180.0f);
-    objects.push_back(object);
+    entities.spawn(object);
     // </Room>
+
+    // Crates in a grid over the floor, spinning at a few different speeds (they
+    // are only there to draw, the player starts among them)
+    unsigned int crateColumns = static_cast<unsigned int>(ceilf(sqrtf(float(extraObjects))));
+    float crateSpacing = 19.0f / std::max(crateColumns, 1u);
+    object.tag = CRATE;
+    object.model = &crate;
+    object.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+    object.scale = glm::vec3(0.3f * crateSpacing);
+    object.width = 0.0f;
+    object.type = NO_COLLIDER;
+    entities.reserve(entities.size() + extraObjects);
+    for (unsigned int i = 0; i < extraObjects; i++)
+    {
+        object.position = glm::vec3((i % crateColumns + 0.5f) * crateSpacing - 9.5f, -1.0f + object.scale.y,
+                                    (i / crateColumns + 0.5f) * crateSpacing - 9.5f);
+        object.angle = float(i);
+        object.velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+        entities.spawn(object);
+    }
     
     // Player object used for the player model 
     Object player;
-    player.name = "player";
     player.position = playerPosition;
     player.rotation = playerRotation;
     player.scale = glm::vec3(0.5f, 0.5f, 0.5f);
@@ -302,34 +598,50 @@ int main(void)
 
     // Teapot held by the player
     Object playerGun;
-    playerGun.name = "teapotGun";
+    playerGun.tag = TEAPOT_GUN;
+    playerGun.model = &teapotGun;
     playerGun.position = camera.eye + glm::vec3(1.0f, 0.0f, 1.0f);
     playerGun.rotation = glm::vec3(0.0f, -1.0f, 0.0f);
     playerGun.angle = 0.0f;
     playerGun.scale = glm::vec3(0.2f, 0.2f, 0.2f);
-
-    // Bullet
-    bulletObject.name = "bullet";
-    bulletObject.position = camera.eye;
-    bulletObject.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
-    bulletObject.angle = 0.0f;
-    bulletObject.width = 0.4f;
-    bulletObject.scale = glm::vec3(0.05f, 0.05f, 0.05f);
-    //objects.push_back(bulletObject);
-
-    std::cout << "Load time: " << glfwGetTime() * 1000 << "ms" << std::endl;
-
-    // Render loop
-    while (!glfwWindowShouldClose(window))
+    playerGun.type = NO_COLLIDER;
+
+    // Bullets are culled once they leave the room
+    bullets.bound = -wallPosition.x;
+
+    const AssetLoadTimes& loadTimes = AssetCache::global().loadTimes;
+    std::cout << "Load time: " << elapsedTime() * 1000 << "ms (window " << windowTime * 1000
+        << "ms, shaders " << shaderTime * 1000 << "ms, assets " << loadTimes.wall * 1000
+        << "ms on " << jobSystem.size() << " threads: meshes " << loadTimes.meshLoad * 1000
+        << "ms, textures " << loadTimes.textureDecode * 1000 << "ms, uploads "
+        << loadTimes.upload * 1000 << "ms)" << std::endl;
+
+    // Headless frame times, for the summary at the end
+    std::vector<double> frameTimes;
+    frameTimes.reserve(headlessFrames);
+    unsigned int frame = 0;
+
+    // One simulation tick: input, movement, the entity and bullet update and
+    // collision, then the state is copied for drawing
+    FixedTimestep timestep(tickRate);
+    auto simulate = [&](unsigned long long index)
     {
-        // Update timer
-        float time = glfwGetTime();
-        deltaTime = time - previousTime;
-        previousTime = time;
+        double time = index * timestep.step;
+        currentTime = float(time);
+        deltaTime = float(timestep.step);
 
         // Get inputs
-        keyboardInput(window);
-        mouseInput(window);
+        ProfileScope inputScope("Input");
+        if (headless && replayPath == nullptr)
+            scriptedInput(currentTime);
+        else
+        {
+            InputFrame input = takeInput();
+            keyboardInput(input, previousTickInput);
+            mouseInput(input);
+            previousTickInput = input;
+        }
+        inputScope.stop();
 
         if (camera.isJumping) {
             tick += 1.0f * deltaTime;
@@ -344,153 +656,237 @@ int main(void)
             }
         }
 
-        // Clear the window
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Calculate view and projection matrices
-        camera.target = camera.eye + camera.front;
-        camera.quaternionCamera();
-
-        // Activate shader
-        glUseProgram(shaderID);
-
-        // Send light source properties to the shader
-        lightSources.toShader(shaderID, camera.view);
-        
-        // Send view matrix to the shader
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "V"), 1, GL_FALSE, &camera.view[0][0]);
-
-
-        // Only draw the player model if in 3rd person
+        // The third person camera follows the player
         if (camera.isThird == true)
-        {
             camera.eye = playerPosition;
 
-            // Drawing the player model
-            //glm::normalize(playerDirection);
-            glm::mat4 translate = Maths::translate(playerPosition);
-            glm::mat4 scale = Maths::scale(player.scale);
-            glm::mat4 rotate = Maths::rotate(playerAngle, playerRotation);
-            glm::mat4 model = translate * rotate * scale;
-            glm::mat4 MV = camera.view * model;
-            glm::mat4 MVP = camera.projection * MV;
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, &MVP[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MV"), 1, GL_FALSE, &MV[0][0]);
-            catSphere.draw(shaderID);
-        }
-
+        // Calculate the camera orientation and vectors
+        camera.target = camera.eye + camera.front;
+        camera.quaternionCamera();
 
         // =============================================================
         // OBJECT LOOP
         // =============================================================
-        for (unsigned int i = 0; i < static_cast<unsigned int>(objects.size()); i++)
+        ProfileScope updateScope("Update");
+        for (unsigned int i = 0; i < entities.size(); i++)
         {
-            if (&objects[i] == NULL)
-            {
-                printf("Object at %u not found\n", i);
-                continue;
-            }
-
             // modifying object properties during runtime
-            if (objects[i].name == "staticTeapot")
+            if (entities.tags[i] == STATIC_TEAPOT)
             {
-                objects[i].position.y = 0.5 * Maths::square(sinf(glfwGetTime() * 2));
-                objects[i].angle = glfwGetTime() * 2;
+                entities.positions[i].y = 0.5 * Maths::square(sinf(currentTime * 2));
+                entities.angles[i] = currentTime * 2;
             }
 
-            if (objects[i].name == "teapotGun")
+            if (entities.tags[i] == TEAPOT_GUN)
             {
-                objects[i].position = camera.eye + Maths::normalise(camera.front) * glm::vec3(1.0f, 0.0f, 1.0f);
-                //objects[i].rotation = playerRotation;
-                objects[i].angle = camera.yaw;
-                //objects[i].position = glm::vec3(1.0f + cosf(Maths::radians(camera.yaw)), 0.0f, 1.0f + sinf(Maths::radians(camera.yaw)));
+                entities.positions[i] = camera.eye + Maths::normalise(camera.front) * glm::vec3(1.0f, 0.0f, 1.0f);
+                //entities.rotations[i] = playerRotation;
+                entities.angles[i] = camera.yaw;
+                //entities.positions[i] = glm::vec3(1.0f + cosf(Maths::radians(camera.yaw)), 0.0f, 1.0f + sinf(Maths::radians(camera.yaw)));
             }
 
-            if (objects[i].name == "bullet") 
-            {
-                objects[i].position += bulletDirection * 20.0f * deltaTime;
-            }
+            if (entities.tags[i] == CRATE)
+                entities.angles[i] += (0.5f + (i % 7) * 0.25f) * deltaTime;
+        }
 
-            // Calculate model matrix
-            glm::mat4 translate = Maths::translate(objects[i].position);
-            glm::mat4 scale = Maths::scale(objects[i].scale);
-            glm::mat4 rotate = Maths::rotate(objects[i].angle, objects[i].rotation);
-            glm::mat4 model = translate * rotate * scale;
-
-            // Send the MVP and MV matrices to the vertex shader
-            glm::mat4 MV = camera.view * model;
-            glm::mat4 MVP = camera.projection * MV;
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MVP"), 1, GL_FALSE, &MVP[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "MV"), 1, GL_FALSE, &MV[0][0]);
-
-            // Draw the model
-            if (objects[i].name == "staticTeapot")
-                teapot.draw(shaderID);
-            if (objects[i].name == "teapotGun")
-                teapotGun.draw(shaderID);
-            if (objects[i].name == "bullet")
-                bullet.draw(shaderID);
-            if (objects[i].name == "walls")
-                walls.draw(shaderID);
-            if (objects[i].name == "floor" || objects[i].name == "roof")
-                floor.draw(shaderID);
-
-            // Check for collision (ignoring y bcs I am lazy :D) none if in free cam
-            if(!camera.isFreeCam)
+        // Stress mode: spray bullets in every direction from the camera
+        for (unsigned int i = 0; i < stressBullets; i++)
+        {
+            float angle = (stressFired++ % 360) * 2.39996f;   // golden angle
+            glm::vec3 direction = glm::vec3(cosf(angle), 0.0f, sinf(angle));
+            bullets.fire(camera.eye + direction * 0.5f, direction * 20.0f, -angle);
+        }
+
+        // Move the entities and the bullets
+        entities.move(deltaTime);
+        bullets.update(deltaTime);
+
+        // Calculate the model matrices (in jobs of 1024 entities) and keep the object
+        // colliders in the broadphase grid up to date
+        jobSystem.parallelFor(entities.size(), 1024, [&](unsigned int begin, unsigned int end)
+        {
+            entities.updateTransforms(begin, end);
+        });
+        entities.updateColliders(collisionGrid);
+        updateScope.stop();
+
+        // Bullets stop when they hit the triangles of an object or the room during this tick's step
+        ProfileScope collisionScope("Collision");
+        RayHit hit;
+        for (unsigned int i = bullets.size(); i > 0; i--)
+        {
+            glm::vec3 end = bullets.positions[i - 1];
+            glm::vec3 step = bullets.velocities[i - 1] * deltaTime;
+            collisionGrid.query(end, bulletRadius + Maths::length(step), nearbyObjects);
+            for (unsigned int object : nearbyObjects)
             {
-                switch (objects[i].type)
+                if (entities.sphereSweep(object, end - step, end, bulletRadius, hit))
                 {
-                case OBJECT:
-                    glm::vec3 positionDiff = glm::vec3(camera.eye.x, 0.0f, camera.eye.z) - glm::vec3(objects[i].position.x, 0.0f, objects[i].position.z);
-                    if (Maths::length(positionDiff) <= objects[i].width)
-                    {
-                        playerCollided = true;
-                        //camera.eye += glm::vec3(Maths::normalise(positionDiff).x, 0.0f, Maths::normalise(positionDiff).z) * 0.1f; // Moving the camera back (rather than resetiing the position)
-                        camera.eye = previousCameraPosition;
-                        playerPosition = previousPlayerPosition;
-                    }
-                    else if (Maths::length(positionDiff) > objects[i].width)
-                    {
-                        playerCollided = false;
-                    }
-
-                    if (playerCollided)
-                    {
-                        if (objects[i].name == "staticTeapot")
-                        {
-                            teapotTrigger = true;
-                            objects[i] = playerGun;
-                        }
-                    }
+                    bullets.remove(i - 1);
                     break;
                 }
+            }
+        }
 
-                if (camera.eye.x - 0.5 < wallPosition.x || camera.eye.z - 0.5 < wallPosition.z || camera.eye.x + 0.5 > -wallPosition.x || camera.eye.z + 0.5 > -wallPosition.z)
-                {
-                    playerCollided = true;
-                    camera.eye = previousCameraPosition;
-                    playerPosition = previousPlayerPosition;
-                }
-                else
+        // Check for collision, none if in free cam
+        if (!camera.isFreeCam)
+        {
+            // Objects and walls whose triangles the player's capsule touches
+            playerCollided = false;
+            collisionGrid.query(camera.eye, playerRadius, nearbyObjects);
+            for (unsigned int i : nearbyObjects)
+            {
+                glm::vec3 feet = glm::vec3(camera.eye.x, playerFeet + playerStep + playerRadius, camera.eye.z);
+                glm::vec3 head = glm::vec3(camera.eye.x, camera.eye.y + playerHead, camera.eye.z);
+                if (!entities.sphereSweep(i, feet, head, playerRadius, hit))
+                    continue;
+
+                playerCollided = true;
+                camera.eye = previousCameraPosition;
+                playerPosition = previousPlayerPosition;
+
+                if (entities.tags[i] == STATIC_TEAPOT)
                 {
-                    playerCollided = false;
+                    teapotTrigger = true;
+                    entities.set(i, playerGun);
                 }
             }
         }
+        collisionScope.stop();
         // =============================================================
         // END OF OBJECT LOOP
         // =============================================================
 
-        //std::cout << camera.eye << std::endl;
-        //std::cout << playerCollided << std::endl;
+        // Update previous positions
+        previousCameraPosition = camera.eye;
+        previousPlayerPosition = playerPosition;
 
-        if (playerCollided) {
-            
+        // Copy the state for drawing
+        publishSnapshot(time + timestep.skipped);
+        collisionGrid.resetCounts();
+    };
+
+    // Draw the starting state until the first tick
+    entities.updateTransforms();
+    entities.updateColliders(collisionGrid);
+    publishSnapshot(0.0);
+    publishSnapshot(0.0);
+
+    // With --sim-thread the ticks run on their own thread at the tick rate
+    std::atomic<bool> stopSimulation(false);
+    std::thread simulationThread;
+    if (threadedSimulation)
+    {
+        simulationThread = std::thread([&]
+        {
+            while (!stopSimulation)
+            {
+                unsigned int count = timestep.advance(elapsedTime());
+                for (unsigned int i = count; i > 0; i--)
+                    simulate(timestep.ticks - i + 1);
+
+                // Sleep until the next tick is due
+                double wait = timestep.skipped + (timestep.ticks + 1) * timestep.step - elapsedTime();
+                if (wait > 0.0)
+                    std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            }
+        });
+    }
+
+    // Render packets. Jobs build a frame's packet (the ticks due, the blend of
+    // the last two, culling and the instance lists) while the main thread draws
+    // the packet of the frame before, so a frame costs the longer of the two
+    // rather than both. Only the build job and the chunk, light and gather jobs
+    // it starts touch the simulation state and drawState. buildCounter counts
+    // the whole build, chunkCounter the chunk and light jobs the gather waits on.
+    RenderPacket packets[2];
+    unsigned int drawIndex = 0;
+    SimSnapshot drawState;
+    SimSnapshot previousState;
+    std::vector<BuildChunk> chunks;
+    JobCounter buildCounter;
+    JobCounter chunkCounter;
+
+    // Blend, cull and queue a range of the entities
+    auto buildChunk = [&](RenderPacket& packet, BuildChunk& chunk)
+    {
+        ProfileScope scope("Build chunk");
+        drawState.entities.interpolate(previousState.entities, packet.alpha, chunk.begin, chunk.end);
+        chunk.frustum = packet.frustum;
+        chunk.frustum.resetCounts();
+        chunk.frustum.cullSpheres(chunk.end - chunk.begin, drawState.entities.bounds.data() + chunk.begin,
+            chunk.visible);
+        for (unsigned int& i : chunk.visible)
+            i += chunk.begin;
+        chunk.instances.clear();
+        drawState.entities.submit(chunk.instances, chunk.visible);
+    };
+
+    // Gather the chunks into the packet once they are done (bullets are drawn
+    // where they were alpha of a step before the last tick)
+    auto gather = [&](RenderPacket& packet)
+    {
+        ProfileScope scope("Gather");
+        packet.objects.clear();
+        for (BuildChunk& chunk : chunks)
+        {
+            packet.objects.append(chunk.instances);
+            packet.culledTested += chunk.frustum.tested;
+            packet.culledVisible += chunk.frustum.visible;
         }
+        drawState.bullets.submit(packet.objects, bullet, bulletScale, (packet.alpha - 1.0f) * float(timestep.step));
+    };
 
-        // Draw light sources
-        if (teapotTrigger)
+    // Run the ticks due by the time, then fill a packet with the state blended
+    // between the last two ticks
+    auto buildPacket = [&](RenderPacket& packet, double time)
+    {
+        ProfileScope buildScope("Build packet");
+
+        // Run the ticks due by now (unless the simulation thread runs them)
+        if (!threadedSimulation)
+        {
+            unsigned int count = timestep.advance(time);
+            for (unsigned int i = count; i > 0; i--)
+                simulate(timestep.ticks - i + 1);
+        }
+
+        // Blend the last two ticks by how far the frame is past the last one
+        {
+            std::lock_guard<std::mutex> lock(simulationMutex);
+            drawState = latestSnapshot;
+            previousState = previousSnapshot;
+        }
+        packet.alpha = timestep.alpha(time, drawState.tickTime);
+        Camera& drawCamera = packet.camera;
+        drawCamera = drawState.camera;
+        drawCamera.eye = glm::mix(previousState.camera.eye, drawCamera.eye, packet.alpha);
+        drawCamera.orientation = Maths::SLERP(previousState.camera.orientation, drawCamera.orientation, packet.alpha);
+        drawCamera.calculateOrientationMatrices();
+
+        // Calculate the view frustum
+        packet.frustum.update(drawCamera.projection * drawCamera.view);
+        packet.frustum.resetCounts();
+
+        // Only draw the player model if in 3rd person (and in view)
+        packet.drawPlayer = false;
+        if (drawCamera.isThird == true)
+        {
+            glm::vec3 position = glm::mix(previousState.playerPosition, drawState.playerPosition, packet.alpha);
+            glm::mat4 translate = Maths::translate(position);
+            glm::mat4 scale = Maths::scale(player.scale);
+            glm::mat4 rotate = Maths::rotate(drawState.playerAngle, playerRotation);
+            packet.playerModel = translate * rotate * scale;
+            const MeshBounds& playerBounds = catSphere.bounds();
+            glm::vec3 playerCentre = glm::vec3(packet.playerModel * glm::vec4(playerBounds.centre, 1.0f));
+            float playerScale = std::max(player.scale.x, std::max(player.scale.y, player.scale.z));
+            packet.drawPlayer = packet.frustum.sphereVisible(playerCentre, playerBounds.radius * playerScale);
+        }
+
+        // The spotlight becomes the player's flashlight once the teapot is picked up
+        packet.lights.lightSources = lightSources.lightSources;
+        packet.lights.cutoff = lightSources.cutoff;
+        if (drawState.teapotTrigger)
         {
             // This is a better way  to do it vv
             // Enable player flashlight
@@ -505,21 +901,311 @@ int main(void)
             //    lightSources.lightSources[i].enabled = false;
             //}
             // Easier (bad) way to swap to the flashlight by moving the spotlight
-            lightSources.lightSources[0].position = camera.eye;
-            lightSources.lightSources[0].direction = camera.front;
-            lightSources.lightSources[0].cosPhi = Maths::radians(40.0f);
-            lightSources.lightSources[0].drawSource = false;
+            packet.lights.lightSources[0].position = drawCamera.eye;
+            packet.lights.lightSources[0].direction = drawCamera.front;
+            packet.lights.lightSources[0].cosPhi = Maths::radians(40.0f);
+            packet.lights.lightSources[0].drawSource = false;
         }
 
-        lightSources.draw(shaderID, camera.view, camera.projection, lightSphere);
+        // With clustering each cluster of the view frustum gets the list of lights reaching it
+        if (!forwardLighting)
+        {
+            packet.lights.toClusters(drawCamera.view, packet.clusters);
+            packet.clusters.setProjection(drawCamera.projection, drawCamera.near, drawCamera.far, 1024.0f, 768.0f);
+        }
 
-        // Update previous positions
-        previousCameraPosition = camera.eye;
-        previousPlayerPosition = playerPosition;
+        packet.culledTested = packet.frustum.tested;
+        packet.culledVisible = packet.frustum.visible;
+        packet.pairsTested = drawState.pairsTested;
+        packet.pairsFound = drawState.pairsFound;
+        packet.numBullets = drawState.bullets.size();
+        packet.bulletBytes = drawState.bullets.memoryBytes();
+        packet.numEntities = drawState.entities.size();
+        packet.playerCollided = drawState.playerCollided;
+
+        // Split the entities into chunks, the lights are assigned alongside
+        unsigned int count = drawState.entities.size();
+        unsigned int numChunks = std::max(std::min((count + 1023) / 1024, jobSystem.size() * 4), 1u);
+        chunks.resize(numChunks);
+        for (unsigned int i = 0; i < numChunks; i++)
+        {
+            chunks[i].begin = count * i / numChunks;
+            chunks[i].end = count * (i + 1) / numChunks;
+        }
+        if (!forwardLighting)
+            jobSystem.run([&] { packet.clusters.assign(&jobSystem); }, &chunkCounter);
+        for (unsigned int i = 0; i < numChunks; i++)
+            jobSystem.run([&, i] { buildChunk(packet, chunks[i]); }, &chunkCounter);
+        jobSystem.runAfter(chunkCounter, [&] { gather(packet); }, &buildCounter);
+    };
+
+    // The first frame draws the starting state
+    jobSystem.run([&] { buildPacket(packets[0], 0.0); }, &buildCounter);
+    jobSystem.wait(buildCounter);
+
+    // CPU time of the frames and the threads' job time, for the utilisation
+    std::vector<double> cpuFrameTimes;
+    cpuFrameTimes.reserve(headlessFrames);
+    double statsCPUTime = 0.0;
+    unsigned int statsTested = 0;
+    unsigned int statsVisible = 0;
+    std::vector<double> statsBusy, busy;
+    jobSystem.busyTimes(statsBusy);
+    std::vector<double> startBusy = statsBusy;
+    double loopStart = elapsedTime();
+    bool drawnFreeCam = false;
+    InputFrame previousFrameInput;
 
-        // Swap buffers
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    // Render loop
+    while (!quitRequested && (headless ? frame < headlessFrames : !glfwWindowShouldClose(window)))
+    {
+        Profiler::beginFrame();
+
+        // Update timer (headless runs step a fixed 1/60 s so every run draws the same frames)
+        double frameStart = elapsedTime();
+        double time = headless ? frame / 60.0 : frameStart;
+
+        // Get inputs, the ticks read them
+        if (!headless || replayPath != nullptr)
+        {
+            InputFrame input = headless ? inputLog.frames[frame] : pollInput(window, 1024, 768);
+            if (recordPath != nullptr)
+                inputLog.frames.push_back(input);
+            submitInput(input);
+            lightInput(input, previousFrameInput);
+            previousFrameInput = input;
+        }
+
+        // Start building this frame's packet. When pipelined the last frame's
+        // packet is drawn while it builds (so what is drawn is a frame behind),
+        // otherwise the build is waited for and drawn.
+        unsigned int buildIndex = pipelined ? drawIndex ^ 1 : drawIndex;
+        jobSystem.run([&, buildIndex, time] { buildPacket(packets[buildIndex], time); }, &buildCounter);
+        double waitTime = 0.0;
+        if (!pipelined)
+        {
+            ProfileScope waitScope("Wait for build");
+            jobSystem.wait(buildCounter);
+            waitTime = elapsedTime() - frameStart;
+        }
+        RenderPacket& packet = packets[drawIndex];
+        const Camera& drawCamera = packet.camera;
+
+        // Report free cam changes as they are drawn
+        if (drawCamera.isFreeCam != drawnFreeCam)
+        {
+            drawnFreeCam = drawCamera.isFreeCam;
+            std::cout << (drawnFreeCam ? "Enabling free cam" : "Disabling free cam") << std::endl;
+        }
+
+        // Clear the window
+        GPUProfileScope clearScope("Clear");
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        clearScope.stop();
+
+        // Activate shader
+        glUseProgram(program.id);
+
+        // Send light source properties to the shader
+        ProfileScope lightScope("Lights");
+        if (forwardLighting)
+            packet.lights.toShader(drawCamera.view);
+        else
+            packet.clusters.toShader(program);
+        lightScope.stop();
+        
+        // Send view and projection matrices to the shader
+        CameraBlock cameraBlock;
+        cameraBlock.view = drawCamera.view;
+        cameraBlock.projection = drawCamera.projection;
+        cameraBuffer.update(&cameraBlock, sizeof(cameraBlock));
+
+
+        // Drawing the player model
+        if (packet.drawPlayer)
+        {
+            GPUProfileScope gpuScope("Player");
+            program.setModelView(drawCamera.view * packet.playerModel);
+            catSphere.draw(program);
+        }
+
+        // Draw the objects
+        GPUProfileScope objectsScope("Objects");
+        renderer.draw(program, packet.objects);
+        objectsScope.stop();
+
+        //std::cout << camera.eye << std::endl;
+        //std::cout << playerCollided << std::endl;
+
+        if (packet.playerCollided) {
+            
+        }
+
+        // Draw light sources
+        GPUProfileScope lightSourcesScope("Light sources");
+        packet.lights.draw(program, lightSphere);
+        lightSourcesScope.stop();
+        double mainTime = elapsedTime() - frameStart - waitTime;
+
+        // Print the GL call and heap allocation counts once a second
+        GLStats::endFrame();
+        MemStats::endFrame();
+        statsFrames++;
+        statsTested += packet.culledTested;
+        statsVisible += packet.culledVisible;
+        double wallTime = elapsedTime();
+        if (wallTime - statsTime >= 1.0)
+        {
+            printf("GL calls per frame: %u (%u draws), heap allocations: %u (%zu bytes)\n",
+                GLStats::frameCalls, GLStats::frameDraws, MemStats::frameAllocations, MemStats::frameBytes);
+            printf("Collision pairs per tick: %u tested, %u found\n", packet.pairsTested, packet.pairsFound);
+            printf("Frustum culling per frame: %u tested, %u visible, %u culled\n", statsTested / statsFrames,
+                statsVisible / statsFrames, (statsTested - statsVisible) / statsFrames);
+            if (!forwardLighting)
+                printf("Clustered lighting: %zu lights, %u of %u clusters lit, %.1f lights per lit cluster (max %u)\n",
+                    packet.clusters.lights.size(), packet.clusters.litClusters, LightClusters::numClusters,
+                    packet.clusters.indices.size() / std::max(float(packet.clusters.litClusters), 1.0f),
+                    packet.clusters.maxClusterLights);
+            if (stressBullets > 0)
+                printf("Stress: %u bullets live, %.2f ms per frame, bullet pool %zu KB\n",
+                    packet.numBullets, (wallTime - statsTime) * 1000.0 / statsFrames, packet.bulletBytes / 1024);
+
+            // Share of the time each thread was busy (the main thread's jobs are part of its frame time)
+            jobSystem.busyTimes(busy);
+            printf("CPU frame time %.2f ms, busy: main %.0f%%", statsCPUTime * 1000.0 / statsFrames,
+                100.0 * statsCPUTime / (wallTime - statsTime));
+            for (unsigned int i = 1; i < busy.size(); i++)
+                printf(", worker %u %.0f%%", i, 100.0 * (busy[i] - statsBusy[i]) / (wallTime - statsTime));
+            printf(" (%u entities)\n", packet.numEntities);
+            statsBusy = busy;
+            statsCPUTime = 0.0;
+            statsTested = 0;
+            statsVisible = 0;
+            statsTime = wallTime;
+            statsFrames = 0;
+        }
+
+        if (headless)
+        {
+            // Wait for the frame to finish so its time includes the GPU work
+            ProfileScope finishScope("glFinish");
+            glFinish();
+            finishScope.stop();
+            if (dumpPrefix != nullptr && frame % dumpEvery == 0)
+            {
+                char path[1024];
+                snprintf(path, sizeof(path), "%s%04u.ppm", dumpPrefix, frame);
+                offscreen.savePPM(path);
+            }
+        }
+        else
+        {
+            // Swap buffers
+            ProfileScope swapScope("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+            swapScope.stop();
+            glfwPollEvents();
+        }
+
+        // The next frame draws this frame's packet. The CPU frame time is the
+        // main thread's work plus the time it waited for the build (running its jobs).
+        if (pipelined)
+        {
+            ProfileScope waitScope("Wait for build");
+            double waitStart = elapsedTime();
+            jobSystem.wait(buildCounter);
+            waitTime = elapsedTime() - waitStart;
+        }
+        drawIndex = buildIndex;
+        cpuFrameTimes.push_back(mainTime + waitTime);
+        statsCPUTime += mainTime + waitTime;
+        if (headless)
+            frameTimes.push_back(elapsedTime() - frameStart);
+        frame++;
+        Profiler::endFrame();
+    }
+    jobSystem.wait(buildCounter);
+    double loopTime = elapsedTime() - loopStart;
+
+    // Stop the simulation thread
+    stopSimulation = true;
+    if (simulationThread.joinable())
+        simulationThread.join();
+
+    // Print the profile and write the trace
+    if (profilePath != nullptr)
+    {
+        Profiler::finish();
+        Profiler::report();
+        Profiler::writeTrace(profilePath);
+    }
+
+    // Save the recorded input
+    if (recordPath != nullptr && inputLog.save(recordPath))
+        printf("Recorded %zu frames of input to %s\n", inputLog.frames.size(), recordPath);
+
+    // Print the CPU frame time and how busy each thread was over the run
+    double cpuMean = 0.0;
+    double mainBusy = 0.0;
+    std::vector<double> busyTimes;
+    jobSystem.busyTimes(busyTimes);
+    std::vector<double> workerBusy;
+    if (!cpuFrameTimes.empty())
+    {
+        for (double cpuTime : cpuFrameTimes)
+            cpuMean += cpuTime;
+        mainBusy = cpuMean / loopTime;
+        cpuMean *= 1000.0 / cpuFrameTimes.size();
+        std::sort(cpuFrameTimes.begin(), cpuFrameTimes.end());
+        printf("CPU frame time over %zu frames (%s, %u entities): mean %.2f ms, median %.2f ms, busy: main %.0f%%",
+            cpuFrameTimes.size(), pipelined ? "pipelined" : "not pipelined", entities.size(), cpuMean,
+            cpuFrameTimes[cpuFrameTimes.size() / 2] * 1000.0, 100.0 * mainBusy);
+        for (unsigned int i = 1; i < busyTimes.size(); i++)
+        {
+            workerBusy.push_back((busyTimes[i] - startBusy[i]) / loopTime);
+            printf(", worker %u %.0f%%", i, 100.0 * workerBusy.back());
+        }
+        printf("\n");
+    }
+
+    // Print the headless frame time summary (nearest rank percentiles)
+    if (!frameTimes.empty())
+    {
+        double total = 0.0;
+        for (double frameTime : frameTimes)
+            total += frameTime;
+        std::sort(frameTimes.begin(), frameTimes.end());
+        size_t n = frameTimes.size();
+        double mean = total * 1000.0 / n;
+        double median = frameTimes[n / 2] * 1000.0;
+        double p95 = frameTimes[std::min(n - 1, n * 95 / 100)] * 1000.0;
+        double p99 = frameTimes[std::min(n - 1, n * 99 / 100)] * 1000.0;
+        printf("Headless: %zu frames, frame time mean %.2f ms, median %.2f ms, p95 %.2f ms, p99 %.2f ms, "
+            "min %.2f ms, max %.2f ms\n", n, mean, median, p95, p99, frameTimes.front() * 1000.0,
+            frameTimes.back() * 1000.0);
+
+        // The toggles' final state, so a replay shows they took effect
+        glm::vec3 lightColour = lightSources.lightSources[0].colour;
+        FILE* file = statsPath != nullptr ? fopen(statsPath, "w") : NULL;
+        if (file != NULL)
+        {
+            fprintf(file, "{\n  \"frames\": %zu,\n  \"meanMs\": %.3f,\n  \"medianMs\": %.3f,\n  \"p95Ms\": %.3f,\n"
+                "  \"p99Ms\": %.3f,\n  \"minMs\": %.3f,\n  \"maxMs\": %.3f,\n  \"bulletsFired\": %u,\n"
+                "  \"teapotPickedUp\": %s,\n  \"thirdPerson\": %s,\n  \"freeCam\": %s,\n"
+                "  \"lightColour\": [%.1f, %.1f, %.1f],\n  \"directionalLight\": %s,\n"
+                "  \"cpuMeanMs\": %.3f,\n  \"mainBusy\": %.3f,\n  \"workerBusy\": [",
+                n, mean, median, p95, p99, frameTimes.front() * 1000.0, frameTimes.back() * 1000.0, bulletsFired,
+                teapotTrigger ? "true" : "false", camera.isThird ? "true" : "false",
+                camera.isFreeCam ? "true" : "false", lightColour.r, lightColour.g, lightColour.b,
+                lightSources.lightSources[1].enabled ? "true" : "false", cpuMean, mainBusy);
+            for (unsigned int i = 0; i < workerBusy.size(); i++)
+                fprintf(file, "%s%.3f", i > 0 ? ", " : "", workerBusy[i]);
+            fprintf(file, "]\n}\n");
+            fclose(file);
+        }
+        else if (statsPath != nullptr)
+            printf("Couldn't write %s\n", statsPath);
     }
 
     // Cleanup
@@ -530,25 +1216,97 @@ int main(void)
     bullet.deleteBuffers();
     walls.deleteBuffers();
     floor.deleteBuffers();
-    glDeleteProgram(shaderID);
+    crate.deleteBuffers();
+    lightSources.deleteBuffers();
+    for (RenderPacket& packet : packets)
+    {
+        packet.lights.deleteBuffers();
+        packet.clusters.deleteBuffers();
+    }
+    renderer.deleteBuffers();
+    cameraBuffer.destroy();
+    glDeleteProgram(program.id);
 
     // Close OpenGL window and terminate GLFW
-    glfwTerminate();
+    if (headless)
+        offscreen.destroy();
+    else
+        glfwTerminate();
     return 0;
 }
 
-void keyboardInput(GLFWwindow* window)
+void scriptedInput(float time)
+{
+    // Circle the room looking at the teapot, bobbing the view up and down
+    float angle = 0.5f * time;
+    camera.eye = glm::vec3(6.0f * cosf(angle), 0.0f, 6.0f * sinf(angle));
+    playerPosition = camera.eye;
+    camera.yaw = angle - PI / 2;
+    camera.pitch = 0.2f * sinf(time);
+
+    // Calculate camera vectors from the yaw and pitch angles
+    camera.calculateCameraVectors();
+}
+
+void submitInput(const InputFrame& input)
+{
+    // Keys pressed and released between two ticks still reach the next one
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    pendingInput.keys = input.keys;
+    pendingPresses |= input.keys;
+    pendingInput.cursorX += input.cursorX;
+    pendingInput.cursorY += input.cursorY;
+}
+
+InputFrame takeInput()
+{
+    // The input submitted since the last tick
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    InputFrame input = pendingInput;
+    input.keys |= pendingPresses;
+    pendingPresses = 0;
+    pendingInput.cursorX = 0.0f;
+    pendingInput.cursorY = 0.0f;
+    return input;
+}
+
+void publishSnapshot(double tickTime)
+{
+    // The latest snapshot becomes the previous one and is overwritten (the
+    // copies reuse the vectors' memory)
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    std::swap(previousSnapshot, latestSnapshot);
+    latestSnapshot.tickTime = tickTime;
+    latestSnapshot.camera = camera;
+    latestSnapshot.playerPosition = playerPosition;
+    latestSnapshot.playerAngle = playerAngle;
+    latestSnapshot.teapotTrigger = teapotTrigger;
+    latestSnapshot.playerCollided = playerCollided;
+    latestSnapshot.entities = entities;
+    latestSnapshot.bullets = bullets;
+    latestSnapshot.pairsTested = collisionGrid.pairsTested;
+    latestSnapshot.pairsFound = collisionGrid.pairsFound;
+}
+
+double elapsedTime()
+{
+    // Seconds since the first call (glfwGetTime needs GLFW, which headless mode doesn't start)
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void keyboardInput(const InputFrame& input, const InputFrame& previous)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    if (input.down(INPUT_ESCAPE))
+        quitRequested = true;
 
     // Reseting movement vector when the key is released
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_RELEASE || glfwGetKey(window, GLFW_KEY_S) == GLFW_RELEASE)
+    if (!input.down(INPUT_W) || !input.down(INPUT_S))
     {
         playerDirection.z = 0.0f;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_RELEASE || glfwGetKey(window, GLFW_KEY_D) == GLFW_RELEASE)
+    if (!input.down(INPUT_A) || !input.down(INPUT_D))
     {
         playerDirection.x = 0.0f;
     }
@@ -556,17 +1314,17 @@ void keyboardInput(GLFWwindow* window)
     glm::vec3 movementVector = Maths::normalise(glm::vec3(camera.front.x, 0.0f, camera.front.z)); // Camera front vector with no y (used to lock movement to x and z axis)
 
     // Move the camera / player using WSAD keys
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (input.down(INPUT_W))
     {
         if (camera.isThird)
         {
             playerPosition += 5.0f * deltaTime * movementVector;
 
             // Special case required for diagonal movement (repeated in A key press) as subtracting 1/4 results in the same diagonal as S and D
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (3 * PI / 4), glfwGetTime() * deltaTime);
+            if (input.down(INPUT_A))
+                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (3 * PI / 4), currentTime * deltaTime);
             else
-                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (PI / 2), glfwGetTime() * deltaTime);
+                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (PI / 2), currentTime * deltaTime);
             //playerAngle = -camera.yaw;
             //std::cout << -camera.yaw << std::endl;
         }
@@ -580,12 +1338,12 @@ void keyboardInput(GLFWwindow* window)
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (input.down(INPUT_S))
     {
         if (camera.isThird)
         {
             playerPosition -= 5.0f * deltaTime * movementVector;
-            playerAngle = Maths::lerp(playerAngle, -camera.yaw - (PI / 2), glfwGetTime() * deltaTime);
+            playerAngle = Maths::lerp(playerAngle, -camera.yaw - (PI / 2), currentTime * deltaTime);
             //playerAngle = -camera.yaw - PI;
         }
         else if (camera.isFreeCam)
@@ -598,15 +1356,15 @@ void keyboardInput(GLFWwindow* window)
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (input.down(INPUT_A))
     {
         if (camera.isThird)
         {
             playerPosition -= 5.0f * deltaTime * camera.right;
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (3 * PI / 4), glfwGetTime() * deltaTime);
+            if (input.down(INPUT_W))
+                playerAngle = Maths::lerp(playerAngle, -camera.yaw + (3 * PI / 4), currentTime * deltaTime);
             else
-                playerAngle = Maths::lerp(playerAngle, -camera.yaw - PI, glfwGetTime() * deltaTime);
+                playerAngle = Maths::lerp(playerAngle, -camera.yaw - PI, currentTime * deltaTime);
             //playerAngle = -camera.yaw + (PI / 2);
         }
         else
@@ -615,12 +1373,12 @@ void keyboardInput(GLFWwindow* window)
         }
     }
 
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (input.down(INPUT_D))
     {
         if (camera.isThird)
         {
             playerPosition += 5.0f * deltaTime * camera.right;
-            playerAngle = Maths::lerp(playerAngle, -camera.yaw, glfwGetTime() * deltaTime);
+            playerAngle = Maths::lerp(playerAngle, -camera.yaw, currentTime * deltaTime);
             //playerAngle = -camera.yaw - (PI / 2);
         }
         else
@@ -630,129 +1388,87 @@ void keyboardInput(GLFWwindow* window)
     }
     
     // Jumping
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+    if (input.down(INPUT_SPACE)) {
         if (!camera.isJumping) {
             cameraBaseY = camera.eye.y;
             camera.isJumping = true;
         }
     }
 
-    // Shooting
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    // Shooting (one bullet per press)
+    if (input.pressed(INPUT_E, previous) && teapotTrigger)
     {
-        if (glfwGetKey(window, GLFW_KEY_E) == GLFW_RELEASE)
-        {
-            if (teapotTrigger)
-            {
-                bulletObject.position = camera.eye + movementVector * 1.2f;
-                bulletObject.angle = -camera.yaw;
-                bulletDirection = movementVector;
-                objects.push_back(bulletObject);
-            }
-        }
+        bulletDirection = movementVector;
+        bullets.fire(camera.eye + movementVector * 1.2f, bulletDirection * 20.0f, -camera.yaw);
+        bulletsFired++;
     }
 
     // Third / first person swap
-    if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS)
+    if (input.pressed(INPUT_ENTER, previous) && !camera.isFreeCam)
     {
-        if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_RELEASE && !camera.isFreeCam)
-        {
-            playerPosition = camera.eye;
-            playerAngle = -camera.yaw + (PI / 2);
-            camera.isThird = !camera.isThird;
-
-        }
+        playerPosition = camera.eye;
+        playerAngle = -camera.yaw + (PI / 2);
+        camera.isThird = !camera.isThird;
     }
 
     // Free cam
-    if (glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_PRESS)
+    if (input.pressed(INPUT_BACKSPACE, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_RELEASE)
-        {
-            camera.isThird = false;
-            camera.isFreeCam = !camera.isFreeCam;
-            if (camera.isFreeCam) {
-                std::cout << "Enabling free cam" << std::endl;
-            }
-            else {
-                std::cout << "Disabling free cam" << std::endl;
-            }
-        }
+        camera.isThird = false;
+        camera.isFreeCam = !camera.isFreeCam;
     }
 
+}
 
+void mouseInput(const InputFrame& input)
+{
+    // Update yaw and pitch angles from the cursor movement
+    camera.yaw += 0.005f * input.cursorX;
+    //std::cout << asinf(sinf(camera.yaw)) << std::endl;
+    //playerTargetAngle += camera.yaw * camera.pitch;
+    camera.pitch -= 0.005f * input.cursorY;
+    if (camera.isThird)
+        camera.pitch = Maths::clamp(camera.pitch, -1.2f, 0.5f);
+    else
+        camera.pitch = Maths::clamp(camera.pitch, -1.2, 1.2);
+
+    // Calculate camera vectors from the yaw and pitch angles
+    camera.calculateCameraVectors();
+}
+
+void lightInput(const InputFrame& input, const InputFrame& previous)
+{
     // Changing light colours
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+    if (input.pressed(INPUT_1, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_RELEASE)
-        {
-            lightSources.lightSources[0].colour = glm::vec3(0.0f, 0.0f, 0.0f);
-            std::cout << "Changing light colour to black" << std::endl;
-        }
+        lightSources.lightSources[0].colour = glm::vec3(0.0f, 0.0f, 0.0f);
+        std::cout << "Changing light colour to black" << std::endl;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    if (input.pressed(INPUT_2, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_RELEASE)
-        {
-            lightSources.lightSources[0].colour = glm::vec3(1.0f, 1.0f, 1.0f);
-            std::cout << "Changing light colour to white" << std::endl;
-        }
+        lightSources.lightSources[0].colour = glm::vec3(1.0f, 1.0f, 1.0f);
+        std::cout << "Changing light colour to white" << std::endl;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+    if (input.pressed(INPUT_3, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_RELEASE)
-        {
-            lightSources.lightSources[0].colour = glm::vec3(1.0f, 0.0f, 0.0f);
-            std::cout << "Changing light colour to red" << std::endl;
-        }
+        lightSources.lightSources[0].colour = glm::vec3(1.0f, 0.0f, 0.0f);
+        std::cout << "Changing light colour to red" << std::endl;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+    if (input.pressed(INPUT_4, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_4) == GLFW_RELEASE)
-        {
-            lightSources.lightSources[0].colour = glm::vec3(0.0f, 1.0f, 0.0f);
-            std::cout << "Changing light colour to green" << std::endl;
-        }
+        lightSources.lightSources[0].colour = glm::vec3(0.0f, 1.0f, 0.0f);
+        std::cout << "Changing light colour to green" << std::endl;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
+    if (input.pressed(INPUT_5, previous))
     {
-        if (glfwGetKey(window, GLFW_KEY_5) == GLFW_RELEASE)
-        {
-            lightSources.lightSources[0].colour = glm::vec3(0.0f, 0.0f, 1.0f);
-            std::cout << "Changing light colour to blue" << std::endl;
-        }
+        lightSources.lightSources[0].colour = glm::vec3(0.0f, 0.0f, 1.0f);
+        std::cout << "Changing light colour to blue" << std::endl;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) 
-    {
-        if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_RELEASE) 
-        {
-            lightSources.lightSources[1].enabled = !lightSources.lightSources[1].enabled;
-        }
-    }
+    if (input.pressed(INPUT_Q, previous))
+        lightSources.lightSources[1].enabled = !lightSources.lightSources[1].enabled;
 }
-
-void mouseInput(GLFWwindow* window)
-{
-    // Get mouse cursor position and reset to centre
-    double xPos, yPos;
-    glfwGetCursorPos(window, &xPos, &yPos);
-    glfwSetCursorPos(window, 1024 / 2, 768 / 2);
-
-    // Update yaw and pitch angles
-    camera.yaw += 0.005f * float(xPos - 1024 / 2);
-    //std::cout << asinf(sinf(camera.yaw)) << std::endl;
-    //playerTargetAngle += camera.yaw * camera.pitch;
-    camera.pitch += 0.005f * float(768 / 2 - yPos);
-    if (camera.isThird)
-        camera.pitch = Maths::clamp(camera.pitch, -1.2f, 0.5f);
-    else
-        camera.pitch = Maths::clamp(camera.pitch, -1.2, 1.2);
-
-    // Calculate camera vectors from the yaw and pitch angles
-    camera.calculateCameraVectors();
-}
\ No newline at end of file
@@ -4,28 +4,34 @@
 
 // Inputs
 in vec2 UV;
-in vec3 fragmentPosition;
-in vec3 tangentSpaceLightPosition[maxLights];
-in vec3 tangentSpaceLightDirection[maxLights];
-
+in vec3 viewPosition;
+in vec3 viewNormal;
+in vec4 viewTangent;
 
 // Outputs
 out vec3 fragmentColour;
 out vec3 colour;
 
-// Light struct
+// Light struct (std140, matches LightBlock in light.hpp)
 struct Light
 {
     vec3 position;
-    vec3 colour;
-    vec3 direction;
     float constant;
+    vec3 colour;
     float linear;
+    vec3 direction;
     float quadratic;
     float cosPhi;
     int type;
 };
 
+// Uniform blocks (updated once per frame, positions and directions in view space)
+layout(std140) uniform Lights
+{
+    Light lightSources[maxLights];
+    int numLights;
+};
+
 // Uniforms
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
@@ -34,7 +40,6 @@ uniform float ka;
 uniform float kd;
 uniform float ks;
 uniform float Ns;
-uniform Light lightSources[maxLights];
 uniform vec3 lightColour;
 
 // Function prototypes
@@ -46,20 +51,30 @@ vec3 spotLight(vec3 lightPosition, vec3 direction, vec3 lightColour,
 
 vec3 directionalLight(vec3 lightDirection, vec3 lightColour);
 
-// Get the normal vector from the normal map
-vec3 Normal = normalize(2.0 * vec3(texture(normalMap, UV)) - 1.0);
+// View space fragment position and normal (from the normal map)
+vec3 fragmentPosition;
+vec3 Normal;
 
 void main ()
 {
     colour = lightColour;
+    fragmentPosition = viewPosition;
+
+    // Move the normal map sample from tangent space to view space
+    vec3 n = normalize(viewNormal);
+    vec3 t = normalize(viewTangent.xyz);
+    t = normalize(t - dot(t, n) * n);
+    // The packed handedness only keeps its sign (GL 3.3 decodes a 2-bit -1 as -1/3)
+    vec3 b = cross(n, t) * (viewTangent.w < 0.0 ? -1.0 : 1.0);
+    Normal = normalize(mat3(t, b, n) * (2.0 * vec3(texture(normalMap, UV)) - 1.0));
 
     fragmentColour = vec3(0.0, 0.0, 0.0);
-    for (int i = 0; i < maxLights; i++)
+    for (int i = 0; i < numLights; i++)
     {
         // Determine light properties for current light source
-        vec3 lightPosition  = tangentSpaceLightPosition[i];
+        vec3 lightPosition  = lightSources[i].position;
         vec3 lightColour    = lightSources[i].colour;
-        vec3 lightDirection = tangentSpaceLightDirection[i];
+        vec3 lightDirection = lightSources[i].direction;
         float constant      = lightSources[i].constant;
         float linear        = lightSources[i].linear;
         float quadratic     = lightSources[i].quadratic;
@@ -1,66 +1,59 @@
 #version 330 core
 
-# define maxLights 10
-
 // Inputs
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 uv;
 layout(location = 2) in vec3 normal;
-layout(location = 3) in vec3 tangent;
-layout(location = 4) in vec3 bitangent;
+layout(location = 3) in vec4 tangent;     // w is the handedness
+layout(location = 5) in mat4 instanceModel;
+layout(location = 9) in vec4 instanceColour;
+layout(location = 10) in mat3 instanceNormal;
 
-// Outputs
+// Outputs (lighting is done in view space, so no per light outputs)
 out vec2 UV;
-out vec3 fragmentPosition;
-out vec3 tangentSpaceLightPosition[maxLights];
-out vec3 tangentSpaceLightDirection[maxLights];
+out vec3 viewPosition;
+out vec3 viewNormal;
+out vec4 viewTangent;
 out vec3 colour;
 
-// Light struct
-struct Light
+// Uniform blocks (updated once per frame)
+layout(std140) uniform Camera
 {
-    vec3 position;
-    vec3 colour;
-    vec3 direction;
-    float constant;
-    float linear;
-    float quadratic;
-    float cosPhi;
-    int type;
+    mat4 view;
+    mat4 projection;
 };
 
 // Uniforms
-uniform mat4 MVP;
 uniform mat4 MV;
-uniform Light lightSources[maxLights];
+uniform mat3 normalMatrix;
 uniform vec3 lightColour;
+uniform bool instanced;
 
 void main()
 {
+    // Instanced draws take the model matrix, normal matrix and colour from the
+    // instance buffer (the view only rotates and translates, so mat3(view)
+    // moves world space normals to view space)
+    mat4 modelView = MV;
+    mat3 normalView = normalMatrix;
     colour = lightColour;
+    if (instanced)
+    {
+        modelView = view * instanceModel;
+        normalView = mat3(view) * instanceNormal;
+        colour = vec3(instanceColour);
+    }
 
     // Output vertex position
-    gl_Position = MVP * vec4(position, 1.0);
-    
+    vec4 position4 = modelView * vec4(position, 1.0);
+    gl_Position = projection * position4;
+
     // Output texture co-ordinates
     UV = uv;
-    
-    // Calculate the TBN matrix that transforms view space to tangent space
-    mat3 invMV = transpose(inverse(mat3(MV)));
-    vec3 t     = normalize(invMV * tangent);
-    //vec3 b     = normalize(invMV * bitangent);
-    vec3 n     = normalize(invMV * normal);
-    t = normalize(t - dot(t, n) * n);
-    vec3 b     = cross(n, t);
-    mat3 TBN   = transpose(mat3(t, b, n));
-    
-    // Output tangent space fragment position, light positions and directions
-    fragmentPosition = TBN * vec3(MV * vec4(position, 1.0));
-    
-    for (int i = 0; i < maxLights; i++)
-    {
-        tangentSpaceLightPosition[i]  = TBN * lightSources[i].position;
-        tangentSpaceLightDirection[i] = TBN * lightSources[i].direction;
-    }
-}
 
+    // Output the view space position, normal and tangent (the fragment shader
+    // builds the TBN matrix from them)
+    viewPosition = vec3(position4);
+    viewNormal   = normalView * normal;
+    viewTangent  = vec4(normalView * tangent.xyz, tangent.w);
+}